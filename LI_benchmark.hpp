@@ -0,0 +1,614 @@
+#ifndef LI_BENCHMARK_H
+#define LI_BENCHMARK_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "LI_stereocamera.hpp"
+
+/*
+ * Benchmarks of the frame path
+ *
+ * Times the pieces of work done on every frame, with no camera and no
+ * display needed: the YUYV split (with every kernel the CPU supports),
+ * the preprocessing of an eye for the cascades, the cascade detection at
+ * several scales (and with the models parsed for every frame, as they
+ * once were), the eye detection for more and more faces, the
+ * rectification of a pair with float and fixed-point maps, the disparity
+ * map of a pair on a single core, and whole frames through the pipeline
+ * of a camera (fed through push_frame() or replay(), like streamed
+ * frames), with the two images of a frame scanned for faces one after
+ * the other or at the same time, in full or along the epipolar bands of
+ * the faces of the left one, and on every frame or tracked between
+ * periodic full scans. Frames are either synthetic (see
+ * synthetic_frame()) or taken from a recording.
+ *
+ * Results come with their median and 99th percentile times and the frame
+ * rate they allow, and whether they fit in their budget if they have one
+ * (the 33 ms of a frame at 30 fps for the disparities), as text or as
+ * JSON for tracking regressions:
+ *
+ *   LI_benchmark benchmark;
+ *   std::vector<uint8_t> yuyv;
+ *   LI_benchmark::synthetic_frame(640, 480, yuyv);
+ *   benchmark.deinterleave(yuyv, 640, 480);
+ *   benchmark.end_to_end(LI_config(), yuyv, 640, 480);
+ *   benchmark.write_json(std::cout);
+ */
+
+struct LI_benchmark_result {
+  std::string name;
+  unsigned int iterations;
+
+  // Times per iteration, in microseconds.
+  double p50_us;
+  double p99_us;
+  double mean_us;
+
+  // Iterations per second, and bytes processed per second where that
+  // makes sense (0 otherwise).
+  double fps;
+  double bytes_per_s;
+
+  // Time (in microseconds) an iteration has to fit in, 0 if there is no
+  // such budget. The 99th percentile is held against it.
+  double budget_us;
+
+  LI_benchmark_result() :
+    iterations(0),
+    p50_us(0),
+    p99_us(0),
+    mean_us(0),
+    fps(0),
+    bytes_per_s(0),
+    budget_us(0) {
+
+  }
+};
+
+class LI_benchmark {
+  unsigned int iterations;
+  unsigned int warmup;
+
+  std::vector<LI_benchmark_result> results;
+  std::vector<double> samples;
+
+  // Fills in a result from the samples (in microseconds) and the wall
+  // time of the whole run.
+  LI_benchmark_result& summarize(
+    const std::string& name, std::vector<double>& samples,
+    double wall_us, size_t bytes) {
+
+    LI_benchmark_result result;
+    result.name = name;
+    result.iterations = (unsigned int) samples.size();
+
+    if (!samples.empty()) {
+      std::sort(samples.begin(), samples.end());
+
+      double sum = 0;
+      for (size_t i = 0; i < samples.size(); ++i)
+        sum += samples[i];
+
+      result.p50_us = samples[samples.size() / 2];
+      result.p99_us = samples[std::min(samples.size() - 1,
+        (size_t) (samples.size() * 0.99))];
+      result.mean_us = sum / samples.size();
+
+      if (wall_us > 0) {
+        result.fps = samples.size() * 1e6 / wall_us;
+        result.bytes_per_s = (double) bytes * samples.size() * 1e6 / wall_us;
+      }
+    }
+
+    this->results.push_back(result);
+    return this->results.back();
+  }
+
+  // Times every call of body() after a few untimed ones.
+  template <typename Body>
+  LI_benchmark_result& time(
+    const std::string& name, size_t bytes, const Body& body) {
+
+    typedef std::chrono::steady_clock clock;
+
+    for (unsigned int i = 0; i < this->warmup; ++i)
+      body();
+
+    this->samples.clear();
+    clock::time_point begin = clock::now();
+
+    for (unsigned int i = 0; i < this->iterations; ++i) {
+      clock::time_point start = clock::now();
+      body();
+      this->samples.push_back(std::chrono::duration<double, std::micro>(
+        clock::now() - start).count());
+    }
+
+    double wall_us = std::chrono::duration<double, std::micro>(
+      clock::now() - begin).count();
+    return this->summarize(name, this->samples, wall_us, bytes);
+  }
+
+  static const char* simd_name(LI_simd_t simd) {
+    switch (simd) {
+      case LI_SIMD_SCALAR: return "scalar";
+      case LI_SIMD_SSE2: return "sse2";
+      case LI_SIMD_AVX2: return "avx2";
+      case LI_SIMD_NEON: return "neon";
+      default: return "auto";
+    }
+  }
+
+  static uint8_t pattern(int x, int y, int noise) {
+    int cx = (x % 160) - 80, cy = (y % 160) - 80;
+    int blob = (cx * cx + cy * cy < 40 * 40) ? 96 : 0;
+
+    return (uint8_t) std::min(255, (x + y) / 5 + blob + noise);
+  }
+
+  static std::string scale_name(double scale) {
+    std::ostringstream name;
+    name << "x" << scale;
+    return name.str();
+  }
+
+  // Runs frames through a camera built with the given settings, timing
+  // each from the frame callback to a last stage added for the purpose.
+  template <typename Feed>
+  void pipeline(
+    const std::string& name, const LI_config& config, size_t bytes,
+    const Feed& feed) {
+
+    typedef std::chrono::steady_clock clock;
+
+    // Latencies are written by the workers into preallocated slots.
+    std::vector<double> latencies(this->warmup + 4 * (size_t) this->iterations);
+    std::atomic<size_t> recorded(0);
+    std::atomic<unsigned long long> seen(0), finished(0);
+    unsigned int warmup = this->warmup;
+
+    LI_stereocamera camera(config);
+
+    camera.add_stage([&](LI_stereo_frame& frame) {
+      double latency = std::chrono::duration<double, std::micro>(
+        clock::now() - frame.info.arrival).count();
+
+      if (seen++ >= warmup) {
+        size_t slot = recorded++;
+        if (slot < latencies.size())
+          latencies[slot] = latency;
+      }
+      ++finished;
+      return LI_SUCCESS;
+    });
+
+    feed(camera, this->warmup);
+    while (finished + camera.dropped_frames() < this->warmup)
+      std::this_thread::yield();
+
+    clock::time_point begin = clock::now();
+    feed(camera, this->iterations);
+
+    // Wait for the pipeline to empty (frames dropped never show up).
+    unsigned long long expected = this->warmup + this->iterations;
+    while (finished + camera.dropped_frames() < expected)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    double wall_us = std::chrono::duration<double, std::micro>(
+      clock::now() - begin).count();
+
+    latencies.resize(std::min(latencies.size(), (size_t) recorded));
+    this->summarize(name, latencies, wall_us, bytes);
+  }
+
+public:
+  explicit LI_benchmark(unsigned int iterations = 200, unsigned int warmup = 10) :
+    iterations(std::max(1u, iterations)),
+    warmup(warmup) {
+
+  }
+
+  // A YUYV stereo frame with some structure to it (gradients and a few
+  // face-sized blobs) so that histograms and cascades have work to do.
+  // The right image is the left one shifted by a few pixels.
+  static void synthetic_frame(
+    int width, int height, std::vector<uint8_t>& yuyv, unsigned int seed = 1) {
+
+    yuyv.resize(2 * (size_t) width * height);
+
+    for (int y = 0; y < height; ++y) {
+      uint8_t *row = &yuyv[2 * (size_t) width * y];
+
+      for (int x = 0; x < width; ++x) {
+        seed = seed * 1103515245u + 12345u;
+        int noise = (int) ((seed >> 16) & 15);
+
+        row[2 * x] = LI_benchmark::pattern(x, y, noise);
+        row[2 * x + 1] = LI_benchmark::pattern(x + 8, y, noise);
+      }
+    }
+  }
+
+  // The YUYV split, once per kernel the CPU supports.
+  void deinterleave(const std::vector<uint8_t>& yuyv, int width, int height) {
+    std::vector<uint8_t> left((size_t) width * height);
+    std::vector<uint8_t> right((size_t) width * height);
+
+    const LI_simd_t kernels[] = {
+      LI_SIMD_SCALAR, LI_SIMD_SSE2, LI_SIMD_AVX2, LI_SIMD_NEON
+    };
+
+    for (unsigned int i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i) {
+      LI_simd_t simd = kernels[i];
+      if (!LI_simd_supported(simd))
+        continue;
+
+      this->time(std::string("deinterleave/") + simd_name(simd), yuyv.size(),
+        [&]() {
+          LI_deinterleave_yuyv(&yuyv[0], 2 * (size_t) width, width, height,
+            &left[0], width, &right[0], width, simd);
+        });
+    }
+  }
+
+  // Shrinking and equalising one eye for the cascades, as the face
+  // detection does, at each of the scales.
+  void preprocess(const cv::Mat& eye, const std::vector<double>& scales) {
+    cv::Mat small;
+
+    for (unsigned int i = 0; i < scales.size(); ++i) {
+      double scale = scales[i];
+
+      this->time("preprocess/" + scale_name(scale), eye.total(), [&]() {
+        cv::Size size(cvRound(eye.cols/scale), cvRound(eye.rows/scale));
+
+        if (size == eye.size())
+          cv::equalizeHist(eye, small);
+        else {
+          cv::resize(eye, small, size, 0, 0, cv::INTER_LINEAR);
+          cv::equalizeHist(small, small);
+        }
+      });
+    }
+  }
+
+  // A full multi-scale scan of one (already equalised) eye, at each of the
+  // scales. Returns false if the model cannot be loaded.
+  bool detection(
+    const cv::Mat& eye, const std::string& model,
+    const std::vector<double>& scales) {
+
+    cv::CascadeClassifier cascade;
+    if (!cascade.load(model))
+      return false;
+
+    cv::Mat small;
+    std::vector<cv::Rect> faces;
+
+    for (unsigned int i = 0; i < scales.size(); ++i) {
+      double scale = scales[i];
+      cv::resize(eye, small, cv::Size(cvRound(eye.cols/scale),
+        cvRound(eye.rows/scale)), 0, 0, cv::INTER_LINEAR);
+
+      this->time("detection/" + scale_name(scale), small.total(), [&]() {
+        cascade.detectMultiScale(small, faces, 1.1, 2,
+          cv::CASCADE_SCALE_IMAGE, cv::Size(30, 30));
+      });
+    }
+    return true;
+  }
+
+  // A scan of one (already equalised) eye, first with both models parsed
+  // before it, as process_frame did on every frame before the models were
+  // cached, then with the classifiers of an LI_detector loaded once.
+  // Returns false if a model cannot be loaded.
+  bool cascade_loading(
+    const cv::Mat& eye, const std::string& model,
+    const std::string& nested_model) {
+
+    LI_cascade_models models(model, nested_model);
+    LI_detector detector;
+    if (!detector.update(models))
+      return false;
+
+    std::vector<cv::Rect> faces;
+
+    this->time("cascade_loading/per_frame", eye.total(), [&]() {
+      cv::CascadeClassifier cascade, nested_cascade;
+      cascade.load(model);
+      if (!nested_model.empty())
+        nested_cascade.load(nested_model);
+
+      cascade.detectMultiScale(eye, faces, 1.1, 2,
+        cv::CASCADE_SCALE_IMAGE, cv::Size(30, 30));
+    });
+
+    this->time("cascade_loading/cached", eye.total(), [&]() {
+      detector.update(models);
+      detector.cascade.detectMultiScale(eye, faces, 1.1, 2,
+        cv::CASCADE_SCALE_IMAGE, cv::Size(30, 30));
+    });
+    return true;
+  }
+
+  // The eye detection of a frame with each of the numbers of faces, spread
+  // over a pool of the given number of threads. The faces are boxes of
+  // 'size' pixels laid over the image row by row (over the blobs of a
+  // synthetic frame), and are all scanned. Returns false if the nested
+  // model cannot be loaded.
+  bool eye_detection(
+    const cv::Mat& eye, const std::string& nested_model,
+    const std::vector<unsigned int>& face_counts,
+    unsigned int threads, int size = 100) {
+
+    LI_cascade_models models("", nested_model);
+    LI_eye_detector detector;
+    LI_eye_scratch scratch;
+    LI_threadpool pool(threads);
+
+    LI_eye_config config;
+    config.enabled = true;
+    config.max_faces = 0;
+
+    int columns = std::max(1, eye.cols / 160);
+    int rows = std::max(1, eye.rows / 160);
+    std::vector<LI_face> faces;
+
+    for (unsigned int i = 0; i < face_counts.size(); ++i) {
+      faces.resize(face_counts[i]);
+      for (unsigned int j = 0; j < faces.size(); ++j) {
+        int cell = (int) j % (columns * rows);
+        faces[j].left = cv::Rect(80 + 160 * (cell % columns) - size / 2,
+          80 + 160 * (cell / columns) - size / 2, size, size);
+      }
+
+      if (!detector.detect(models, config, eye, eye, faces, scratch,
+            LI_PARALLEL_THREADS, &pool))
+        return false;
+
+      std::ostringstream name;
+      name << "eyes/" << faces.size();
+
+      this->time(name.str(), (size_t) size * size * faces.size(), [&]() {
+        detector.detect(models, config, eye, eye, faces, scratch,
+          LI_PARALLEL_THREADS, &pool);
+      });
+    }
+    return true;
+  }
+
+  // Rectifying both images of a pair, first with float maps and then with
+  // the fixed-point ones LI_rectifier builds, for a made-up calibration
+  // with some lens distortion and a slight rotation.
+  void rectification(const cv::Mat& left, const cv::Mat& right) {
+    cv::Size size = left.size();
+
+    cv::Mat M = (cv::Mat_<double>(3, 3) <<
+      size.width, 0, size.width / 2.0,
+      0, size.width, size.height / 2.0,
+      0, 0, 1);
+    cv::Mat D = (cv::Mat_<double>(1, 5) << -0.2, 0.05, 0.001, -0.001, 0);
+    cv::Mat R;
+    cv::Rodrigues(cv::Vec3d(0.01, -0.02, 0.005), R);
+
+    cv::Mat map_x, map_y, map_xy, map_weights;
+    cv::initUndistortRectifyMap(M, D, R, M, size, CV_32FC1, map_x, map_y);
+    cv::convertMaps(map_x, map_y, map_xy, map_weights, CV_16SC2);
+
+    cv::Mat rectified[2];
+    const cv::Mat *eyes[2] = { &left, &right };
+
+    this->time("rectification/float", 2 * left.total(), [&]() {
+      for (int eye = 0; eye < 2; ++eye)
+        cv::remap(*eyes[eye], rectified[eye], map_x, map_y,
+          cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+    });
+
+    this->time("rectification/fixed", 2 * left.total(), [&]() {
+      for (int eye = 0; eye < 2; ++eye)
+        cv::remap(*eyes[eye], rectified[eye], map_xy, map_weights,
+          cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+    });
+  }
+
+  // The disparity map of a pair with each of the settings, on a single
+  // core (OpenCV's own threads are turned off for the run) and against
+  // the time between two frames at the given rate.
+  void disparity(
+    const cv::Mat& left, const cv::Mat& right,
+    const std::vector<LI_depth_config>& configs, double fps = 30) {
+
+    int threads = cv::getNumThreads();
+    cv::setNumThreads(0);
+
+    cv::Mat map;
+    cv::Rect roi;
+
+    for (unsigned int i = 0; i < configs.size(); ++i) {
+      LI_depth_estimator estimator(configs[i]);
+      const LI_depth_config& settings = estimator.settings();
+
+      std::ostringstream name;
+      name << "disparity/" <<
+        (LI_DEPTH_SGBM == settings.algorithm ? "sgbm" : "bm") << "/" <<
+        settings.num_disparities;
+      if (1 != settings.downscale)
+        name << "/x" << settings.downscale;
+      if (!settings.roi.empty())
+        name << "/roi";
+
+      LI_benchmark_result& result = this->time(name.str(), left.total(),
+        [&]() {
+          estimator.compute(left, right, map, roi);
+        });
+      result.budget_us = 1e6 / fps;
+    }
+
+    cv::setNumThreads(threads);
+  }
+
+  // The face detection of whole frames in LI_DETECT_DUAL mode, scanning
+  // the two images one after the other and then at the same time, on a
+  // single worker so that only the latency of a frame is measured.
+  // 'config' gives the models.
+  void dual_detection(
+    LI_config config, const std::vector<uint8_t>& yuyv, int width, int height) {
+
+    config.face_detection = true;
+    config.detect_mode = LI_DETECT_DUAL;
+    config.workers = 1;
+
+    config.parallel = LI_PARALLEL_NONE;
+    this->end_to_end(config, yuyv, width, height, LI_BLOCK,
+      "dual_detection/serial");
+
+    config.parallel = LI_PARALLEL_THREADS;
+    config.parallel_threads = std::max(1u, config.parallel_threads);
+    this->end_to_end(config, yuyv, width, height, LI_BLOCK,
+      "dual_detection/concurrent");
+  }
+
+  // Whole frames through the pipeline of a camera built with the given
+  // settings, from the frame callback to the end of the stages. Frames
+  // are pushed as fast as the pipeline takes them, LI_BLOCK (the default
+  // here) avoiding drops.
+  void end_to_end(
+    LI_config config, const std::vector<uint8_t>& yuyv, int width, int height,
+    LI_overflow_t overflow = LI_BLOCK, const std::string& name = "end_to_end") {
+
+    config.overflow = overflow;
+    config.mode.width = width;
+    config.mode.height = height;
+
+    uvc_frame_t frame;
+    std::memset(&frame, 0, sizeof(frame));
+    frame.data = (void*) &yuyv[0];
+    frame.data_bytes = yuyv.size();
+    frame.width = width;
+    frame.height = height;
+    frame.step = 2 * (size_t) width;
+
+    this->pipeline(name, config, yuyv.size(),
+      [&](LI_stereocamera& camera, unsigned int count) {
+        for (unsigned int i = 0; i < count; ++i) {
+          frame.sequence = i;
+          camera.push_frame(&frame);
+        }
+      });
+  }
+
+  // The same with the frames of a recording, replayed as fast as possible.
+  void end_to_end(
+    LI_config config, const LI_replay& source,
+    LI_overflow_t overflow = LI_BLOCK,
+    const std::string& name = "end_to_end/replay") {
+
+    if (0 == source.frames())
+      return;
+
+    LI_record_header header;
+    source.frame(0, header);
+
+    config.overflow = overflow;
+    config.mode.width = header.width;
+    config.mode.height = header.height;
+
+    // Exactly 'count' frames per call, going round the recording, so that
+    // the pipeline is waited for the very frames fed.
+    size_t position = 0;
+
+    this->pipeline(name, config, header.payload_bytes,
+      [&](LI_stereocamera& camera, unsigned int count) {
+        for (size_t done = 0; done < count; ) {
+          size_t fed = camera.replay(source, false, position, count - done);
+          done += fed;
+          position = (position + fed) % source.frames();
+        }
+      });
+  }
+
+  // The face detection of the frames of a recording, first scanning both
+  // images in full (LI_DETECT_DUAL) and then the right one only along the
+  // epipolar bands of the faces found in the left one. The scans run one
+  // after the other on a single worker. 'config' gives the models.
+  void epipolar_detection(LI_config config, const LI_replay& source) {
+    config.face_detection = true;
+    config.workers = 1;
+    config.parallel = LI_PARALLEL_NONE;
+
+    config.detect_mode = LI_DETECT_DUAL;
+    this->end_to_end(config, source, LI_BLOCK, "epipolar_detection/full");
+
+    config.detect_mode = LI_DETECT_EPIPOLAR;
+    this->end_to_end(config, source, LI_BLOCK, "epipolar_detection/bands");
+  }
+
+  // The face detection of the frames of a recording, first scanning every
+  // frame in full and then only every 'interval' frames, the faces being
+  // tracked in between (see LI_face_tracker). On a single worker, so that
+  // the frames come in order. 'config' gives the models. The recording
+  // has to show faces for the tracking to have anything to follow.
+  void tracking(LI_config config, const LI_replay& source, unsigned int interval) {
+    config.face_detection = true;
+    config.workers = 1;
+    config.parallel = LI_PARALLEL_NONE;
+
+    config.tracking.interval = 1;
+    this->end_to_end(config, source, LI_BLOCK, "tracking/full");
+
+    std::ostringstream name;
+    name << "tracking/interval_" << interval;
+    config.tracking.interval = interval;
+    this->end_to_end(config, source, LI_BLOCK, name.str());
+  }
+
+  const std::vector<LI_benchmark_result>& report() const {
+    return this->results;
+  }
+
+  void clear() {
+    this->results.clear();
+  }
+
+  void write_text(std::ostream& out) const {
+    for (size_t i = 0; i < this->results.size(); ++i) {
+      const LI_benchmark_result& result = this->results[i];
+
+      out << result.name << ": p50 " << result.p50_us << " us, p99 " <<
+        result.p99_us << " us, " << result.fps << " fps";
+      if (0 != result.bytes_per_s)
+        out << ", " << result.bytes_per_s / (1024 * 1024) << " MiB/s";
+      if (0 != result.budget_us)
+        out << ", " << (result.p99_us <= result.budget_us ? "within" : "over") <<
+          " budget of " << result.budget_us << " us";
+      out << " (" << result.iterations << " iterations)\n";
+    }
+  }
+
+  void write_json(std::ostream& out) const {
+    out << "{\"results\": [";
+
+    for (size_t i = 0; i < this->results.size(); ++i) {
+      const LI_benchmark_result& result = this->results[i];
+
+      out << (0 == i ? "" : ",") << "\n  {\"name\": \"" << result.name <<
+        "\", \"iterations\": " << result.iterations <<
+        ", \"p50_us\": " << result.p50_us <<
+        ", \"p99_us\": " << result.p99_us <<
+        ", \"mean_us\": " << result.mean_us <<
+        ", \"fps\": " << result.fps <<
+        ", \"bytes_per_s\": " << result.bytes_per_s <<
+        ", \"budget_us\": " << result.budget_us << "}";
+    }
+
+    out << "\n]}\n";
+  }
+};
+
+#endif
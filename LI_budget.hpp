@@ -0,0 +1,229 @@
+#ifndef LI_BUDGET_H
+#define LI_BUDGET_H
+
+#include <cmath>
+#include <mutex>
+
+// Settings of the detection resolution, see LI_resolution_controller.
+struct LI_budget_config {
+  // Time the face detection may take per frame, in microseconds. With no
+  // budget (0) the images are scanned at full resolution for faces of at
+  // least min_size pixels, as they always were.
+  double budget_us;
+
+  // Bounds of the factor the images are shrunk by before the scan, and of
+  // the smallest face looked for (in pixels of the shrunk images, so that
+  // the smallest face found in the full images is scale * min_size).
+  double max_scale;
+  int min_size;
+  int max_min_size;
+
+  // Factor between one operating point and the next, on the scale first
+  // and then on the minimum face size.
+  double step;
+
+  // Resolution is only given back once the detection would still take less
+  // than this fraction of the budget with it, so that the controller does
+  // not swing between two points.
+  double headroom;
+
+  // Weight of the last frame in the running average of the detection
+  // time, and number of frames an operating point is kept at least.
+  double smoothing;
+  unsigned int hold;
+
+  LI_budget_config() :
+    budget_us(0),
+    max_scale(4),
+    min_size(30),
+    max_min_size(120),
+    step(1.25),
+    headroom(0.8),
+    smoothing(0.2),
+    hold(8) {
+
+  }
+};
+
+// What the detection runs at: the factor the images are shrunk by, and the
+// smallest face looked for in pixels of the shrunk images.
+struct LI_operating_point {
+  double scale;
+  int min_size;
+
+  LI_operating_point() :
+    scale(1),
+    min_size(30) {
+
+  }
+
+  // The smallest face found, in pixels of the full images.
+  double min_face() const {
+    return this->scale * this->min_size;
+  }
+};
+
+// The state of an LI_resolution_controller and the decisions it took.
+struct LI_budget_stats {
+  double budget_us;
+
+  // The current operating point, and its rank from 0 (full resolution,
+  // smallest faces) up.
+  LI_operating_point point;
+  unsigned int level;
+
+  // Running average and last value of the detection time.
+  double average_us;
+  double last_us;
+
+  // Frames measured, those over the budget, and the changes of operating
+  // point towards less work (raised) and back (lowered).
+  unsigned long long frames;
+  unsigned long long over_budget;
+  unsigned long long raised;
+  unsigned long long lowered;
+
+  LI_budget_stats() :
+    budget_us(0),
+    level(0),
+    average_us(0),
+    last_us(0),
+    frames(0),
+    over_budget(0),
+    raised(0),
+    lowered(0) {
+
+  }
+};
+
+/*
+ * Detection resolution driven by a time budget
+ *
+ * The operating points form a ladder: from full resolution the scale grows
+ * by 'step' up to max_scale, then the minimum face size grows by 'step' up
+ * to max_min_size. Every frame reports the time its detection took. When
+ * the running average goes over the budget the controller climbs a rung,
+ * and it climbs back down once the expected cost of the rung below (see
+ * cost()) fits in the headroom of the budget. Frames analysed at the time
+ * of a change may be counted against the new point. Shared by all the
+ * workers, like the tracker.
+ */
+class LI_resolution_controller {
+  mutable std::mutex lock;
+
+  LI_budget_config config;
+  unsigned int levels;
+  unsigned int since_change;
+
+  LI_budget_stats stats;
+
+  // Relative cost of the scans at a level, compared to full resolution.
+  // The cascade's image pyramid starts at the size where the smallest face
+  // fills its window, so the work goes with the inverse square of the
+  // smallest face in the full images.
+  double cost(unsigned int level) const {
+    double ratio = this->config.min_size / this->point(level).min_face();
+    return ratio * ratio;
+  }
+
+  LI_operating_point point(unsigned int level) const {
+    LI_operating_point point;
+    point.scale = 1;
+    point.min_size = this->config.min_size;
+
+    for (unsigned int i = 0; i < level; ++i) {
+      if (point.scale * this->config.step <= this->config.max_scale)
+        point.scale *= this->config.step;
+      else
+        point.min_size = (int) std::lround(point.min_size * this->config.step);
+    }
+    return point;
+  }
+
+  void move(unsigned int level) {
+    double ratio = this->cost(level) / this->cost(this->stats.level);
+
+    this->stats.level = level;
+    this->stats.point = this->point(level);
+    this->stats.average_us *= ratio;
+    this->since_change = 0;
+  }
+
+public:
+  explicit LI_resolution_controller(
+    const LI_budget_config& config = LI_budget_config()) {
+
+    this->configure(config);
+  }
+
+  // Applies new settings, going back to full resolution.
+  void configure(const LI_budget_config& config) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    this->config = config;
+    if (this->config.step <= 1)
+      this->config.step = 1.25;
+    if (this->config.max_scale < 1)
+      this->config.max_scale = 1;
+    if (this->config.max_min_size < this->config.min_size)
+      this->config.max_min_size = this->config.min_size;
+
+    // Count the rungs of the ladder.
+    this->levels = 1;
+    while (this->levels < 64 &&
+           this->point(this->levels).min_size <= this->config.max_min_size)
+      ++this->levels;
+
+    this->stats = LI_budget_stats();
+    this->stats.budget_us = this->config.budget_us;
+    this->stats.point = this->point(0);
+    this->since_change = 0;
+  }
+
+  LI_operating_point current() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->stats.point;
+  }
+
+  // Reports the detection time of a frame, which may move the operating
+  // point of the frames to come.
+  void record(double elapsed_us) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    LI_budget_stats& stats = this->stats;
+    stats.last_us = elapsed_us;
+    stats.average_us = (0 == stats.frames) ? elapsed_us :
+      stats.average_us + this->config.smoothing * (elapsed_us - stats.average_us);
+    ++stats.frames;
+    ++this->since_change;
+
+    if (0 >= this->config.budget_us)
+      return;
+
+    if (elapsed_us > this->config.budget_us)
+      ++stats.over_budget;
+
+    if (this->since_change < this->config.hold)
+      return;
+
+    if (stats.average_us > this->config.budget_us &&
+        stats.level + 1 < this->levels) {
+      this->move(stats.level + 1);
+      ++stats.raised;
+    }
+    else if (0 < stats.level &&
+        stats.average_us * this->cost(stats.level - 1) /
+          this->cost(stats.level) <
+        this->config.headroom * this->config.budget_us) {
+      this->move(stats.level - 1);
+      ++stats.lowered;
+    }
+  }
+
+  LI_budget_stats snapshot() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->stats;
+  }
+};
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef LI_CALIBRATION_H
+#define LI_CALIBRATION_H
+
+#include <string>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+/*
+ * Stereo calibration and rectification maps
+ *
+ * The calibration is read from OpenCV FileStorage files using the names
+ * written by OpenCV's stereo_calib sample: M1, D1, M2, D2 (intrinsics) and
+ * R, T (extrinsics), either from a single file or split over two, plus
+ * optional image_width/image_height giving the resolution it was made at.
+ *
+ * Once the streaming resolution is known, prepare() computes the
+ * rectification and builds the remap tables in OpenCV's compact
+ * fixed-point form (CV_16SC2 coordinates plus CV_16UC1 interpolation
+ * weights), which are about twice as fast to apply as float maps. After
+ * that the object is only read from, so it can be shared between threads.
+ */
+class LI_rectifier {
+  cv::Mat M[2], D[2];
+  cv::Mat R, T;
+  cv::Size calibrated;
+
+  cv::Size size;
+  cv::Mat R_rect[2], P[2], Q;
+  cv::Mat map_xy[2], map_weights[2];
+
+  static bool read(const std::string& path, LI_rectifier& out) {
+    cv::FileStorage storage(path, cv::FileStorage::READ);
+    if (!storage.isOpened())
+      return false;
+
+    if (!storage["M1"].empty()) storage["M1"] >> out.M[0];
+    if (!storage["D1"].empty()) storage["D1"] >> out.D[0];
+    if (!storage["M2"].empty()) storage["M2"] >> out.M[1];
+    if (!storage["D2"].empty()) storage["D2"] >> out.D[1];
+    if (!storage["R"].empty()) storage["R"] >> out.R;
+    if (!storage["T"].empty()) storage["T"] >> out.T;
+
+    if (!storage["image_width"].empty() && !storage["image_height"].empty()) {
+      storage["image_width"] >> out.calibrated.width;
+      storage["image_height"] >> out.calibrated.height;
+    }
+
+    return true;
+  }
+
+public:
+  // Reads the calibration, returns false if a file cannot be read or a
+  // parameter is missing.
+  bool load(const std::string& path, const std::string& extrinsics = "") {
+    if (!LI_rectifier::read(path, *this) ||
+        (!extrinsics.empty() && !LI_rectifier::read(extrinsics, *this)))
+      return false;
+
+    return this->loaded();
+  }
+
+  bool loaded() const {
+    return !this->M[0].empty() && !this->D[0].empty() &&
+      !this->M[1].empty() && !this->D[1].empty() &&
+      !this->R.empty() && !this->T.empty();
+  }
+
+  // Builds the rectification maps for images of the given size. If the
+  // calibration was made at another resolution the camera matrices are
+  // scaled accordingly.
+  bool prepare(cv::Size size) {
+    if (!this->loaded())
+      return false;
+
+    if (size == this->size && !this->map_xy[0].empty())
+      return true;
+
+    cv::Mat M[2];
+    for (int eye = 0; eye < 2; ++eye) {
+      M[eye] = this->M[eye].clone();
+
+      if (0 != this->calibrated.width && size != this->calibrated) {
+        double sx = (double) size.width / this->calibrated.width;
+        double sy = (double) size.height / this->calibrated.height;
+
+        M[eye].at<double>(0, 0) *= sx;
+        M[eye].at<double>(0, 2) *= sx;
+        M[eye].at<double>(1, 1) *= sy;
+        M[eye].at<double>(1, 2) *= sy;
+      }
+    }
+
+    cv::stereoRectify(M[0], this->D[0], M[1], this->D[1], size,
+      this->R, this->T,
+      this->R_rect[0], this->R_rect[1], this->P[0], this->P[1], this->Q,
+      cv::CALIB_ZERO_DISPARITY, 0);
+
+    for (int eye = 0; eye < 2; ++eye)
+      cv::initUndistortRectifyMap(M[eye], this->D[eye],
+        this->R_rect[eye], this->P[eye], size, CV_16SC2,
+        this->map_xy[eye], this->map_weights[eye]);
+
+    this->size = size;
+    return true;
+  }
+
+  bool ready() const {
+    return !this->map_xy[0].empty();
+  }
+
+  cv::Size image_size() const {
+    return this->size;
+  }
+
+  // Rectifies one image (eye 0 is the left one) into 'dst', which is only
+  // (re)allocated if it does not have the right size already.
+  void remap(int eye, const cv::Mat& src, cv::Mat& dst) const {
+    cv::remap(src, dst, this->map_xy[eye], this->map_weights[eye],
+      cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+  }
+
+  // The remap tables of one image: the integer source coordinates
+  // (CV_16SC2) and, for each, the index of its interpolation weights
+  // (CV_16UC1), i.e. the fractional part of the coordinates in steps of
+  // 1 / cv::INTER_TAB_SIZE of a pixel, y part first.
+  void maps(int eye, cv::Mat& xy, cv::Mat& weights) const {
+    xy = this->map_xy[eye];
+    weights = this->map_weights[eye];
+  }
+
+  // Focal length (in pixels) and baseline (in the units of T) of the
+  // rectified pair, a disparity d then corresponds to a range of
+  // focal * baseline / d. Both are 0 until prepare() succeeded.
+  double focal_length() const {
+    return this->P[1].empty() ? 0 : this->P[1].at<double>(0, 0);
+  }
+
+  double baseline() const {
+    if (this->P[1].empty() || 0 == this->P[1].at<double>(0, 0))
+      return 0;
+    return -this->P[1].at<double>(0, 3) / this->P[1].at<double>(0, 0);
+  }
+
+  // The disparity-to-depth mapping computed by cv::stereoRectify.
+  const cv::Mat& reprojection() const {
+    return this->Q;
+  }
+};
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef LI_DEINTERLEAVE_H
+#define LI_DEINTERLEAVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <opencv2/core/core.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LI_DEINTERLEAVE_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define LI_DEINTERLEAVE_NEON
+#include <arm_neon.h>
+#endif
+
+/*
+ * Single-pass YUYV deinterleaving
+ *
+ * The OV580 streams both sensors as one YUYV 4:2:2 image, the left sensor
+ * occupying the luma (even) bytes and the right sensor the chroma (odd)
+ * bytes. The kernels below split every row into the two planes in one
+ * pass, which is what uvc_yuyv2y followed by uvc_yuyv2uv do in two.
+ */
+
+enum LI_simd_t {
+  LI_SIMD_AUTO = 0,
+  LI_SIMD_SCALAR = 1,
+  LI_SIMD_SSE2 = 2,
+  LI_SIMD_AVX2 = 3,
+  LI_SIMD_NEON = 4
+};
+
+// A row kernel splits 'count' pixels (2*count source bytes) into the two
+// destination rows.
+typedef void (*LI_deinterleave_fn)(
+  const uint8_t *src, uint8_t *even, uint8_t *odd, size_t count);
+
+inline void LI_deinterleave_row_scalar(
+  const uint8_t *src, uint8_t *even, uint8_t *odd, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    even[i] = src[2 * i];
+    odd[i] = src[2 * i + 1];
+  }
+}
+
+#ifdef LI_DEINTERLEAVE_X86
+// 16 pixels per iteration: the even bytes are masked in place and the odd
+// bytes shifted down, then both are narrowed back to bytes with unsigned
+// saturation (which never triggers since the values fit).
+__attribute__((target("sse2")))
+inline void LI_deinterleave_row_sse2(
+  const uint8_t *src, uint8_t *even, uint8_t *odd, size_t count) {
+  const __m128i mask = _mm_set1_epi16(0x00FF);
+  size_t i = 0;
+
+  for (; i + 16 <= count; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i*) (src + 2 * i));
+    __m128i b = _mm_loadu_si128((const __m128i*) (src + 2 * i + 16));
+
+    _mm_storeu_si128((__m128i*) (even + i), _mm_packus_epi16(
+      _mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+    _mm_storeu_si128((__m128i*) (odd + i), _mm_packus_epi16(
+      _mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+  }
+
+  LI_deinterleave_row_scalar(src + 2 * i, even + i, odd + i, count - i);
+}
+
+// 32 pixels per iteration. The 256-bit pack works within 128-bit lanes,
+// hence the final permutation putting the 64-bit quarters back in order.
+__attribute__((target("avx2")))
+inline void LI_deinterleave_row_avx2(
+  const uint8_t *src, uint8_t *even, uint8_t *odd, size_t count) {
+  const __m256i mask = _mm256_set1_epi16(0x00FF);
+  size_t i = 0;
+
+  for (; i + 32 <= count; i += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i*) (src + 2 * i));
+    __m256i b = _mm256_loadu_si256((const __m256i*) (src + 2 * i + 32));
+
+    __m256i e = _mm256_packus_epi16(
+      _mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+    __m256i o = _mm256_packus_epi16(
+      _mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+
+    _mm256_storeu_si256((__m256i*) (even + i),
+      _mm256_permute4x64_epi64(e, 0xD8));
+    _mm256_storeu_si256((__m256i*) (odd + i),
+      _mm256_permute4x64_epi64(o, 0xD8));
+  }
+
+  LI_deinterleave_row_sse2(src + 2 * i, even + i, odd + i, count - i);
+}
+#endif
+
+#ifdef LI_DEINTERLEAVE_NEON
+// 16 pixels per iteration, the structured load does the split for us.
+inline void LI_deinterleave_row_neon(
+  const uint8_t *src, uint8_t *even, uint8_t *odd, size_t count) {
+  size_t i = 0;
+
+  for (; i + 16 <= count; i += 16) {
+    uint8x16x2_t pixels = vld2q_u8(src + 2 * i);
+    vst1q_u8(even + i, pixels.val[0]);
+    vst1q_u8(odd + i, pixels.val[1]);
+  }
+
+  LI_deinterleave_row_scalar(src + 2 * i, even + i, odd + i, count - i);
+}
+#endif
+
+// Returns true if the running CPU can execute the given code path.
+inline bool LI_simd_supported(LI_simd_t simd) {
+  switch (simd) {
+    case LI_SIMD_AUTO:
+    case LI_SIMD_SCALAR:
+      return true;
+#ifdef LI_DEINTERLEAVE_X86
+    case LI_SIMD_SSE2:
+      return 0 != __builtin_cpu_supports("sse2");
+    case LI_SIMD_AVX2:
+      return 0 != __builtin_cpu_supports("avx2");
+#endif
+#ifdef LI_DEINTERLEAVE_NEON
+    case LI_SIMD_NEON:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+// Picks the best code path for the running CPU, this is only done once.
+inline LI_simd_t LI_simd_best() {
+  static const LI_simd_t best =
+    LI_simd_supported(LI_SIMD_AVX2) ? LI_SIMD_AVX2 :
+    LI_simd_supported(LI_SIMD_SSE2) ? LI_SIMD_SSE2 :
+    LI_simd_supported(LI_SIMD_NEON) ? LI_SIMD_NEON : LI_SIMD_SCALAR;
+  return best;
+}
+
+// Returns the row kernel for the requested code path, or NULL if the
+// running CPU does not support it.
+inline LI_deinterleave_fn LI_deinterleave_kernel(LI_simd_t simd = LI_SIMD_AUTO) {
+  if (LI_SIMD_AUTO == simd)
+    simd = LI_simd_best();
+
+  if (!LI_simd_supported(simd))
+    return NULL;
+
+  switch (simd) {
+#ifdef LI_DEINTERLEAVE_X86
+    case LI_SIMD_SSE2:
+      return LI_deinterleave_row_sse2;
+    case LI_SIMD_AVX2:
+      return LI_deinterleave_row_avx2;
+#endif
+#ifdef LI_DEINTERLEAVE_NEON
+    case LI_SIMD_NEON:
+      return LI_deinterleave_row_neon;
+#endif
+    default:
+      return LI_deinterleave_row_scalar;
+  }
+}
+
+// Splits a YUYV image into caller-provided left (even bytes) and right
+// (odd bytes) planes. Returns false if the code path is not supported.
+inline bool LI_deinterleave_yuyv(
+  const uint8_t *src, size_t src_step,
+  int width, int height,
+  uint8_t *left, size_t left_step,
+  uint8_t *right, size_t right_step,
+  LI_simd_t simd = LI_SIMD_AUTO) {
+
+  LI_deinterleave_fn kernel = LI_deinterleave_kernel(simd);
+  if (NULL == kernel)
+    return false;
+
+  // Contiguous images are processed as one long row.
+  if (src_step == 2 * (size_t) width &&
+      left_step == (size_t) width && right_step == (size_t) width) {
+    width *= height;
+    height = 1;
+  }
+
+  for (int y = 0; y < height; ++y)
+    kernel(src + y * src_step,
+      left + y * left_step, right + y * right_step, (size_t) width);
+
+  return true;
+}
+
+// The same for OpenCV images, 'src' is a two-channel (CV_8UC2) image. The
+// destination matrices are only (re)allocated if they do not already have
+// the right size and type, so passing views on pre-allocated memory makes
+// the call write straight into it.
+inline bool LI_deinterleave_yuyv(
+  const cv::Mat& src, cv::Mat& left, cv::Mat& right,
+  LI_simd_t simd = LI_SIMD_AUTO) {
+
+  if (CV_8UC2 != src.type())
+    return false;
+
+  left.create(src.rows, src.cols, CV_8UC1);
+  right.create(src.rows, src.cols, CV_8UC1);
+
+  return LI_deinterleave_yuyv(
+    src.data, src.step, src.cols, src.rows,
+    left.data, left.step, right.data, right.step, simd);
+}
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef LI_DEPTH_H
+#define LI_DEPTH_H
+
+#include <algorithm>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+// Stereo correspondence algorithms offered by LI_depth_estimator.
+enum LI_depth_algorithm_t {
+  LI_DEPTH_BM = 0,    /* cv::StereoBM, block matching (fastest) */
+  LI_DEPTH_SGBM = 1   /* cv::StereoSGBM, semi-global block matching */
+};
+
+// Settings of the disparity computation.
+struct LI_depth_config {
+  LI_depth_algorithm_t algorithm;
+
+  // Searched disparity range, in pixels of the (downscaled) images. The
+  // number of disparities is rounded up to a multiple of 16 and the block
+  // size up to an odd number, as OpenCV requires.
+  int min_disparity;
+  int num_disparities;
+  int block_size;
+
+  // The images are shrunk by this factor before matching, which divides
+  // the cost by its square (and the disparity resolution by itself).
+  int downscale;
+
+  // Part of the (full resolution) image to compute disparities for, an
+  // empty rectangle meaning all of it.
+  cv::Rect roi;
+
+  LI_depth_config() :
+    algorithm(LI_DEPTH_BM),
+    min_disparity(0),
+    num_disparities(64),
+    block_size(15),
+    downscale(1),
+    roi() {
+
+  }
+};
+
+/*
+ * Disparity map computation for rectified stereo pairs
+ *
+ * An estimator keeps its matcher and every working buffer from one frame
+ * to the next, so nothing is allocated per frame once the first one is
+ * through. It is not thread safe: use one estimator per thread.
+ */
+class LI_depth_estimator {
+  LI_depth_config config;
+
+  cv::Ptr<cv::StereoMatcher> matcher;
+
+  cv::Mat small_left, small_right;
+  cv::Mat disparity;
+
+  static int round_up(int value, int multiple) {
+    return ((std::max(value, 1) + multiple - 1) / multiple) * multiple;
+  }
+
+public:
+  explicit LI_depth_estimator(const LI_depth_config& config = LI_depth_config()) :
+    config(config) {
+
+    this->config.num_disparities = LI_depth_estimator::round_up(
+      config.num_disparities, 16);
+    this->config.block_size |= 1;
+    this->config.downscale = std::max(1, config.downscale);
+
+    if (LI_DEPTH_SGBM == this->config.algorithm) {
+      int area = this->config.block_size * this->config.block_size;
+      this->matcher = cv::StereoSGBM::create(
+        this->config.min_disparity,
+        this->config.num_disparities,
+        this->config.block_size,
+        8 * area, 32 * area);
+    }
+    else {
+      cv::Ptr<cv::StereoBM> matcher = cv::StereoBM::create(
+        this->config.num_disparities,
+        std::max(5, this->config.block_size));
+      matcher->setMinDisparity(this->config.min_disparity);
+      this->matcher = matcher;
+    }
+  }
+
+  const LI_depth_config& settings() const {
+    return this->config;
+  }
+
+  // Computes the disparities of the configured region of interest. On
+  // return 'disparity' is a CV_16S view (with 4 fractional bits, as in
+  // OpenCV) on the estimator's own buffer, valid until the next call, and
+  // 'roi' is the area it covers in full resolution coordinates.
+  void compute(
+    const cv::Mat& left, const cv::Mat& right,
+    cv::Mat& disparity, cv::Rect& roi) {
+
+    const int scale = this->config.downscale;
+    cv::Rect image(0, 0, left.cols, left.rows);
+
+    roi = this->config.roi.empty() ? image : (this->config.roi & image);
+
+    // Matching a pixel compares the block around it with those up to
+    // min+num disparities to its left, the matchers leaving no disparity
+    // where that reaches out of the images. So the images are cropped with
+    // that much of a margin around the region (as far as they go), whose
+    // results are cut off again below.
+    int half = (this->config.block_size / 2) * scale;
+    int reach = (this->config.min_disparity +
+      this->config.num_disparities) * scale + half;
+    cv::Rect crop = cv::Rect(roi.x - reach, roi.y - half,
+      roi.width + reach + half, roi.height + 2 * half) & image;
+
+    if (1 == scale) {
+      this->small_left = left(crop);
+      this->small_right = right(crop);
+    }
+    else {
+      cv::Size size(crop.width / scale, crop.height / scale);
+      cv::resize(left(crop), this->small_left, size, 0, 0, cv::INTER_AREA);
+      cv::resize(right(crop), this->small_right, size, 0, 0, cv::INTER_AREA);
+    }
+
+    this->matcher->compute(this->small_left, this->small_right, this->disparity);
+
+    disparity = this->disparity(cv::Rect(
+      (roi.x - crop.x) / scale, (roi.y - crop.y) / scale,
+      roi.width / scale, roi.height / scale) &
+      cv::Rect(0, 0, this->disparity.cols, this->disparity.rows));
+  }
+};
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef LI_DETECTOR_H
+#define LI_DETECTOR_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/objdetect/objdetect.hpp>
+
+/*
+ * Paths of the Haar cascade models shared by all the detectors
+ *
+ * Changing the paths bumps a generation number, which is all a detector
+ * has to check per frame to know whether it must reload.
+ */
+class LI_cascade_models {
+  mutable std::mutex lock;
+
+  std::string face_path;
+  std::string nested_path;
+
+  std::atomic<unsigned int> generation;
+
+public:
+  LI_cascade_models(const std::string& face, const std::string& nested) :
+    face_path(face),
+    nested_path(nested),
+    generation(1) {
+
+  }
+
+  void set(const std::string& face, const std::string& nested) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    this->face_path = face;
+    this->nested_path = nested;
+    ++this->generation;
+  }
+
+  unsigned int version() const {
+    return this->generation.load();
+  }
+
+  // Copies the paths out along with the generation they belong to.
+  unsigned int get(std::string& face, std::string& nested) const {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    face = this->face_path;
+    nested = this->nested_path;
+    return this->generation.load();
+  }
+};
+
+/*
+ * A set of loaded cascade classifiers
+ *
+ * Parsing the XML models takes tens of milliseconds, so every worker owns
+ * one detector that is loaded once and then reused for every frame (a
+ * cv::CascadeClassifier must not be shared between concurrent callers).
+ */
+class LI_detector {
+  unsigned int generation;
+  bool loaded;
+  bool failed;
+
+public:
+  cv::CascadeClassifier cascade;
+  cv::CascadeClassifier nested_cascade;
+
+  LI_detector() :
+    generation(0),
+    loaded(false),
+    failed(false) {
+
+  }
+
+  // Reloads the classifiers if the models changed since the last call.
+  // Returns false if that reload failed, and keeps returning false until
+  // the paths change again (the failing models are not retried). The
+  // previously loaded classifiers, if any, are kept meanwhile. An empty
+  // nested path leaves the nested classifier empty, and so does
+  // 'face_only', as 'nested_only' does the face one: a model that is not
+  // loaded cannot fail either.
+  bool update(
+    const LI_cascade_models& models, 
+    bool nested_only = false, bool face_only = false) {
+    if (models.version() == this->generation)
+      return !this->failed;
+
+    std::string face, nested;
+    this->generation = models.get(face, nested);
+
+    cv::CascadeClassifier cascade, nested_cascade;
+
+    this->failed = (!nested_only && !cascade.load(face)) ||
+      (!face_only && !nested.empty() && !nested_cascade.load(nested));
+    if (this->failed)
+      return false;
+
+    this->cascade = cascade;
+    this->nested_cascade = nested_cascade;
+    this->loaded = true;
+    return true;
+  }
+
+  // True once a model was successfully loaded.
+  bool ready() const {
+    return this->loaded;
+  }
+
+  // The generation of the models last loaded or tried.
+  unsigned int version() const {
+    return this->generation;
+  }
+};
+
+#endif
@@ -0,0 +1,270 @@
+#ifndef LI_EVENTLOOP_H
+#define LI_EVENTLOOP_H
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include <sys/time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <libusb-1.0/libusb.h>
+
+// Settings of an LI_event_thread.
+struct LI_event_config {
+  // Longest wait for an event, which bounds how long stopping the thread
+  // takes with libusb versions that cannot interrupt it.
+  int timeout_ms;
+
+  // CPU the thread is pinned to (-1 for any), and its SCHED_FIFO priority
+  // (0 for the normal scheduling). Both are best effort, see
+  // LI_event_thread::pinned() and realtime().
+  int cpu;
+  int priority;
+
+  LI_event_config() :
+    timeout_ms(100),
+    cpu(-1),
+    priority(0) {
+
+  }
+};
+
+/*
+ * Thread handling the events of a libusb context
+ *
+ * Frame completions, and so the frame callback of the cameras, as well as
+ * the hotplug callbacks all run on this thread. stop() returns once the
+ * thread is done with the event it was handling.
+ */
+class LI_event_thread {
+  libusb_context *context;
+  LI_event_config config;
+
+  std::thread thread;
+  std::atomic<bool> running;
+  int completed;
+
+  std::atomic<bool> is_pinned;
+  std::atomic<bool> is_realtime;
+
+  void loop() {
+    while (this->running) {
+      struct timeval timeout;
+      timeout.tv_sec = this->config.timeout_ms / 1000;
+      timeout.tv_usec = (this->config.timeout_ms % 1000) * 1000;
+
+      libusb_handle_events_timeout_completed(
+        this->context, &timeout, &this->completed);
+    }
+  }
+
+  void schedule() {
+#ifdef __linux__
+    if (0 <= this->config.cpu && CPU_SETSIZE > this->config.cpu) {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(this->config.cpu, &cpus);
+
+      this->is_pinned = (0 == pthread_setaffinity_np(
+        this->thread.native_handle(), sizeof(cpus), &cpus));
+    }
+#endif
+
+    if (0 < this->config.priority) {
+      struct sched_param parameters;
+      parameters.sched_priority = this->config.priority;
+
+      // Usually needs CAP_SYS_NICE (or an RLIMIT_RTPRIO allowance).
+      this->is_realtime = (0 == pthread_setschedparam(
+        this->thread.native_handle(), SCHED_FIFO, &parameters));
+    }
+  }
+
+public:
+  LI_event_thread() :
+    context(NULL),
+    running(false),
+    completed(0),
+    is_pinned(false),
+    is_realtime(false) {
+
+  }
+
+  ~LI_event_thread() {
+    this->stop();
+  }
+
+  LI_event_thread(const LI_event_thread&) = delete;
+  LI_event_thread& operator=(const LI_event_thread&) = delete;
+
+  // Starts handling the events of the context, returns false if already
+  // running.
+  bool start(libusb_context *context, const LI_event_config& config) {
+    if (this->thread.joinable())
+      return false;
+
+    this->context = context;
+    this->config = config;
+    if (0 >= this->config.timeout_ms)
+      this->config.timeout_ms = 1;
+
+    this->completed = 0;
+    this->is_pinned = false;
+    this->is_realtime = false;
+    this->running = true;
+    this->thread = std::thread(&LI_event_thread::loop, this);
+
+    this->schedule();
+    return true;
+  }
+
+  void stop() {
+    if (!this->thread.joinable())
+      return;
+
+    this->running = false;
+#if LIBUSB_API_VERSION >= 0x01000105
+    libusb_interrupt_event_handler(this->context);
+#endif
+    this->thread.join();
+  }
+
+  bool is_running() const {
+    return this->thread.joinable();
+  }
+
+  // Whether the CPU affinity and the realtime priority asked for could be
+  // applied.
+  bool pinned() const {
+    return this->is_pinned;
+  }
+
+  bool realtime() const {
+    return this->is_realtime;
+  }
+};
+
+// Called when libusb starts (added) or stops (!added) watching a file
+// descriptor, with the poll() events to watch it for.
+typedef std::function<void(int fd, short events, bool added)> LI_pollfd_listener;
+
+/*
+ * Events of a libusb context driven by the application's own reactor
+ *
+ * Instead of a thread of its own, the context is handled whenever one of
+ * the file descriptors of fds() is ready, or the timeout_ms() are over,
+ * by calling handle() from the reactor's thread:
+ *
+ *   poller.watch([&](int fd, short events, bool added) { ... epoll_ctl ... });
+ *   poller.fds(fds);   // the descriptors to start with
+ *   ...
+ *   epoll_wait(epoll, ready, count, poller.timeout_ms());
+ *   poller.handle();
+ *
+ * This requires libusb_pollfds_handle_timeouts(), i.e. Linux with timerfd.
+ * A poller attached to no context (as that of a camera sharing the
+ * context of an LI_camera_manager) has nothing to watch nor to handle.
+ */
+class LI_event_poller {
+  libusb_context *context;
+  LI_pollfd_listener listener;
+
+  static void added(int fd, short events, void *user_data) {
+    LI_event_poller *self = (LI_event_poller*) user_data;
+    if (self->listener)
+      self->listener(fd, events, true);
+  }
+
+  static void removed(int fd, void *user_data) {
+    LI_event_poller *self = (LI_event_poller*) user_data;
+    if (self->listener)
+      self->listener(fd, 0, false);
+  }
+
+public:
+  explicit LI_event_poller(libusb_context *context = NULL) :
+    context(context) {
+
+  }
+
+  ~LI_event_poller() {
+    this->unwatch();
+  }
+
+  LI_event_poller(const LI_event_poller&) = delete;
+  LI_event_poller& operator=(const LI_event_poller&) = delete;
+
+  void attach(libusb_context *context) {
+    this->unwatch();
+    this->context = context;
+  }
+
+  // Whether libusb exposes every timeout through its descriptors, in
+  // which case timeout_ms() is always -1.
+  bool supported() const {
+    return NULL != this->context &&
+      0 != libusb_pollfds_handle_timeouts(this->context);
+  }
+
+  // The descriptors to watch at the moment, see watch() for the changes.
+  void fds(std::vector<libusb_pollfd>& fds) const {
+    fds.clear();
+    if (NULL == this->context)
+      return;
+
+    const libusb_pollfd **list = libusb_get_pollfds(this->context);
+    if (NULL == list)
+      return;
+
+    for (unsigned int i = 0; NULL != list[i]; ++i)
+      fds.push_back(*list[i]);
+
+    libusb_free_pollfds(list);
+  }
+
+  // Calls the listener on the thread handling the events whenever a
+  // descriptor is added or removed.
+  void watch(const LI_pollfd_listener& listener) {
+    if (NULL == this->context)
+      return;
+
+    this->listener = listener;
+    libusb_set_pollfd_notifiers(this->context,
+      &LI_event_poller::added, &LI_event_poller::removed, (void*) this);
+  }
+
+  void unwatch() {
+    if (NULL != this->context && this->listener)
+      libusb_set_pollfd_notifiers(this->context, NULL, NULL, NULL);
+    this->listener = LI_pollfd_listener();
+  }
+
+  // How long the reactor may wait before calling handle() anyway, -1 for
+  // no limit.
+  int timeout_ms() const {
+    struct timeval timeout;
+    if (NULL == this->context ||
+        1 != libusb_get_next_timeout(this->context, &timeout))
+      return -1;
+
+    return (int) (timeout.tv_sec * 1000 + (timeout.tv_usec + 999) / 1000);
+  }
+
+  // Handles whatever is pending without blocking.
+  int handle() {
+    if (NULL == this->context)
+      return LIBUSB_ERROR_INVALID_PARAM;
+
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 0;
+
+    return libusb_handle_events_timeout_completed(
+      this->context, &timeout, NULL);
+  }
+};
+
+#endif
@@ -0,0 +1,232 @@
+#ifndef LI_EYES_H
+#define LI_EYES_H
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/objdetect/objdetect.hpp>
+
+#include "LI_detector.hpp"
+#include "LI_frame.hpp"
+#include "LI_threadpool.hpp"
+#include "LI_trace.hpp"
+
+// Settings of the eye detection, see LI_eye_detector.
+struct LI_eye_config {
+  // Whether the eyes of the faces found are looked for, with the nested
+  // cascade model.
+  bool enabled;
+
+  // Most faces per frame whose eyes are looked for, the largest ones (0
+  // for all of them). Each face costs one scan per image it was seen in.
+  unsigned int max_faces;
+
+  LI_eye_config() :
+    enabled(false),
+    max_faces(4) {
+
+  }
+};
+
+// Buffers of an LI_eye_detector, kept by the caller (e.g. one per worker)
+// from one frame to the next: one slot per scan, holding the equalised
+// face and the eyes found in it.
+struct LI_eye_scratch {
+  struct scan_t {
+    unsigned int face;
+    int eye;
+
+    cv::Mat roi;
+    std::vector<cv::Rect> hits;
+  };
+
+  std::vector<scan_t> scans;
+  std::vector<unsigned int> order;
+};
+
+/*
+ * Nested eye detection over the faces of a frame
+ *
+ * Every face box, in either image, is scanned for eyes on its own, and
+ * the scans of a frame are spread over a thread pool. A cv::Cascade
+ * Classifier must not be shared between concurrent callers, and the pool
+ * threads are not known in advance, so classifiers are lent to the scans
+ * out of a stock. The stock only grows when no classifier is idle, i.e.
+ * up to the most scans ever running at the same time.
+ *
+ * Each scan fills its own slot of the scratch buffers, and the eyes are
+ * handed to the faces in slot order, so the output does not depend on
+ * which thread ran which scan.
+ */
+class LI_eye_detector {
+  mutable std::mutex lock;
+
+  std::vector<std::unique_ptr<LI_detector> > detectors;
+  std::vector<LI_detector*> idle;
+
+  LI_detector* acquire() {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    if (this->idle.empty()) {
+      this->detectors.push_back(
+        std::unique_ptr<LI_detector>(new LI_detector()));
+      return this->detectors.back().get();
+    }
+
+    LI_detector *detector = this->idle.back();
+    this->idle.pop_back();
+    return detector;
+  }
+
+  void release(LI_detector *detector) {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->idle.push_back(detector);
+  }
+
+  // Looks for the eyes within one face box, in image coordinates.
+  static void scan(
+    LI_detector& detector, const cv::Mat& image, const cv::Rect& face,
+    LI_eye_scratch::scan_t& scan) {
+
+    LI_TRACE_SCOPE("cascade_nested");
+
+    scan.hits.clear();
+
+    cv::Rect box = face & cv::Rect(0, 0, image.cols, image.rows);
+    if (box.empty() || !detector.ready() || detector.nested_cascade.empty())
+      return;
+
+    cv::equalizeHist(image(box), scan.roi);
+
+    detector.nested_cascade.detectMultiScale(
+      scan.roi, scan.hits,
+      1.1, 2, 0
+      //|cv::CASCADE_FIND_BIGGEST_OBJECT
+      //|cv::CASCADE_DO_ROUGH_SEARCH
+      //|cv::CASCADE_DO_CANNY_PRUNING
+      |cv::CASCADE_SCALE_IMAGE,
+      cv::Size());
+
+    for (unsigned int i = 0; i < scan.hits.size(); ++i) {
+      scan.hits[i].x += box.x;
+      scan.hits[i].y += box.y;
+    }
+  }
+
+public:
+  LI_eye_detector() {
+
+  }
+
+  LI_eye_detector(const LI_eye_detector&) = delete;
+  LI_eye_detector& operator=(const LI_eye_detector&) = delete;
+
+  // Loads the nested model into 'count' detectors up front, rather than
+  // as the first scans need them. Returns false if it could not be loaded.
+  bool preload(const LI_cascade_models& models, unsigned int count) {
+    std::vector<LI_detector*> loaded;
+    bool result = true;
+
+    while (loaded.size() < count) {
+      loaded.push_back(this->acquire());
+      result = loaded.back()->update(models, true) && result;
+    }
+
+    for (unsigned int i = 0; i < loaded.size(); ++i)
+      this->release(loaded[i]);
+    return result;
+  }
+
+  // Fills in the eyes of the faces (of the largest max_faces of them, the
+  // others are left alone). Returns false if the nested model could not
+  // be loaded, in which case no eyes are found.
+  bool detect(
+    const LI_cascade_models& models, const LI_eye_config& config,
+    const cv::Mat& left, const cv::Mat& right,
+    std::vector<LI_face>& faces, LI_eye_scratch& scratch,
+    LI_parallel_t parallel, LI_threadpool *pool) {
+
+    // Pick the largest faces, ties going to the first ones, then scan them
+    // in the order of the faces.
+    std::vector<unsigned int>& order = scratch.order;
+    order.clear();
+    for (unsigned int i = 0; i < faces.size(); ++i)
+      order.push_back(i);
+
+    if (0 != config.max_faces && config.max_faces < order.size()) {
+      std::stable_sort(order.begin(), order.end(),
+        [&faces](unsigned int a, unsigned int b) {
+          return std::max(faces[a].left.area(), faces[a].right.area()) >
+            std::max(faces[b].left.area(), faces[b].right.area());
+        });
+      order.resize(config.max_faces);
+      std::sort(order.begin(), order.end());
+    }
+
+    // The slots are only ever added to, so that their buffers are kept.
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < order.size(); ++i) {
+      LI_face& face = faces[order[i]];
+      face.left_eyes.clear();
+      face.right_eyes.clear();
+
+      for (int eye = 0; eye < 2; ++eye) {
+        if ((0 == eye ? face.left : face.right).empty())
+          continue;
+
+        if (count == scratch.scans.size())
+          scratch.scans.push_back(LI_eye_scratch::scan_t());
+
+        scratch.scans[count].face = order[i];
+        scratch.scans[count].eye = eye;
+        ++count;
+      }
+    }
+
+    std::atomic<bool> loaded(true);
+
+    LI_parallel_for(parallel, pool, (int) count, [&](int i) {
+      LI_eye_scratch::scan_t& slot = scratch.scans[i];
+      const LI_face& face = faces[slot.face];
+      LI_detector *detector = this->acquire();
+
+      try {
+        if (!detector->update(models, true) || !detector->ready())
+          loaded = false;
+
+        LI_eye_detector::scan(*detector,
+          (0 == slot.eye) ? left : right,
+          (0 == slot.eye) ? face.left : face.right, slot);
+      } catch (...) {
+        this->release(detector);
+        throw;
+      }
+
+      this->release(detector);
+    });
+
+    for (unsigned int i = 0; i < count; ++i) {
+      const LI_eye_scratch::scan_t& slot = scratch.scans[i];
+      LI_face& face = faces[slot.face];
+      std::vector<cv::Rect>& eyes = (0 == slot.eye) ?
+        face.left_eyes : face.right_eyes;
+
+      eyes.insert(eyes.end(), slot.hits.begin(), slot.hits.end());
+    }
+
+    return loaded;
+  }
+
+  // Number of classifiers in the stock.
+  unsigned int classifiers() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return (unsigned int) this->detectors.size();
+  }
+};
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef LI_FRAME_H
+#define LI_FRAME_H
+
+#include <stdint.h>
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "LI_videomode.hpp"
+
+// Metadata travelling with every frame through the pipeline.
+struct LI_frame_info {
+  // Frame counter maintained by libuvc, and the number of frames missing
+  // from the sequence right before this one (lost by the camera, on the
+  // bus, or by libuvc).
+  uint32_t sequence;
+  uint32_t gap;
+
+  // When libuvc completed the frame (its capture_time, in microseconds of
+  // the system clock since the epoch, 0 if not provided), and when the
+  // frame callback received it.
+  int64_t capture_us;
+  std::chrono::steady_clock::time_point arrival;
+
+  // Size of the payload as delivered by libuvc.
+  size_t payload_bytes;
+
+  int width, height;
+
+  // The video mode the frame was streamed in.
+  LI_video_mode mode;
+
+  LI_frame_info() :
+    sequence(0),
+    gap(0),
+    capture_us(0),
+    arrival(),
+    payload_bytes(0),
+    width(0),
+    height(0),
+    mode() {
+
+  }
+};
+
+// A face found by the built-in face detection. It may have been seen in
+// either image or in both, an empty rectangle meaning not seen. For faces
+// seen in both images the disparity (in pixels, between the centres of
+// the boxes) is given, and the range too if the camera is calibrated (in
+// the units of the calibration, 0 otherwise). The ID stays the same for
+// as long as the face is tracked from frame to frame. The eyes are only
+// looked for with eye detection enabled (see LI_eye_detector).
+struct LI_face {
+  cv::Rect left;
+  cv::Rect right;
+
+  std::vector<cv::Rect> left_eyes;
+  std::vector<cv::Rect> right_eyes;
+
+  float disparity;
+  float range;
+
+  int id;
+
+  LI_face() :
+    disparity(0),
+    range(0),
+    id(-1) {
+
+  }
+};
+
+inline bool operator==(const LI_face& a, const LI_face& b) {
+  return a.left == b.left && a.right == b.right &&
+    a.left_eyes == b.left_eyes && a.right_eyes == b.right_eyes &&
+    a.disparity == b.disparity && a.range == b.range && a.id == b.id;
+}
+
+inline bool operator!=(const LI_face& a, const LI_face& b) {
+  return !(a == b);
+}
+
+// What changed in a frame since the last one analysed, see LI_motion_gate.
+// The images are divided into a grid of tiles, those that changed in
+// either image being marked in 'tiles' (row by row) and covered by
+// 'region' (in pixels of the images). Frames not 'changed' may be skipped
+// by the analysis stages, which then reuse their previous results.
+struct LI_motion_map {
+  bool changed;
+
+  cv::Size grid;
+  std::vector<uint8_t> tiles;
+  unsigned int changed_tiles;
+  cv::Rect region;
+
+  LI_motion_map() :
+    changed(true),
+    changed_tiles(0) {
+
+  }
+};
+
+// What the processing stages get to see of a frame. The left and right
+// images are views on pooled memory (no copies are involved), and only
+// valid while the stages run. A stage may point them elsewhere, e.g. at
+// buffers of its own, for the stages that follow.
+struct LI_stereo_frame {
+  cv::Mat left;
+  cv::Mat right;
+
+  LI_frame_info info;
+
+  // Disparity map filled in by the depth stage (empty otherwise): a CV_16S
+  // image with 4 fractional bits covering 'disparity_roi' of the images,
+  // shrunk by 'disparity_downscale'. On frames where nothing moved it is
+  // shared with the other such frames: stages should not write into it.
+  cv::Mat disparity;
+  cv::Rect disparity_roi;
+  int disparity_downscale;
+
+  // Faces found by the face detection stage (empty otherwise). On frames
+  // where nothing moved these are the faces of the last frame analysed,
+  // lent by the worker for as long as the stages run. Stages may still
+  // change them: the worker then copies the faces afresh for the next
+  // frame rather than lend out the changed ones.
+  std::vector<LI_face> faces;
+
+  // What changed since the last frame analysed. Always 'changed' unless
+  // motion gating is enabled (see LI_config::motion).
+  LI_motion_map motion;
+
+  // Index of the worker thread running the stages, so that stages called
+  // concurrently by several workers can keep per-worker state.
+  unsigned int worker;
+
+  LI_stereo_frame() :
+    disparity_downscale(1),
+    worker(0) {
+
+  }
+};
+
+#endif
@@ -0,0 +1,369 @@
+#ifndef LI_FRAMEPOOL_H
+#define LI_FRAMEPOOL_H
+
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "LI_ring.hpp"
+#include "LI_frame.hpp"
+
+// A recycled frame buffer handed out by LI_framepool. Every buffer holds
+// one or more equally sized planes (for the stereo camera: the left and
+// the right monochrome images) laid out back to back in a single block of
+// memory, each plane starting on an LI_framepool::ALIGNMENT boundary.
+struct LI_framebuffer {
+  uint8_t *plane[2];
+
+  int width, height;
+
+  // Number of bytes per row and per plane (rows are not padded, so that
+  // the planes can be handed to libuvc converters as they are).
+  size_t step;
+  size_t plane_bytes;
+
+  // Position of the buffer inside its pool, used for bookkeeping only.
+  unsigned int index;
+
+  // Metadata of the frame currently held by the buffer.
+  LI_frame_info info;
+};
+
+class LI_frame_ref;
+
+// Counters of an LI_framepool, see LI_framepool::stats().
+struct LI_pool_stats {
+  unsigned int capacity;
+  unsigned int available;
+  unsigned long long exhausted;
+  unsigned long long allocations;
+};
+
+/*
+ * Fixed-capacity pool of aligned frame buffers
+ *
+ * All the memory is obtained once in allocate() and then recycled through
+ * acquire() and release(), so that the streaming path never calls malloc
+ * or free. When all the buffers are in use acquire() does not allocate
+ * more but returns NULL and counts the event, it is up to the caller to
+ * drop the frame. Acquiring and releasing buffers is lock-free and safe
+ * from any thread, (re)sizing the pool is not.
+ *
+ * Buffers are reference counted: acquire() hands one out with a single
+ * reference, share() adds one (as an LI_frame_ref), and the buffer goes
+ * back to the pool when the last reference is released.
+ */
+class LI_framepool {
+public:
+  static const size_t ALIGNMENT = 64;
+  static const unsigned int MAX_PLANES = 2;
+
+private:
+  friend class LI_frame_ref;
+
+  // The memory and bookkeeping of one allocate(). References outliving a
+  // reallocation (or the pool) keep theirs alive, and their buffers go
+  // back to it rather than to the new one.
+  struct storage_t {
+    uint8_t *memory;
+    std::vector<LI_framebuffer> buffers;
+    std::unique_ptr<std::atomic<unsigned int>[]> references;
+    LI_ring<LI_framebuffer*> free_list;
+
+    explicit storage_t(unsigned int capacity) :
+      memory(NULL),
+      buffers(capacity),
+      references(new std::atomic<unsigned int>[capacity]),
+      free_list(capacity) {
+
+    }
+
+    ~storage_t() {
+      free(this->memory);
+    }
+
+    void release(LI_framebuffer *buffer) {
+      // Cannot fail, the ring has room for every buffer of the pool.
+      if (1 == this->references[buffer->index].fetch_sub(1))
+        this->free_list.try_push(buffer);
+    }
+  };
+
+  std::shared_ptr<storage_t> storage;
+
+  unsigned int planes;
+  size_t bytes_per_pixel;
+
+  // Diagnostics, the number of times the pool ran dry and the number of
+  // times it had to obtain memory from the heap.
+  std::atomic<unsigned long long> exhausted;
+  std::atomic<unsigned long long> allocations;
+
+  static size_t align(size_t size) {
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  }
+
+public:
+  LI_framepool() :
+    planes(0),
+    bytes_per_pixel(0),
+    exhausted(0),
+    allocations(0) {
+
+  }
+
+  ~LI_framepool() {
+    this->deallocate();
+  }
+
+  // The pool owns raw memory handed out by pointer, so it cannot be
+  // copied around.
+  LI_framepool(const LI_framepool&) = delete;
+  LI_framepool& operator=(const LI_framepool&) = delete;
+
+  // Sizes the pool for frames of the given geometry. Calling it again
+  // with the same geometry is a no-op, so that reconnecting the camera
+  // does not reallocate. Must not be called while buffers are in use.
+  bool allocate(
+    unsigned int capacity,
+    int width, int height,
+    unsigned int planes = 2,
+    size_t bytes_per_pixel = 1) {
+
+    if (0 == capacity || width <= 0 || height <= 0 ||
+        0 == planes || planes > MAX_PLANES)
+      return false;
+
+    if (this->storage &&
+        this->storage->buffers.size() == capacity &&
+        this->storage->buffers[0].width == width &&
+        this->storage->buffers[0].height == height &&
+        this->planes == planes &&
+        this->bytes_per_pixel == bytes_per_pixel)
+      return true;
+
+    this->deallocate();
+
+    size_t step = (size_t) width * bytes_per_pixel;
+    size_t plane_bytes = step * (size_t) height;
+    size_t stride = LI_framepool::align(plane_bytes);
+
+    void *block = NULL;
+    if (0 != posix_memalign(&block, ALIGNMENT, stride * planes * capacity))
+      return false;
+
+    std::shared_ptr<storage_t> storage(new storage_t(capacity));
+    storage->memory = (uint8_t*) block;
+
+    this->planes = planes;
+    this->bytes_per_pixel = bytes_per_pixel;
+    ++this->allocations;
+
+    for (unsigned int i = 0; i < capacity; ++i) {
+      LI_framebuffer &buffer = storage->buffers[i];
+
+      for (unsigned int p = 0; p < MAX_PLANES; ++p)
+        buffer.plane[p] = (p < planes) ?
+          storage->memory + (i * planes + p) * stride : NULL;
+
+      buffer.width = width;
+      buffer.height = height;
+      buffer.step = step;
+      buffer.plane_bytes = plane_bytes;
+      buffer.index = i;
+
+      storage->references[i] = 0;
+      storage->free_list.try_push(&buffer);
+    }
+
+    this->storage = storage;
+    return true;
+  }
+
+  // Releases all the memory of the pool, except for the buffers still
+  // referenced by an LI_frame_ref. Must not be called while buffers
+  // obtained from acquire() are in use.
+  void deallocate() {
+    this->storage.reset();
+  }
+
+  // Returns a free buffer, or NULL (counting the event) if all of them
+  // are currently in use.
+  LI_framebuffer* acquire() {
+    LI_framebuffer *buffer = NULL;
+
+    if (!this->storage || !this->storage->free_list.try_pop(buffer)) {
+      ++this->exhausted;
+      return NULL;
+    }
+
+    this->storage->references[buffer->index].store(1);
+    return buffer;
+  }
+
+  // Drops a reference to a buffer obtained from acquire(), which goes back
+  // to the pool unless it is shared.
+  void release(LI_framebuffer *buffer) {
+    if (NULL == buffer)
+      return;
+
+    this->storage->release(buffer);
+  }
+
+  // A reference to a buffer obtained from acquire() and not yet released,
+  // which may be kept past the release() of the caller. Defined below.
+  inline LI_frame_ref share(LI_framebuffer *buffer);
+
+  unsigned int capacity() const {
+    return this->storage ? (unsigned int) this->storage->buffers.size() : 0;
+  }
+
+  unsigned int available() const {
+    return this->storage ? (unsigned int) this->storage->free_list.size() : 0;
+  }
+
+  unsigned long long exhausted_count() const {
+    return this->exhausted.load();
+  }
+
+  unsigned long long allocation_count() const {
+    return this->allocations.load();
+  }
+
+  LI_pool_stats stats() const {
+    LI_pool_stats stats;
+    stats.capacity = this->capacity();
+    stats.available = this->available();
+    stats.exhausted = this->exhausted_count();
+    stats.allocations = this->allocation_count();
+    return stats;
+  }
+};
+
+// A counted reference to a pooled buffer, see LI_framepool::share(). The
+// buffer (and its memory) stays valid for as long as a copy of the
+// reference holds it, and goes back to its pool with the last one.
+class LI_frame_ref {
+  std::shared_ptr<LI_framepool::storage_t> storage;
+  LI_framebuffer *buffer;
+
+  friend class LI_framepool;
+
+  LI_frame_ref(
+    const std::shared_ptr<LI_framepool::storage_t>& storage,
+    LI_framebuffer *buffer) :
+    storage(storage),
+    buffer(buffer) {
+
+    ++this->storage->references[buffer->index];
+  }
+
+public:
+  LI_frame_ref() :
+    buffer(NULL) {
+
+  }
+
+  LI_frame_ref(const LI_frame_ref& other) :
+    storage(other.storage),
+    buffer(other.buffer) {
+
+    if (NULL != this->buffer)
+      ++this->storage->references[this->buffer->index];
+  }
+
+  LI_frame_ref(LI_frame_ref&& other) :
+    storage(std::move(other.storage)),
+    buffer(other.buffer) {
+
+    other.buffer = NULL;
+  }
+
+  ~LI_frame_ref() {
+    this->reset();
+  }
+
+  LI_frame_ref& operator=(LI_frame_ref other) {
+    this->swap(other);
+    return *this;
+  }
+
+  void swap(LI_frame_ref& other) {
+    this->storage.swap(other.storage);
+    std::swap(this->buffer, other.buffer);
+  }
+
+  void reset() {
+    if (NULL != this->buffer)
+      this->storage->release(this->buffer);
+
+    this->buffer = NULL;
+    this->storage.reset();
+  }
+
+  const LI_framebuffer* get() const {
+    return this->buffer;
+  }
+
+  const LI_framebuffer* operator->() const {
+    return this->buffer;
+  }
+
+  explicit operator bool() const {
+    return NULL != this->buffer;
+  }
+};
+
+LI_frame_ref LI_framepool::share(LI_framebuffer *buffer) {
+  return LI_frame_ref(this->storage, buffer);
+}
+
+// A stereo pair handed to the application by LI_stereocamera::grab(). The
+// images are views on the pooled buffer the pair was converted into, or
+// the rectified images of a rectified pair, with no copy involved. The
+// buffer is not recycled for as long as a copy of the handle holds it, so
+// handles are best released soon after use.
+struct LI_frame_handle {
+  cv::Mat left;
+  cv::Mat right;
+
+  LI_frame_info info;
+
+  // Keeps the images alive.
+  LI_frame_ref buffer;
+
+  // Points the handle at a buffer, or empties it (for an empty reference).
+  void assign(LI_frame_ref buffer) {
+    this->buffer = std::move(buffer);
+
+    if (!this->buffer) {
+      this->left = cv::Mat();
+      this->right = cv::Mat();
+      this->info = LI_frame_info();
+      return;
+    }
+
+    const LI_framebuffer& frame = *this->buffer.get();
+    this->left = cv::Mat(frame.height, frame.width, CV_8UC1,
+      frame.plane[0], frame.step);
+    this->right = cv::Mat(frame.height, frame.width, CV_8UC1,
+      frame.plane[1], frame.step);
+    this->info = frame.info;
+  }
+
+  void release() {
+    this->assign(LI_frame_ref());
+  }
+
+  bool empty() const {
+    return !this->buffer;
+  }
+};
+
+#endif
@@ -0,0 +1,356 @@
+#ifndef LI_MOTION_H
+#define LI_MOTION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "LI_deinterleave.hpp"
+#include "LI_frame.hpp"
+
+/*
+ * Sum of absolute differences
+ *
+ * A SAD kernel compares two rows of 'count' bytes and adds the absolute
+ * differences of every block of 8 bytes to its entry of 'sums' (the last
+ * block may be shorter). Blocks of 8 are what _mm_sad_epu8 sums natively,
+ * and the motion tiles are made of whole blocks.
+ */
+
+#define LI_SAD_BLOCK 8
+
+typedef void (*LI_sad_fn)(
+  const uint8_t *a, const uint8_t *b, size_t count, uint32_t *sums);
+
+inline void LI_sad_row_scalar(
+  const uint8_t *a, const uint8_t *b, size_t count, uint32_t *sums) {
+  for (size_t i = 0; i < count; ++i)
+    sums[i / LI_SAD_BLOCK] += (uint32_t) std::abs((int) a[i] - (int) b[i]);
+}
+
+#ifdef LI_DEINTERLEAVE_X86
+// 16 bytes, i.e. two blocks, per iteration.
+__attribute__((target("sse2")))
+inline void LI_sad_row_sse2(
+  const uint8_t *a, const uint8_t *b, size_t count, uint32_t *sums) {
+  size_t i = 0;
+
+  for (; i + 16 <= count; i += 16) {
+    __m128i sad = _mm_sad_epu8(
+      _mm_loadu_si128((const __m128i*) (a + i)),
+      _mm_loadu_si128((const __m128i*) (b + i)));
+
+    sums[i / 8] += (uint32_t) _mm_cvtsi128_si32(sad);
+    sums[i / 8 + 1] += (uint32_t) _mm_cvtsi128_si32(_mm_srli_si128(sad, 8));
+  }
+
+  LI_sad_row_scalar(a + i, b + i, count - i, sums + i / 8);
+}
+
+// 32 bytes, four blocks, per iteration. The sums come out in block order,
+// one per 64-bit lane.
+__attribute__((target("avx2")))
+inline void LI_sad_row_avx2(
+  const uint8_t *a, const uint8_t *b, size_t count, uint32_t *sums) {
+  size_t i = 0;
+
+  for (; i + 32 <= count; i += 32) {
+    __m256i sad = _mm256_sad_epu8(
+      _mm256_loadu_si256((const __m256i*) (a + i)),
+      _mm256_loadu_si256((const __m256i*) (b + i)));
+    __m128i low = _mm256_castsi256_si128(sad);
+    __m128i high = _mm256_extracti128_si256(sad, 1);
+
+    sums[i / 8] += (uint32_t) _mm_cvtsi128_si32(low);
+    sums[i / 8 + 1] += (uint32_t) _mm_cvtsi128_si32(_mm_srli_si128(low, 8));
+    sums[i / 8 + 2] += (uint32_t) _mm_cvtsi128_si32(high);
+    sums[i / 8 + 3] += (uint32_t) _mm_cvtsi128_si32(_mm_srli_si128(high, 8));
+  }
+
+  LI_sad_row_sse2(a + i, b + i, count - i, sums + i / 8);
+}
+#endif
+
+#ifdef LI_DEINTERLEAVE_NEON
+// 16 bytes per iteration, the pairwise additions widening the differences
+// up to one sum per block.
+inline void LI_sad_row_neon(
+  const uint8_t *a, const uint8_t *b, size_t count, uint32_t *sums) {
+  size_t i = 0;
+
+  for (; i + 16 <= count; i += 16) {
+    uint64x2_t sad = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(
+      vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i)))));
+
+    sums[i / 8] += (uint32_t) vgetq_lane_u64(sad, 0);
+    sums[i / 8 + 1] += (uint32_t) vgetq_lane_u64(sad, 1);
+  }
+
+  LI_sad_row_scalar(a + i, b + i, count - i, sums + i / 8);
+}
+#endif
+
+// Returns the SAD kernel for the requested code path, or NULL if the
+// running CPU does not support it.
+inline LI_sad_fn LI_sad_kernel(LI_simd_t simd = LI_SIMD_AUTO) {
+  if (LI_SIMD_AUTO == simd)
+    simd = LI_simd_best();
+
+  if (!LI_simd_supported(simd))
+    return NULL;
+
+  switch (simd) {
+#ifdef LI_DEINTERLEAVE_X86
+    case LI_SIMD_SSE2:
+      return LI_sad_row_sse2;
+    case LI_SIMD_AVX2:
+      return LI_sad_row_avx2;
+#endif
+#ifdef LI_DEINTERLEAVE_NEON
+    case LI_SIMD_NEON:
+      return LI_sad_row_neon;
+#endif
+    default:
+      return LI_sad_row_scalar;
+  }
+}
+
+// Settings of the motion gating, see LI_motion_gate.
+struct LI_motion_config {
+  // Mean absolute difference (in grey levels) over a tile above which the
+  // tile counts as changed. With no threshold (0) there is no gating and
+  // every frame is analysed, as it always was.
+  double threshold;
+
+  // Factor both images are shrunk by before being compared, and size of
+  // the tiles in pixels of the shrunk images (rounded up to a multiple of
+  // LI_SAD_BLOCK).
+  int downscale;
+  int tile;
+
+  // Changed tiles (over both images) for a frame to be analysed, and most
+  // frames skipped in a row (0 for no limit), so that changes too slow
+  // or too small to be seen are still caught up with eventually.
+  unsigned int min_tiles;
+  unsigned int refresh;
+
+  LI_simd_t simd;
+
+  LI_motion_config() :
+    threshold(0),
+    downscale(4),
+    tile(8),
+    min_tiles(1),
+    refresh(30),
+    simd(LI_SIMD_AUTO) {
+
+  }
+};
+
+// Counters of an LI_motion_gate.
+struct LI_motion_stats {
+  double threshold;
+
+  // Frames compared, those skipped as unchanged, and those analysed for
+  // having been skipped too long.
+  unsigned long long frames;
+  unsigned long long skipped;
+  unsigned long long refreshed;
+
+  // Tiles of the last frame compared, and how many had changed.
+  unsigned int tiles;
+  unsigned int changed_tiles;
+
+  LI_motion_stats() :
+    threshold(0),
+    frames(0),
+    skipped(0),
+    refreshed(0),
+    tiles(0),
+    changed_tiles(0) {
+
+  }
+
+  double skip_rate() const {
+    return (0 == this->frames) ? 0 : (double) this->skipped / this->frames;
+  }
+};
+
+/*
+ * Change detection between stereo pairs
+ *
+ * Both images are shrunk and compared tile by tile with the reference,
+ * i.e. with the last frame analysed rather than the previous one, so that
+ * slow changes add up until they show. A frame with fewer than min_tiles
+ * changed tiles is marked unchanged, and the analysis stages may reuse
+ * what they found in the reference. The frame that starts to move is
+ * analysed itself, so gating adds no latency.
+ *
+ * Shared by all the workers, like the tracker. Frames analysed out of
+ * order are compared with whichever reference is the latest.
+ */
+class LI_motion_gate {
+  mutable std::mutex lock;
+
+  LI_motion_config config;
+  LI_sad_fn kernel;
+
+  cv::Mat reference[2];
+  bool valid;
+  unsigned int skipped;
+
+  std::vector<uint32_t> blocks;
+  std::vector<uint32_t> sums;
+
+  LI_motion_stats stats;
+
+  // Sums the differences of every tile of a pair of images into 'sums',
+  // laid out as the tiles are.
+  void compare(const cv::Mat& a, const cv::Mat& b, int tile, int columns) {
+    const int per_tile = tile / LI_SAD_BLOCK;
+
+    for (int y = 0; y < a.rows; y += tile) {
+      std::fill(this->blocks.begin(), this->blocks.end(), 0);
+
+      for (int row = y; row < std::min(y + tile, a.rows); ++row)
+        this->kernel(a.ptr<uint8_t>(row), b.ptr<uint8_t>(row),
+          (size_t) a.cols, &this->blocks[0]);
+
+      uint32_t *sums = &this->sums[(y / tile) * columns];
+      for (size_t i = 0; i < this->blocks.size(); ++i)
+        sums[i / per_tile] += this->blocks[i];
+    }
+  }
+
+public:
+  explicit LI_motion_gate(const LI_motion_config& config = LI_motion_config()) {
+    this->configure(config);
+  }
+
+  // Applies new settings, the next frame being analysed in any case.
+  void configure(const LI_motion_config& config) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    this->config = config;
+    this->config.downscale = std::max(1, this->config.downscale);
+    this->config.tile = LI_SAD_BLOCK *
+      ((std::max(1, this->config.tile) + LI_SAD_BLOCK - 1) / LI_SAD_BLOCK);
+
+    this->kernel = LI_sad_kernel(this->config.simd);
+    if (NULL == this->kernel)
+      this->kernel = LI_sad_kernel();
+
+    this->valid = false;
+    this->skipped = 0;
+    this->stats = LI_motion_stats();
+    this->stats.threshold = this->config.threshold;
+  }
+
+  // Forgets the reference, e.g. when the stream restarts.
+  void reset() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->valid = false;
+  }
+
+  bool enabled() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return 0 < this->config.threshold;
+  }
+
+  // Compares a stereo pair with the reference and fills 'motion' in. The
+  // images are shrunk into 'small', buffers of the caller's reused from
+  // one frame to the next. A changed frame becomes the reference.
+  void assess(
+    const cv::Mat& left, const cv::Mat& right,
+    cv::Mat small[2], LI_motion_map& motion) {
+
+    int downscale;
+    {
+      std::lock_guard<std::mutex> guard(this->lock);
+      downscale = this->config.downscale;
+    }
+
+    const cv::Mat *images[2] = { &left, &right };
+    cv::Size size((left.cols + downscale - 1) / downscale,
+      (left.rows + downscale - 1) / downscale);
+
+    // Shrinking (by averaging) is done outside the lock, it is the bulk of
+    // the work and smooths out the sensor noise.
+    for (int eye = 0; eye < 2; ++eye)
+      cv::resize(*images[eye], small[eye], size, 0, 0, cv::INTER_AREA);
+
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    const int tile = this->config.tile;
+    motion.grid = cv::Size((size.width + tile - 1) / tile,
+      (size.height + tile - 1) / tile);
+    motion.tiles.assign(motion.grid.area(), 0);
+    motion.region = cv::Rect();
+    motion.changed_tiles = 0;
+
+    bool comparable = this->valid &&
+      this->reference[0].size() == size && right.size() == left.size();
+
+    if (comparable) {
+      int columns = motion.grid.width;
+      this->blocks.resize((size.width + LI_SAD_BLOCK - 1) / LI_SAD_BLOCK);
+
+      for (int eye = 0; eye < 2; ++eye) {
+        this->sums.assign(motion.grid.area(), 0);
+        this->compare(small[eye], this->reference[eye], tile, columns);
+
+        for (int i = 0; i < motion.grid.area(); ++i) {
+          int x = (i % columns) * tile, y = (i / columns) * tile;
+          int pixels = std::min(tile, size.width - x) *
+            std::min(tile, size.height - y);
+
+          if (this->sums[i] <= this->config.threshold * pixels)
+            continue;
+
+          if (0 == motion.tiles[i])
+            ++motion.changed_tiles;
+          motion.tiles[i] = 1;
+          motion.region |= cv::Rect(x * downscale, y * downscale,
+            tile * downscale, tile * downscale);
+        }
+      }
+
+      motion.region &= cv::Rect(0, 0, left.cols, left.rows);
+    }
+
+    ++this->stats.frames;
+    this->stats.tiles = (unsigned int) motion.grid.area();
+    this->stats.changed_tiles = motion.changed_tiles;
+
+    motion.changed = !comparable ||
+      motion.changed_tiles >= std::max(1u, this->config.min_tiles);
+
+    if (!motion.changed && 0 != this->config.refresh &&
+        ++this->skipped >= this->config.refresh) {
+      motion.changed = true;
+      ++this->stats.refreshed;
+    }
+
+    if (!motion.changed) {
+      ++this->stats.skipped;
+      return;
+    }
+
+    for (int eye = 0; eye < 2; ++eye)
+      small[eye].copyTo(this->reference[eye]);
+    this->valid = true;
+    this->skipped = 0;
+  }
+
+  LI_motion_stats snapshot() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->stats;
+  }
+};
+
+#endif
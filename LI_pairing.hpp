@@ -0,0 +1,110 @@
+#ifndef LI_PAIRING_H
+#define LI_PAIRING_H
+
+#include <cstdlib>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "LI_frame.hpp"
+#include "LI_calibration.hpp"
+
+/*
+ * Matching of faces between the two images of a rectified pair
+ *
+ * A face seen in the left image lies on the same rows of the right one,
+ * further left by its disparity: its epipolar band. Only faces within that
+ * band are taken as the same face, the closest one in height and size
+ * winning. The disparity of a matched face is the shift between the
+ * centres of its boxes, and its range follows from the focal length and
+ * baseline of a calibrated camera.
+ */
+
+// The part of the right image where a face seen at 'face' in the left
+// one can be: the same rows (give or take the margin), and at most
+// max_disparity pixels further left.
+inline cv::Rect LI_epipolar_band(
+  const cv::Rect& face, const cv::Size& size, int max_disparity, int margin)
+{
+  return cv::Rect(
+    face.x - max_disparity - margin, face.y - margin,
+    face.width + max_disparity + 2 * margin,
+    face.height + 2 * margin) & cv::Rect(0, 0, size.width, size.height);
+}
+
+// Picks the right face closest to a left one in height and size, among
+// those lying within its epipolar band, and not used yet if 'used' is
+// given. Returns -1 if there is none.
+inline int LI_closest_face(
+  const cv::Rect& face, const cv::Rect& band,
+  const std::vector<cv::Rect>& candidates, const std::vector<bool>* used)
+{
+  int best = -1, best_cost = 0;
+
+  for (unsigned int i = 0; i < candidates.size(); ++i) {
+    const cv::Rect& candidate = candidates[i];
+
+    if ((NULL != used && (*used)[i]) ||
+        candidate != (candidate & band))
+      continue;
+
+    int cost = std::abs(candidate.y - face.y) +
+      std::abs(candidate.width - face.width);
+    if (-1 == best || cost < best_cost) {
+      best = (int) i;
+      best_cost = cost;
+    }
+  }
+
+  return best;
+}
+
+// A face seen in either or both images. The range can only be told for
+// matched faces on calibrated cameras.
+inline LI_face LI_make_face(
+  const cv::Rect& left, const cv::Rect& right, const LI_rectifier* rectifier)
+{
+  LI_face face;
+  face.left = left;
+  face.right = right;
+
+  if (!left.empty() && !right.empty()) {
+    face.disparity = (left.x + left.width*0.5f) - (right.x + right.width*0.5f);
+
+    if (NULL != rectifier && rectifier->ready() && face.disparity > 0)
+      face.range = (float) (rectifier->focal_length() *
+        rectifier->baseline() / face.disparity);
+  }
+
+  return face;
+}
+
+// Pairs up the faces found independently in both images of the given
+// size, every left face taking the closest unused right face within its
+// epipolar band. Right faces left over are recorded on their own. 'used'
+// is scratch space, kept by the caller from frame to frame.
+inline void LI_pair_faces(
+  const std::vector<cv::Rect>& left, const std::vector<cv::Rect>& right,
+  const cv::Size& size, int max_disparity, int margin,
+  const LI_rectifier* rectifier, std::vector<bool>& used,
+  std::vector<LI_face>& faces)
+{
+  used.assign(right.size(), false);
+
+  for (unsigned int i = 0; i < left.size(); ++i) {
+    int best = LI_closest_face(left[i],
+      LI_epipolar_band(left[i], size, max_disparity, margin), right, &used);
+
+    if (-1 != best)
+      used[best] = true;
+
+    faces.push_back(LI_make_face(left[i],
+      (-1 != best) ? right[best] : cv::Rect(), rectifier));
+  }
+
+  for (unsigned int i = 0; i < right.size(); ++i)
+    if (!used[i])
+      faces.push_back(LI_make_face(cv::Rect(), right[i], rectifier));
+}
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef LI_PIPELINE_H
+#define LI_PIPELINE_H
+
+#include <atomic>
+#include <thread>
+
+#include "LI_ring.hpp"
+
+// What a stage queue does with a new item when it is already full.
+enum LI_overflow_t {
+  LI_DROP_OLDEST = 0,   /* evict the oldest queued item */
+  LI_DROP_NEWEST = 1,   /* refuse the new item */
+  LI_BLOCK = 2          /* wait for a consumer to make room */
+};
+
+// Outcome of LI_stage_queue::push().
+enum LI_push_result_t {
+  LI_QUEUED = 0,
+  LI_QUEUED_EVICTED = 1,
+  LI_REJECTED = 2
+};
+
+// Counters of a stage queue, see LI_stage_queue::stats().
+struct LI_queue_stats {
+  unsigned long long pushed;
+  unsigned long long popped;
+  unsigned long long dropped;
+  unsigned int depth;
+  unsigned int max_depth;
+  unsigned int capacity;
+};
+
+/*
+ * Queue feeding one pipeline stage
+ *
+ * An LI_ring with an overflow policy and the counters needed to tell how
+ * well the stage keeps up. Pushing with LI_BLOCK spins (yielding the CPU)
+ * until a consumer makes room or 'running' turns false.
+ */
+template <typename T>
+class LI_stage_queue {
+  LI_ring<T> ring;
+  LI_overflow_t policy;
+
+  std::atomic<unsigned long long> pushed;
+  std::atomic<unsigned long long> popped;
+  std::atomic<unsigned long long> dropped;
+  std::atomic<unsigned int> max_depth;
+
+  void update_depth() {
+    unsigned int depth = (unsigned int) this->ring.size();
+    unsigned int peak = this->max_depth.load(std::memory_order_relaxed);
+
+    while (depth > peak &&
+           !this->max_depth.compare_exchange_weak(
+             peak, depth, std::memory_order_relaxed))
+      ;
+  }
+
+public:
+  LI_stage_queue(size_t capacity, LI_overflow_t policy) :
+    ring(capacity),
+    policy(policy),
+    pushed(0),
+    popped(0),
+    dropped(0),
+    max_depth(0) {
+
+  }
+
+  // Queues 'item'. With LI_DROP_OLDEST a full queue makes room by evicting
+  // its oldest item into 'evicted' (LI_QUEUED_EVICTED). LI_REJECTED means
+  // that 'item' itself was not queued. Either way the caller owns
+  // whatever did not make it into the queue.
+  LI_push_result_t push(
+    const T& item, T& evicted, const std::atomic<bool>& running) {
+
+    LI_push_result_t result = LI_QUEUED;
+
+    while (!this->ring.try_push(item)) {
+      if (LI_DROP_NEWEST == this->policy || !running) {
+        ++this->dropped;
+        return LI_REJECTED;
+      }
+
+      // Only one item can be handed back, if another producer refilled
+      // the queue in the meantime we wait like LI_BLOCK would. A consumer
+      // may also beat us to the eviction, in which case there is room.
+      if (LI_DROP_OLDEST == this->policy && LI_QUEUED == result) {
+        if (this->ring.try_pop(evicted)) {
+          ++this->dropped;
+          result = LI_QUEUED_EVICTED;
+        }
+        continue;
+      }
+
+      std::this_thread::yield();
+    }
+
+    ++this->pushed;
+    this->update_depth();
+    return result;
+  }
+
+  bool pop(T& item) {
+    if (!this->ring.try_pop(item))
+      return false;
+
+    ++this->popped;
+    return true;
+  }
+
+  bool empty() const {
+    return 0 == this->ring.size();
+  }
+
+  LI_queue_stats stats() const {
+    LI_queue_stats stats;
+    stats.pushed = this->pushed.load();
+    stats.popped = this->popped.load();
+    stats.dropped = this->dropped.load();
+    stats.depth = (unsigned int) this->ring.size();
+    stats.max_depth = this->max_depth.load();
+    stats.capacity = (unsigned int) this->ring.capacity();
+    return stats;
+  }
+};
+
+#endif
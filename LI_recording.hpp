@@ -0,0 +1,458 @@
+#ifndef LI_RECORDING_H
+#define LI_RECORDING_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "LI_ring.hpp"
+#include "LI_framepool.hpp"
+
+/*
+ * Raw stream recordings
+ *
+ * A recording is a file header, then every frame as a record header
+ * followed by its raw YUYV payload, appended as they come. Closing the
+ * recording appends an index (the offset of every record) and a footer
+ * pointing at it. A recording that was never closed has no index, the
+ * records are then found by walking through them. All fields are in the
+ * byte order of the recording machine.
+ */
+
+#define LI_RECORDING_MAGIC 0x4352494cu  /* "LIRC" */
+#define LI_RECORD_MAGIC    0x5246494cu  /* "LIFR" */
+#define LI_INDEX_MAGIC     0x5849494cu  /* "LIIX" */
+#define LI_RECORDING_VERSION 1
+
+struct LI_recording_header {
+  uint32_t magic;
+  uint32_t version;
+};
+
+// Metadata of a recorded frame, as delivered by libuvc.
+struct LI_record_header {
+  uint32_t magic;
+  uint32_t sequence;
+  uint32_t width, height;
+  uint32_t step;
+
+  // Frame interval of the video mode, in units of 100ns.
+  uint32_t interval;
+
+  uint64_t payload_bytes;
+
+  // libuvc's capture_time (microseconds since the epoch, 0 if none), and
+  // the arrival of the frame in microseconds since that of the first one.
+  int64_t capture_us;
+  int64_t offset_us;
+};
+
+struct LI_recording_footer {
+  uint32_t magic;
+  uint32_t reserved;
+  uint64_t count;
+  uint64_t index_offset;
+};
+
+/*
+ * Append-only recorder
+ *
+ * Records are written through stdio's buffering, so a frame costs a copy
+ * into the buffer most of the time. write() may be called from any
+ * thread.
+ */
+class LI_recorder {
+  std::mutex lock;
+
+  FILE *file;
+  uint64_t offset;
+  std::vector<uint64_t> index;
+
+public:
+  LI_recorder() :
+    file(NULL),
+    offset(0) {
+
+  }
+
+  ~LI_recorder() {
+    this->close();
+  }
+
+  LI_recorder(const LI_recorder&) = delete;
+  LI_recorder& operator=(const LI_recorder&) = delete;
+
+  // Creates (or truncates) the recording, making room in the index for
+  // the given number of frames (ten minutes at 30 fps by default) so that
+  // writing them does not allocate.
+  bool open(const std::string& path, size_t frames = 18000) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    if (NULL != this->file)
+      return false;
+
+    this->file = std::fopen(path.c_str(), "wb");
+    if (NULL == this->file)
+      return false;
+
+    LI_recording_header header;
+    header.magic = LI_RECORDING_MAGIC;
+    header.version = LI_RECORDING_VERSION;
+
+    if (1 != std::fwrite(&header, sizeof(header), 1, this->file)) {
+      std::fclose(this->file);
+      this->file = NULL;
+      return false;
+    }
+
+    this->offset = sizeof(header);
+    this->index.clear();
+    this->index.reserve(frames);
+    return true;
+  }
+
+  bool is_open() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return NULL != this->file;
+  }
+
+  // Appends a frame. The magic number of the header is filled in here.
+  bool write(LI_record_header header, const void *payload) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    if (NULL == this->file)
+      return false;
+
+    header.magic = LI_RECORD_MAGIC;
+
+    if (1 != std::fwrite(&header, sizeof(header), 1, this->file) ||
+        header.payload_bytes != std::fwrite(
+          payload, 1, (size_t) header.payload_bytes, this->file))
+      return false;
+
+    this->index.push_back(this->offset);
+    this->offset += sizeof(header) + header.payload_bytes;
+    return true;
+  }
+
+  // Appends the index and closes the recording.
+  bool close() {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    if (NULL == this->file)
+      return true;
+
+    LI_recording_footer footer;
+    footer.magic = LI_INDEX_MAGIC;
+    footer.reserved = 0;
+    footer.count = this->index.size();
+    footer.index_offset = this->offset;
+
+    bool written =
+      (this->index.empty() || this->index.size() == std::fwrite(
+        &this->index[0], sizeof(uint64_t), this->index.size(), this->file)) &&
+      1 == std::fwrite(&footer, sizeof(footer), 1, this->file);
+
+    written = (0 == std::fclose(this->file)) && written;
+    this->file = NULL;
+    return written;
+  }
+};
+
+// Counters of a recording, see LI_stereocamera::recording_stats().
+struct LI_recording_stats {
+  // Frames written, and frames lost to a full queue or a failed write.
+  unsigned long long recorded;
+  unsigned long long lost;
+
+  LI_recording_stats() :
+    recorded(0),
+    lost(0) {
+
+  }
+};
+
+// Called on the writing thread with the sequence number of a frame that
+// could not be written.
+typedef std::function<void(uint32_t sequence)> LI_record_failure_listener;
+
+/*
+ * Recording on a thread of its own
+ *
+ * The frame callback only queues a reference to the pooled raw copy of a
+ * frame (see LI_frame_ref), which costs no copy, no lock and no
+ * allocation, and the frames are written out in order by the thread.
+ * Frames that do not fit in the queue (the disk not keeping up) are lost,
+ * and counted.
+ */
+class LI_record_writer {
+public:
+  // Frames waiting to be written, at most. Each holds a raw buffer of the
+  // camera, whose pool has as many more buffers.
+  static const unsigned int DEPTH = 8;
+
+private:
+  // The thread rechecks the queue at least this often (push() does not
+  // take the lock when waking it up).
+  static const int WAKEUP_MS = 2;
+
+  LI_recorder recorder;
+  LI_ring<LI_frame_ref> queue;
+  std::chrono::steady_clock::time_point start;
+  LI_record_failure_listener on_failure;
+
+  std::atomic<bool> running;
+  std::mutex wakeup_lock;
+  std::condition_variable wakeup;
+  std::thread thread;
+
+  std::atomic<unsigned long long> recorded;
+  std::atomic<unsigned long long> lost;
+
+  void write(const LI_frame_ref& frame) {
+    LI_record_header header;
+    header.sequence = frame->info.sequence;
+    header.width = (uint32_t) frame->width;
+    header.height = (uint32_t) frame->height;
+    header.step = (uint32_t) frame->step;
+    header.interval = frame->info.mode.interval;
+    header.payload_bytes = frame->plane_bytes;
+    header.capture_us = frame->info.capture_us;
+    header.offset_us = std::chrono::duration_cast<std::chrono::microseconds>(
+      frame->info.arrival - this->start).count();
+
+    if (this->recorder.write(header, frame->plane[0])) {
+      ++this->recorded;
+      return;
+    }
+
+    ++this->lost;
+    if (this->on_failure)
+      this->on_failure(header.sequence);
+  }
+
+  // Writes the frames as they come, and those still queued once stopped.
+  void loop() {
+    LI_frame_ref frame;
+
+    for (;;) {
+      if (this->queue.try_pop(frame)) {
+        this->write(frame);
+        frame.reset();
+        continue;
+      }
+
+      if (!this->running)
+        break;
+
+      std::unique_lock<std::mutex> guard(this->wakeup_lock);
+      this->wakeup.wait_for(guard, std::chrono::milliseconds(WAKEUP_MS));
+    }
+  }
+
+public:
+  LI_record_writer() :
+    queue(DEPTH),
+    running(false),
+    recorded(0),
+    lost(0) {
+
+  }
+
+  ~LI_record_writer() {
+    this->close();
+  }
+
+  LI_record_writer(const LI_record_writer&) = delete;
+  LI_record_writer& operator=(const LI_record_writer&) = delete;
+
+  // Creates the recording and starts the thread. Frame arrival times are
+  // recorded relative to now.
+  bool open(
+    const std::string& path,
+    const LI_record_failure_listener& on_failure = LI_record_failure_listener()) {
+
+    if (this->thread.joinable() || !this->recorder.open(path))
+      return false;
+
+    this->start = std::chrono::steady_clock::now();
+    this->on_failure = on_failure;
+    this->running = true;
+    this->thread = std::thread(&LI_record_writer::loop, this);
+    return true;
+  }
+
+  // Queues a frame, returns false (counting it as lost) if it does not fit
+  // or the recording is closed. Never blocks.
+  bool push(const LI_frame_ref& frame) {
+    if (!this->running || !this->queue.try_push(frame)) {
+      ++this->lost;
+      return false;
+    }
+
+    this->wakeup.notify_one();
+    return true;
+  }
+
+  // Writes the frames still queued and closes the recording, returns false
+  // if it could not be completed or frames were lost.
+  bool close() {
+    if (!this->thread.joinable())
+      return true;
+
+    this->running = false;
+    this->wakeup.notify_one();
+    this->thread.join();
+
+    return this->recorder.close() && 0 == this->lost;
+  }
+
+  LI_recording_stats stats() const {
+    LI_recording_stats stats;
+    stats.recorded = this->recorded;
+    stats.lost = this->lost;
+    return stats;
+  }
+};
+
+/*
+ * Memory-mapped recording
+ *
+ * The payloads are handed out as pointers into the mapping, so replaying
+ * a frame involves no read and no copy on our side.
+ */
+class LI_replay {
+  const uint8_t *data;
+  size_t size;
+
+  std::vector<uint64_t> index;
+
+  void unmap() {
+    if (NULL != this->data)
+      munmap((void*) this->data, this->size);
+
+    this->data = NULL;
+    this->size = 0;
+    this->index.clear();
+  }
+
+  // Walks through the records of a recording that has no index, up to the
+  // last complete one.
+  void scan() {
+    uint64_t offset = sizeof(LI_recording_header);
+
+    while (offset + sizeof(LI_record_header) <= this->size) {
+      LI_record_header header;
+      std::memcpy(&header, this->data + offset, sizeof(header));
+
+      if (LI_RECORD_MAGIC != header.magic ||
+          header.payload_bytes > this->size - offset - sizeof(header))
+        break;
+
+      this->index.push_back(offset);
+      offset += sizeof(header) + header.payload_bytes;
+    }
+  }
+
+public:
+  LI_replay() :
+    data(NULL),
+    size(0) {
+
+  }
+
+  ~LI_replay() {
+    this->unmap();
+  }
+
+  LI_replay(const LI_replay&) = delete;
+  LI_replay& operator=(const LI_replay&) = delete;
+
+  // Maps a recording, returns false if it cannot be read or is not one.
+  bool open(const std::string& path) {
+    this->unmap();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (-1 == fd)
+      return false;
+
+    struct stat status;
+    if (0 != fstat(fd, &status) ||
+        (size_t) status.st_size < sizeof(LI_recording_header)) {
+      ::close(fd);
+      return false;
+    }
+
+    void *mapping = mmap(NULL, (size_t) status.st_size, PROT_READ,
+      MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (MAP_FAILED == mapping)
+      return false;
+
+    this->data = (const uint8_t*) mapping;
+    this->size = (size_t) status.st_size;
+
+    LI_recording_header header;
+    std::memcpy(&header, this->data, sizeof(header));
+    if (LI_RECORDING_MAGIC != header.magic ||
+        LI_RECORDING_VERSION != header.version) {
+      this->unmap();
+      return false;
+    }
+
+    // Use the index if the recording was closed properly.
+    LI_recording_footer footer;
+    footer.magic = 0;
+    if (this->size >= sizeof(header) + sizeof(footer))
+      std::memcpy(&footer, this->data + this->size - sizeof(footer),
+        sizeof(footer));
+
+    if (LI_INDEX_MAGIC == footer.magic &&
+        footer.index_offset + footer.count * sizeof(uint64_t) +
+          sizeof(footer) == this->size) {
+      this->index.resize((size_t) footer.count);
+      if (0 != footer.count)
+        std::memcpy(&this->index[0], this->data + footer.index_offset,
+          (size_t) footer.count * sizeof(uint64_t));
+
+      for (size_t i = 0; i < this->index.size(); ++i)
+        if (this->index[i] + sizeof(LI_record_header) > footer.index_offset) {
+          this->index.clear();
+          break;
+        }
+    }
+
+    if (this->index.empty())
+      this->scan();
+
+    return true;
+  }
+
+  // Number of frames in the recording.
+  size_t frames() const {
+    return this->index.size();
+  }
+
+  // The header of the i-th frame and a pointer to its payload.
+  const uint8_t* frame(size_t i, LI_record_header& header) const {
+    const uint8_t *record = this->data + this->index[i];
+    std::memcpy(&header, record, sizeof(header));
+    return record + sizeof(header);
+  }
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef LI_RING_H
+#define LI_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <utility>
+
+/*
+ * Bounded lock-free multi-producer/multi-consumer ring
+ *
+ * Every cell carries a sequence number telling producers and consumers
+ * whose turn it is, so neither side ever takes a lock or allocates. The
+ * capacity is rounded up to a power of two.
+ */
+template <typename T>
+class LI_ring {
+  struct cell_t {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  std::unique_ptr<cell_t[]> cells;
+  size_t mask;
+
+  // Kept on separate cache lines, producers only touch the head and
+  // consumers only the tail. Padding rather than alignas(), which plain
+  // operator new does not honour before C++17.
+  char padding0[64];
+  std::atomic<size_t> head;
+  char padding1[64 - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> tail;
+  char padding2[64 - sizeof(std::atomic<size_t>)];
+
+public:
+  explicit LI_ring(size_t capacity) : head(0), tail(0) {
+    size_t size = 2;
+    while (size < capacity)
+      size <<= 1;
+
+    this->cells.reset(new cell_t[size]);
+    this->mask = size - 1;
+
+    for (size_t i = 0; i < size; ++i)
+      this->cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  LI_ring(const LI_ring&) = delete;
+  LI_ring& operator=(const LI_ring&) = delete;
+
+  bool try_push(const T& item) {
+    size_t position = this->head.load(std::memory_order_relaxed);
+    cell_t *cell;
+
+    for (;;) {
+      cell = &this->cells[position & this->mask];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t difference = (intptr_t) sequence - (intptr_t) position;
+
+      if (0 == difference) {
+        if (this->head.compare_exchange_weak(
+              position, position + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (difference < 0)
+        return false;   /* full */
+      else
+        position = this->head.load(std::memory_order_relaxed);
+    }
+
+    cell->data = item;
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool try_pop(T& item) {
+    size_t position = this->tail.load(std::memory_order_relaxed);
+    cell_t *cell;
+
+    for (;;) {
+      cell = &this->cells[position & this->mask];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t difference = (intptr_t) sequence - (intptr_t) (position + 1);
+
+      if (0 == difference) {
+        if (this->tail.compare_exchange_weak(
+              position, position + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (difference < 0)
+        return false;   /* empty */
+      else
+        position = this->tail.load(std::memory_order_relaxed);
+    }
+
+    // Moved out, so that the cell holds on to nothing (items may be
+    // references, see LI_frame_ref).
+    item = std::move(cell->data);
+    cell->sequence.store(
+      position + this->mask + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Approximate number of queued items (exact when the ring is idle).
+  size_t size() const {
+    size_t head = this->head.load(std::memory_order_relaxed);
+    size_t tail = this->tail.load(std::memory_order_relaxed);
+    return (head > tail) ? head - tail : 0;
+  }
+
+  size_t capacity() const {
+    return this->mask + 1;
+  }
+};
+
+#endif
@@ -0,0 +1,495 @@
+#ifndef LI_SHM_H
+#define LI_SHM_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "LI_frame.hpp"
+
+/*
+ * Stereo frames shared with other processes
+ *
+ * A POSIX shared memory object holds a header followed by a ring of slots,
+ * each with the metadata of a frame and its left and right images. A
+ * single publisher writes the slots in turn. Any number of readers map the
+ * object read-only and read the images in place, with no copy.
+ *
+ * Every slot is guarded by a seqlock. Its sequence word is odd while the
+ * slot is being written, and 2 * (index + 1) once frame 'index' (counted
+ * from 0 since the ring was created) is in. A reader checks the word
+ * before and after using a slot, see LI_shm_reader::valid(). A counter in
+ * the header is bumped after every frame and doubles as a futex, so that
+ * readers can sleep until the next frame.
+ *
+ * Both ends must run on the same machine. The arrival times are those of
+ * the steady clock, which all processes share on Linux.
+ */
+
+#define LI_SHM_MAGIC 0x4d48494cu  /* "LIHM" */
+#define LI_SHM_VERSION 1
+
+// Everything in the ring is aligned on cache lines.
+#define LI_SHM_ALIGN 64
+
+struct LI_shm_header {
+  uint32_t magic;
+  uint32_t version;
+
+  uint32_t slots;
+  uint32_t width, height, step;
+  uint64_t slot_bytes;
+
+  // Frames published so far, and the futex word bumped with it.
+  std::atomic<uint64_t> published;
+  std::atomic<uint32_t> wakeup;
+};
+
+// Metadata of a frame in the ring, see LI_frame_info.
+struct LI_shm_frame_info {
+  uint64_t index;
+  uint32_t sequence;
+  uint32_t gap;
+  int64_t capture_us;
+  int64_t arrival_ns;
+
+  uint32_t width, height, step;
+  uint32_t fourcc;
+  uint32_t interval;
+};
+
+struct LI_shm_slot {
+  std::atomic<uint64_t> sequence;
+  LI_shm_frame_info info;
+};
+
+// Offsets of the parts of the ring, rounded up to cache lines.
+inline size_t LI_shm_align(size_t bytes) {
+  return (bytes + LI_SHM_ALIGN - 1) / LI_SHM_ALIGN * LI_SHM_ALIGN;
+}
+
+inline size_t LI_shm_slot_bytes(uint32_t step, uint32_t height) {
+  return LI_shm_align(sizeof(LI_shm_slot)) +
+    2 * LI_shm_align((size_t) step * height);
+}
+
+inline size_t LI_shm_offset(uint32_t slot, size_t slot_bytes) {
+  return LI_shm_align(sizeof(LI_shm_header)) + (size_t) slot * slot_bytes;
+}
+
+/*
+ * Writing end of the ring
+ *
+ * publish() may be called from any thread, frames are written one at a
+ * time in the order they come in.
+ */
+class LI_shm_publisher {
+  std::mutex lock;
+
+  std::string name;
+  uint8_t *data;
+  size_t size;
+  LI_shm_header *header;
+
+  void unmap() {
+    if (NULL != this->data) {
+      munmap(this->data, this->size);
+      shm_unlink(this->name.c_str());
+    }
+
+    this->data = NULL;
+    this->size = 0;
+    this->header = NULL;
+  }
+
+public:
+  LI_shm_publisher() :
+    data(NULL),
+    size(0),
+    header(NULL) {
+
+  }
+
+  ~LI_shm_publisher() {
+    this->close();
+  }
+
+  LI_shm_publisher(const LI_shm_publisher&) = delete;
+  LI_shm_publisher& operator=(const LI_shm_publisher&) = delete;
+
+  // Creates the ring (replacing any object of the same name, e.g. left
+  // behind by a crash) for frames of the given size. The name follows
+  // shm_open()'s rules, e.g. "/li_stereo".
+  bool create(
+    const std::string& name, unsigned int slots, int width, int height) {
+
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->unmap();
+
+    if (0 == slots || 0 >= width || 0 >= height)
+      return false;
+
+    uint32_t step = (uint32_t) LI_shm_align((size_t) width);
+    size_t slot_bytes = LI_shm_slot_bytes(step, (uint32_t) height);
+    size_t size = LI_shm_offset(slots, slot_bytes);
+
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (-1 == fd)
+      return false;
+
+    void *mapping = MAP_FAILED;
+    if (0 == ftruncate(fd, (off_t) size))
+      mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (MAP_FAILED == mapping) {
+      shm_unlink(name.c_str());
+      return false;
+    }
+
+    // The object comes zero-filled: every slot is empty.
+    this->name = name;
+    this->data = (uint8_t*) mapping;
+    this->size = size;
+
+    this->header = new (this->data) LI_shm_header();
+    this->header->slots = slots;
+    this->header->width = (uint32_t) width;
+    this->header->height = (uint32_t) height;
+    this->header->step = step;
+    this->header->slot_bytes = slot_bytes;
+    this->header->published = 0;
+    this->header->wakeup = 0;
+    for (unsigned int i = 0; i < slots; ++i)
+      new (this->data + LI_shm_offset(i, slot_bytes)) LI_shm_slot();
+
+    // Readers only accept the ring once the magic number is in.
+    this->header->version = LI_SHM_VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    this->header->magic = LI_SHM_MAGIC;
+    return true;
+  }
+
+  // Removes the ring. Readers still attached keep their mapping, which
+  // stops receiving frames.
+  void close() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->unmap();
+  }
+
+  bool is_open() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return NULL != this->data;
+  }
+
+  // Copies a stereo pair into the next slot and wakes the readers up.
+  // Returns false if the ring is not open or was made for another size.
+  bool publish(
+    const LI_frame_info& info,
+    const uint8_t *left, size_t left_step,
+    const uint8_t *right, size_t right_step,
+    int width, int height) {
+
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    LI_shm_header *header = this->header;
+    if (NULL == header ||
+        (uint32_t) width != header->width ||
+        (uint32_t) height != header->height)
+      return false;
+
+    uint64_t index = header->published.load(std::memory_order_relaxed);
+    uint8_t *record = this->data +
+      LI_shm_offset((uint32_t) (index % header->slots), header->slot_bytes);
+    LI_shm_slot *slot = (LI_shm_slot*) record;
+    uint8_t *planes[2] = {
+      record + LI_shm_align(sizeof(LI_shm_slot)),
+      record + LI_shm_align(sizeof(LI_shm_slot)) +
+        LI_shm_align((size_t) header->step * header->height)
+    };
+
+    slot->sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const uint8_t *sources[2] = { left, right };
+    size_t steps[2] = { left_step, right_step };
+    for (int eye = 0; eye < 2; ++eye)
+      for (int y = 0; y < height; ++y)
+        std::memcpy(planes[eye] + y * (size_t) header->step,
+          sources[eye] + y * steps[eye], (size_t) width);
+
+    slot->info.index = index;
+    slot->info.sequence = info.sequence;
+    slot->info.gap = info.gap;
+    slot->info.capture_us = info.capture_us;
+    slot->info.arrival_ns = std::chrono::duration_cast<
+      std::chrono::nanoseconds>(info.arrival.time_since_epoch()).count();
+    slot->info.width = (uint32_t) width;
+    slot->info.height = (uint32_t) height;
+    slot->info.step = header->step;
+    slot->info.fourcc = info.mode.fourcc;
+    slot->info.interval = info.mode.interval;
+
+    slot->sequence.store(2 * index + 2, std::memory_order_release);
+    header->published.store(index + 1, std::memory_order_release);
+
+    header->wakeup.fetch_add(1, std::memory_order_release);
+#ifdef __linux__
+    syscall(SYS_futex, (uint32_t*) &header->wakeup, FUTEX_WAKE, INT_MAX,
+      NULL, NULL, 0);
+#endif
+    return true;
+  }
+};
+
+// A frame of the ring as seen by a reader. The images point into the
+// mapping, and are only to be trusted as long as valid() holds.
+struct LI_shm_frame {
+  LI_shm_frame_info info;
+  const uint8_t *left;
+  const uint8_t *right;
+
+  // Frames published but overwritten before this reader got to them,
+  // since the frame it read before.
+  uint64_t skipped;
+
+  LI_shm_frame() :
+    info(),
+    left(NULL),
+    right(NULL),
+    skipped(0) {
+
+  }
+};
+
+/*
+ * Reading end of the ring
+ *
+ * Each reader keeps its own position, and reads the frames in order until
+ * it falls more than the size of the ring behind, in which case it skips
+ * to the oldest frame still there and counts those it missed. latest()
+ * skips to the newest frame instead.
+ */
+class LI_shm_reader {
+  const uint8_t *data;
+  size_t size;
+  const LI_shm_header *header;
+
+  uint64_t next_index;
+  uint64_t lost;
+
+  const LI_shm_slot* slot(uint64_t index) const {
+    return (const LI_shm_slot*) (this->data + LI_shm_offset(
+      (uint32_t) (index % this->header->slots), this->header->slot_bytes));
+  }
+
+  // Reads the metadata of a frame and points at its images, if the frame
+  // is (still) in its slot.
+  bool read(uint64_t index, LI_shm_frame& frame) const {
+    const LI_shm_slot *slot = this->slot(index);
+
+    if (2 * index + 2 != slot->sequence.load(std::memory_order_acquire))
+      return false;
+
+    std::memcpy(&frame.info, &slot->info, sizeof(frame.info));
+    frame.left = (const uint8_t*) slot + LI_shm_align(sizeof(LI_shm_slot));
+    frame.right = frame.left +
+      LI_shm_align((size_t) this->header->step * this->header->height);
+
+    return this->valid(frame);
+  }
+
+public:
+  LI_shm_reader() :
+    data(NULL),
+    size(0),
+    header(NULL),
+    next_index(0),
+    lost(0) {
+
+  }
+
+  ~LI_shm_reader() {
+    this->close();
+  }
+
+  LI_shm_reader(const LI_shm_reader&) = delete;
+  LI_shm_reader& operator=(const LI_shm_reader&) = delete;
+
+  // Attaches to a ring, read-only. Reading starts with the next frame
+  // published.
+  bool open(const std::string& name) {
+    this->close();
+
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (-1 == fd)
+      return false;
+
+    struct stat status;
+    if (0 != fstat(fd, &status) ||
+        (size_t) status.st_size < LI_shm_align(sizeof(LI_shm_header))) {
+      ::close(fd);
+      return false;
+    }
+
+    void *mapping = mmap(NULL, (size_t) status.st_size, PROT_READ,
+      MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (MAP_FAILED == mapping)
+      return false;
+
+    this->data = (const uint8_t*) mapping;
+    this->size = (size_t) status.st_size;
+    this->header = (const LI_shm_header*) this->data;
+
+    uint32_t magic = this->header->magic;
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (LI_SHM_MAGIC != magic || LI_SHM_VERSION != this->header->version ||
+        0 == this->header->slots ||
+        LI_shm_offset(this->header->slots, this->header->slot_bytes) >
+          this->size) {
+      this->close();
+      return false;
+    }
+
+    this->next_index = this->header->published.load(std::memory_order_acquire);
+    this->lost = 0;
+    return true;
+  }
+
+  void close() {
+    if (NULL != this->data)
+      munmap((void*) this->data, this->size);
+
+    this->data = NULL;
+    this->size = 0;
+    this->header = NULL;
+  }
+
+  bool is_open() const {
+    return NULL != this->data;
+  }
+
+  int width() const {
+    return (int) this->header->width;
+  }
+
+  int height() const {
+    return (int) this->header->height;
+  }
+
+  // Row stride of the images.
+  size_t step() const {
+    return this->header->step;
+  }
+
+  // Frames this reader missed for falling behind, since it attached.
+  uint64_t lost_frames() const {
+    return this->lost;
+  }
+
+  // The next frame in order, if any was published since the last one
+  // read. Returns false if there is none yet.
+  bool next(LI_shm_frame& frame) {
+    for (;;) {
+      uint64_t published =
+        this->header->published.load(std::memory_order_acquire);
+      if (published <= this->next_index)
+        return false;
+
+      // Fallen behind: the oldest frames are gone.
+      uint64_t oldest = (published > this->header->slots) ?
+        published - this->header->slots : 0;
+      frame.skipped = 0;
+      if (this->next_index < oldest) {
+        frame.skipped = oldest - this->next_index;
+        this->lost += frame.skipped;
+        this->next_index = oldest;
+      }
+
+      if (this->read(this->next_index, frame)) {
+        ++this->next_index;
+        return true;
+      }
+
+      // Overwritten in the meantime, try again from further on.
+      ++this->next_index;
+      ++this->lost;
+    }
+  }
+
+  // The newest frame, skipping those in between (which are not counted as
+  // lost). Returns false if no frame was published since the last one read.
+  bool latest(LI_shm_frame& frame) {
+    uint64_t published =
+      this->header->published.load(std::memory_order_acquire);
+    if (published <= this->next_index)
+      return false;
+
+    this->next_index = published - 1;
+    return this->next(frame);
+  }
+
+  // Whether the images of a frame were not overwritten yet. To be checked
+  // once done with them (or with a copy of them): if false, what was read
+  // may be torn.
+  bool valid(const LI_shm_frame& frame) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return 2 * frame.info.index + 2 ==
+      this->slot(frame.info.index)->sequence.load(std::memory_order_relaxed);
+  }
+
+  // Sleeps until a frame is published that this reader did not read yet,
+  // or the timeout is over. Returns false on timeout.
+  bool wait(int timeout_ms) {
+    std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+    for (;;) {
+      uint32_t wakeup = this->header->wakeup.load(std::memory_order_acquire);
+      if (this->header->published.load(std::memory_order_acquire) >
+          this->next_index)
+        return true;
+
+      std::chrono::steady_clock::duration left =
+        deadline - std::chrono::steady_clock::now();
+      if (left <= std::chrono::steady_clock::duration::zero())
+        return false;
+
+#ifdef __linux__
+      struct timespec timeout;
+      std::chrono::nanoseconds ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(left);
+      timeout.tv_sec = (time_t) (ns.count() / 1000000000);
+      timeout.tv_nsec = (long) (ns.count() % 1000000000);
+
+      // Returns at once if a frame came in since 'wakeup' was read.
+      syscall(SYS_futex, (const uint32_t*) &this->header->wakeup,
+        FUTEX_WAIT, wakeup, &timeout, NULL, 0);
+#else
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+    }
+  }
+};
+
+#endif
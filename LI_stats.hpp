@@ -0,0 +1,121 @@
+#ifndef LI_STATS_H
+#define LI_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+// Number of buckets of a latency histogram, bucket i counting the
+// latencies below 2^i microseconds (and at least 2^(i-1)), the last one
+// everything above.
+#define LI_HISTOGRAM_BUCKETS 32
+
+// A copy of the counts of an LI_histogram.
+struct LI_latency_histogram {
+  uint64_t count;
+  uint64_t sum_us;
+  uint64_t max_us;
+  uint64_t buckets[LI_HISTOGRAM_BUCKETS];
+
+  LI_latency_histogram() :
+    count(0),
+    sum_us(0),
+    max_us(0),
+    buckets() {
+
+  }
+
+  double mean_us() const {
+    return (0 == this->count) ? 0 : (double) this->sum_us / this->count;
+  }
+
+  // Upper bound (in microseconds) of the bucket holding the given
+  // fraction of the latencies, e.g. 0.99 for the 99th percentile. Being
+  // a power of two it is at most twice the actual value, and never above
+  // the maximum.
+  uint64_t percentile_us(double fraction) const {
+    if (0 == this->count)
+      return 0;
+
+    uint64_t rank = (uint64_t) (fraction * this->count);
+    if (rank >= this->count)
+      rank = this->count - 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < LI_HISTOGRAM_BUCKETS; ++i) {
+      seen += this->buckets[i];
+      if (seen > rank) {
+        uint64_t bound = (uint64_t) 1 << i;
+        return (bound < this->max_us) ? bound : this->max_us;
+      }
+    }
+    return this->max_us;
+  }
+};
+
+/*
+ * Histogram of latencies with power-of-two buckets
+ *
+ * Recording is wait-free (a handful of relaxed atomic operations), so it
+ * can be done from any thread on every frame.
+ */
+class LI_histogram {
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> sum_us;
+  std::atomic<uint64_t> max_us;
+  std::atomic<uint64_t> buckets[LI_HISTOGRAM_BUCKETS];
+
+public:
+  LI_histogram() {
+    this->reset();
+  }
+
+  LI_histogram(const LI_histogram&) = delete;
+  LI_histogram& operator=(const LI_histogram&) = delete;
+
+  void reset() {
+    this->count = 0;
+    this->sum_us = 0;
+    this->max_us = 0;
+    for (int i = 0; i < LI_HISTOGRAM_BUCKETS; ++i)
+      this->buckets[i] = 0;
+  }
+
+  void record(uint64_t us) {
+    int bucket = 0;
+    while (bucket < LI_HISTOGRAM_BUCKETS - 1 && ((uint64_t) 1 << bucket) <= us)
+      ++bucket;
+
+    this->buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    this->sum_us.fetch_add(us, std::memory_order_relaxed);
+    this->count.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t max = this->max_us.load(std::memory_order_relaxed);
+    while (us > max &&
+      !this->max_us.compare_exchange_weak(max, us, std::memory_order_relaxed));
+  }
+
+  // Records the time elapsed from 'since' to 'until', if positive.
+  template <typename TimePoint>
+  void record(const TimePoint& since, const TimePoint& until) {
+
+    if (until > since)
+      this->record((uint64_t) std::chrono::duration_cast<
+        std::chrono::microseconds>(until - since).count());
+  }
+
+  // The counts, each read atomically but not all at the same instant.
+  LI_latency_histogram snapshot() const {
+    LI_latency_histogram copy;
+
+    copy.count = this->count.load(std::memory_order_relaxed);
+    copy.sum_us = this->sum_us.load(std::memory_order_relaxed);
+    copy.max_us = this->max_us.load(std::memory_order_relaxed);
+    for (int i = 0; i < LI_HISTOGRAM_BUCKETS; ++i)
+      copy.buckets[i] = this->buckets[i].load(std::memory_order_relaxed);
+
+    return copy;
+  }
+};
+
+#endif
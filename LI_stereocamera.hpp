@@ -5,19 +5,56 @@
 // #define NDEBUG
 #include <cassert>
 #include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "LI_frame.hpp"
+#include "LI_videomode.hpp"
+#include "LI_framepool.hpp"
+#include "LI_deinterleave.hpp"
+#include "LI_pipeline.hpp"
+#include "LI_stats.hpp"
+#include "LI_trace.hpp"
+#include "LI_eventloop.hpp"
+#include "LI_recording.hpp"
+#include "LI_shm.hpp"
+#include "LI_detector.hpp"
+#include "LI_eyes.hpp"
+#include "LI_tracker.hpp"
+#include "LI_budget.hpp"
+#include "LI_motion.hpp"
+#include "LI_threadpool.hpp"
+#include "LI_depth.hpp"
+#include "LI_calibration.hpp"
+#include "LI_pairing.hpp"
 
 #include <opencv/cv.h>
-#include <opencv/highgui.h>
 #include <opencv2/core/core.hpp>
 // #include <opencv2/core/types.hpp>
-#include <opencv2/opencv.hpp>
 #include <opencv2/objdetect/objdetect.hpp>
 // #include <opencv2/imgcodecs/imgcodecs.hpp>
 // #include <opencv2/videoio/videoio.hpp>
-#include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 // #include <opencv2/core/utility.hpp>
+
+// HighGUI is only needed by the (optional) preview stage, define
+// LI_WITH_HIGHGUI to build it. Headless builds never touch it.
+#ifdef LI_WITH_HIGHGUI
+#include <opencv/highgui.h>
+#include <opencv2/highgui/highgui.hpp>
 #include <opencv2/highgui/highgui_c.h>
+#endif
 
 #ifndef _GLIBCXX_STRING
 #error "LI_stereocamera relies on the String module of the standard C++ library."
@@ -40,6 +77,10 @@ enum LI_error_t {
   LI_UNABLE_TO_ALLOCATE_FRAME = 4,
   LI_UNABLE_TO_CONVERT_FRAME = 5,
   LI_UNSUPPORTED_CAMERA_MODE = 6,
+  LI_UNABLE_TO_LOAD_MODEL = 7,
+  LI_NOT_CALIBRATED = 8,
+  LI_UNABLE_TO_PUBLISH_FRAME = 9,
+  LI_UNABLE_TO_RECORD_FRAME = 10,
   LI_UNSPECIFIED = 99
 };
 
@@ -123,6 +164,14 @@ public:
     return (bool) *this;
   }
   
+  // Silently resets every error code, e.g. once an error was handled
+  // and the object is to be used again.
+  void clear() {
+    this->code_usb = LIBUSB_SUCCESS;
+    this->code_uvc = UVC_SUCCESS;
+    this->code_other = LI_SUCCESS;
+  }
+  
   const char* error_message() const {
     if (LI_SUCCESS != this->code_other) {
       switch (this->code_other) {
@@ -139,6 +188,14 @@ public:
         case LI_UNSUPPORTED_CAMERA_MODE:
           return "The camera did not support the requested video size"
             " and/or frame rate.";
+        case LI_UNABLE_TO_LOAD_MODEL:
+          return "Unable to load the detection model";
+        case LI_NOT_CALIBRATED:
+          return "No usable stereo calibration was loaded";
+        case LI_UNABLE_TO_PUBLISH_FRAME:
+          return "Unable to publish frame (no shared memory ring of that size)";
+        case LI_UNABLE_TO_RECORD_FRAME:
+          return "Unable to record frame";
         default:
           return "Unspecified error";
       }
@@ -185,32 +242,974 @@ std::ostream& operator<<(std::ostream& ostream, const LI_exception& error){
   return ostream;
 }
 
+// Number of error codes counted apart by an LI_error_channel, every code
+// from LI_UNSUPPORTED_PLATFORM to LI_UNABLE_TO_RECORD_FRAME having its
+// own slot and the rest (LI_UNSPECIFIED included) sharing the last one.
+#define LI_ERROR_SLOTS 12
+
+inline unsigned int LI_error_slot(LI_error_t code) {
+  return ((unsigned int) code < LI_ERROR_SLOTS - 1) ?
+    (unsigned int) code : LI_ERROR_SLOTS - 1;
+}
+
+// An error raised while streaming: its code and the sequence number of the
+// frame it hit (0 when not tied to a frame).
+struct LI_error_event {
+  LI_error_t code;
+  uint32_t sequence;
+  std::chrono::steady_clock::time_point time;
+  
+  LI_error_event() :
+    code(LI_SUCCESS),
+    sequence(0),
+    time() {
+  
+  }
+};
+
+// Called on the thread that raised the error (a worker or the libusb event
+// thread), so it should return quickly. See LI_error_channel::subscribe().
+typedef std::function<void(const LI_error_event&)> LI_error_listener;
+
+// A copy of the counters of an LI_error_channel.
+struct LI_error_stats {
+  unsigned long long total;
+  unsigned long long counts[LI_ERROR_SLOTS];
+  
+  // The last error raised (with an LI_SUCCESS code if none was).
+  LI_error_event last;
+  
+  LI_error_stats() :
+    total(0),
+    counts(),
+    last() {
+  
+  }
+  
+  unsigned long long count(LI_error_t code) const {
+    return this->counts[LI_error_slot(code)];
+  }
+};
+
+/*
+ * Error channel of the streaming path
+ *
+ * Errors hitting a frame cannot be thrown: the frame callback is called by
+ * libuvc's C code, and the workers have nobody to throw at. They are
+ * recorded here instead, the frame being skipped, and the application may
+ * poll the counters or subscribe to the errors. Recording never throws and
+ * never blocks: counters are atomics, and the last error is a code and a
+ * sequence number packed into one atomic word (its time being stored next
+ * to it, it may belong to an error raised concurrently).
+ *
+ * Without subscribers, the first error of each code since the last reset
+ * is written to the standard error, the next ones are only counted.
+ */
+class LI_error_channel {
+  typedef std::vector<std::pair<unsigned int, LI_error_listener> > listener_list;
+  
+  std::atomic<unsigned long long> total;
+  std::atomic<unsigned long long> counts[LI_ERROR_SLOTS];
+  std::atomic<uint64_t> last;
+  std::atomic<std::chrono::steady_clock::rep> last_time;
+  
+  // Replaced as a whole like the stages of a camera.
+  std::shared_ptr<const listener_list> listeners;
+  std::mutex listeners_lock;
+  unsigned int next_id;
+  
+public:
+  LI_error_channel() :
+    listeners(new listener_list()),
+    next_id(1) {
+  
+    this->reset();
+  }
+  
+  LI_error_channel(const LI_error_channel&) = delete;
+  LI_error_channel& operator=(const LI_error_channel&) = delete;
+  
+  void record(LI_error_t code, uint32_t sequence = 0) noexcept {
+    if (LI_SUCCESS == code)
+      return;
+  
+    LI_error_event event;
+    event.code = code;
+    event.sequence = sequence;
+    event.time = std::chrono::steady_clock::now();
+  
+    unsigned long long previous = this->counts[LI_error_slot(code)].fetch_add(
+      1, std::memory_order_relaxed);
+    this->total.fetch_add(1, std::memory_order_relaxed);
+    this->last.store(((uint64_t) code << 32) | sequence,
+      std::memory_order_relaxed);
+    this->last_time.store(event.time.time_since_epoch().count(),
+      std::memory_order_relaxed);
+  
+    try {
+      std::shared_ptr<const listener_list> listeners =
+        std::atomic_load(&this->listeners);
+  
+      if (listeners->empty() && 0 == previous)
+        std::cerr << LI_exception(code) << "\n";
+  
+      for (unsigned int i = 0; i < listeners->size(); ++i)
+        (*listeners)[i].second(event);
+    } catch (...) {
+      // A failing listener must not take the stream down with it.
+    }
+  }
+  
+  LI_error_stats snapshot() const {
+    LI_error_stats stats;
+  
+    stats.total = this->total.load(std::memory_order_relaxed);
+    for (int i = 0; i < LI_ERROR_SLOTS; ++i)
+      stats.counts[i] = this->counts[i].load(std::memory_order_relaxed);
+  
+    uint64_t last = this->last.load(std::memory_order_relaxed);
+    stats.last.code = (LI_error_t) (last >> 32);
+    stats.last.sequence = (uint32_t) last;
+    stats.last.time = std::chrono::steady_clock::time_point(
+      std::chrono::steady_clock::duration(
+        this->last_time.load(std::memory_order_relaxed)));
+  
+    return stats;
+  }
+  
+  void reset() {
+    this->total = 0;
+    for (int i = 0; i < LI_ERROR_SLOTS; ++i)
+      this->counts[i] = 0;
+    this->last = 0;
+    this->last_time = 0;
+  }
+  
+  // Registers a listener, called with every error from now on. Returns an
+  // identifier for unsubscribe().
+  unsigned int subscribe(const LI_error_listener& listener) {
+    std::lock_guard<std::mutex> guard(this->listeners_lock);
+  
+    std::shared_ptr<listener_list> listeners(
+      new listener_list(*std::atomic_load(&this->listeners)));
+    listeners->push_back(std::make_pair(this->next_id, listener));
+    std::atomic_store(&this->listeners,
+      std::shared_ptr<const listener_list>(listeners));
+  
+    return this->next_id++;
+  }
+  
+  // Errors being reported at the same time may still reach the listener.
+  void unsubscribe(unsigned int id) {
+    std::lock_guard<std::mutex> guard(this->listeners_lock);
+  
+    std::shared_ptr<listener_list> listeners(
+      new listener_list(*std::atomic_load(&this->listeners)));
+    for (unsigned int i = 0; i < listeners->size(); ++i)
+      if (id == (*listeners)[i].first) {
+        listeners->erase(listeners->begin() + i);
+        break;
+      }
+    std::atomic_store(&this->listeners,
+      std::shared_ptr<const listener_list>(listeners));
+  }
+};
+
+// How the built-in face detection finds faces in both images.
+enum LI_detect_mode_t {
+  LI_DETECT_DUAL = 0,       /* scan both images in full */
+  LI_DETECT_EPIPOLAR = 1    /* scan the left one, then its epipolar bands */
+};
+
+// Settings of the stereo camera, passed to its constructor.
+struct LI_config {
+  // Number of worker threads running the conversion and analysis stages
+  // of the frame pipeline.
+  unsigned int workers;
+  
+  // Capacity of the queue in front of each stage (rounded up to a power
+  // of two), and what to do with new frames when it is full.
+  unsigned int queue_depth;
+  LI_overflow_t overflow;
+  
+  // Number of frames the application may hold at once through grab() (see
+  // LI_frame_handle), besides the one waiting to be grabbed. The frame
+  // pool gets as many more buffers, holding more starves the pipeline. 0
+  // disables grab(). With rectification, the rectified images are handed
+  // to grab() along with the buffer, not copied. A frame grabbed takes its
+  // images with it, so the next one is rectified into new images (a frame
+  // overwritten gives them back). Images other stages pointed elsewhere
+  // are copied back into the pooled buffer, which 0 saves.
+  unsigned int grab_handles;
+  
+  // Haar cascade models used by process_frame (the nested one may be left
+  // empty). The face model is parsed once per worker and image, the nested
+  // one only with eye detection enabled, once per eye scan running at the
+  // same time. They are parsed at construction (eager_load) or when first
+  // needed. A nested model that fails to load only costs the eyes.
+  std::string face_cascade;
+  std::string nested_cascade;
+  bool eager_load;
+  
+  // How the two eyes of a frame are analysed concurrently, and the number
+  // of threads helping the workers when that is done on a thread pool.
+  // Only the full scans of LI_DETECT_DUAL run concurrently: in epipolar
+  // mode (and on tracked frames) the right image is only scanned along
+  // the bands of the faces found in the left one, after it. The threads
+  // also scan the faces for eyes at the same time.
+  LI_parallel_t parallel;
+  unsigned int parallel_threads;
+  
+  // Whether the built-in face detection is registered as a processing
+  // stage, and how it matches faces between the images. In epipolar mode
+  // a face seen in the left image is looked for up to max_disparity
+  // pixels further left in the right image, and epipolar_margin rows
+  // above or below (to allow for imperfect rectification).
+  bool face_detection;
+  LI_detect_mode_t detect_mode;
+  int max_disparity;
+  int epipolar_margin;
+  
+  // Whether the face detection also looks for the eyes of the faces it
+  // found, with the nested cascade model (see LI_eye_detector). Off by
+  // default.
+  LI_eye_config eyes;
+  
+  // The video mode to negotiate with the camera (see LI_select_mode()).
+  // Only the YUY2 modes can be used.
+  LI_mode_request mode;
+  
+  // Tracking of the faces from frame to frame (see LI_face_tracker). By
+  // default every frame is scanned in full.
+  LI_tracker_config tracking;
+  
+  // Time budget of the face detection, within which it is kept by scanning
+  // at a lower resolution or for larger faces (see LI_resolution_
+  // controller). By default there is none and the scans run at full
+  // resolution.
+  LI_budget_config budget;
+  
+  // Skipping of the analysis on frames where nothing moved (see LI_motion_
+  // gate). By default every frame is analysed.
+  LI_motion_config motion;
+  
+  // Stereo calibration (see LI_rectifier), optionally split into two
+  // files. If given, it is loaded at construction and a rectification
+  // stage is registered ahead of all the others.
+  std::string calibration;
+  std::string calibration_extrinsics;
+  
+  // Whether the camera handles its libusb events on a thread of its own
+  // (started at construction, see LI_stereocamera::start_event_thread()),
+  // rather than leaving it to main_loop() or to the application's reactor
+  // (see LI_stereocamera::event_poller()). Ignored with shared contexts.
+  bool event_thread;
+  LI_event_config events;
+  
+  LI_config() :
+    workers(2),
+    queue_depth(4),
+    overflow(LI_DROP_OLDEST),
+    grab_handles(2),
+    face_cascade("./data/haarcascades/haarcascade_frontalface_alt.xml"),
+    nested_cascade("./data/haarcascades/haarcascade_eye_tree_eyeglasses.xml"),
+    eager_load(false),
+    parallel(LI_PARALLEL_THREADS),
+    parallel_threads(2),
+    face_detection(true),
+    detect_mode(LI_DETECT_EPIPOLAR),
+    max_disparity(128),
+    epipolar_margin(8),
+    event_thread(false) {
+    
+  }
+};
+
+// Stages of the frame pipeline, see LI_stereocamera::queue_stats() and
+// pool_stats().
+enum LI_stage_t {
+  LI_STAGE_CONVERT = 0,
+  LI_STAGE_ANALYSE = 1
+};
+
+/*
+ * Frame processing stages
+ *
+ * Every stereo pair leaving the conversion stage goes through a chain of
+ * processing stages registered with LI_stereocamera::add_stage(). A stage
+ * is any callable taking an LI_stereo_frame& and returning an LI_error_t,
+ * the chain stops at the first stage that does not return LI_SUCCESS.
+ * Stages are called concurrently by all the workers, so a stage with
+ * state must either guard it or keep one copy per LI_stereo_frame::worker.
+ */
+typedef std::function<LI_error_t(LI_stereo_frame&)> LI_stage;
+
+// A chain of stages known at compile time, registered as a single stage so
+// that the calls between them can be inlined.
+template <typename... Stages>
+class LI_stage_chain {
+  std::tuple<Stages...> stages;
+  
+  template <size_t I>
+  typename std::enable_if<I == sizeof...(Stages), LI_error_t>::type 
+  run(LI_stereo_frame&) {
+    return LI_SUCCESS;
+  }
+  
+  template <size_t I>
+  typename std::enable_if<I < sizeof...(Stages), LI_error_t>::type 
+  run(LI_stereo_frame& frame) {
+    LI_error_t result = std::get<I>(this->stages)(frame);
+    if (LI_SUCCESS != result)
+      return result;
+    
+    return this->run<I + 1>(frame);
+  }
+  
+public:
+  explicit LI_stage_chain(const Stages&... stages) : stages(stages...) {
+    
+  }
+  
+  LI_error_t operator()(LI_stereo_frame& frame) {
+    return this->run<0>(frame);
+  }
+};
+
+template <typename... Stages>
+LI_stage_chain<Stages...> LI_make_chain(const Stages&... stages) {
+  return LI_stage_chain<Stages...>(stages...);
+}
+
+// Computes the disparity map of every stereo pair into the frame, see
+// LI_depth_estimator. Each worker gets its own estimator, and with it its
+// own working buffers, so 'workers' must cover every worker index.
+class LI_depth_stage {
+  std::shared_ptr<std::vector<LI_depth_estimator> > estimators;
+  
+  // With motion gating, the disparities of the last frame that changed,
+  // shared by the frames that did not. Each frame matched keeps a map of
+  // its own, so the one lent out is never written to again.
+  struct still_t {
+    std::mutex lock;
+    cv::Mat disparity;
+    cv::Rect roi;
+    int downscale;
+  };
+  
+  std::shared_ptr<still_t> still;
+  
+public:
+  explicit LI_depth_stage(
+    const LI_depth_config& config = LI_depth_config(), 
+    unsigned int workers = 1) :
+    estimators(new std::vector<LI_depth_estimator>()),
+    still(new still_t()) {
+    
+    // Constructed one by one, copies would share the same matcher.
+    for (unsigned int i = 0; i < std::max(1u, workers); ++i)
+      this->estimators->push_back(LI_depth_estimator(config));
+    
+    this->still->downscale = 1;
+  }
+  
+  LI_error_t operator()(LI_stereo_frame& frame) {
+    if (frame.worker >= this->estimators->size())
+      return LI_UNSPECIFIED;
+    
+    LI_depth_estimator& estimator = (*this->estimators)[frame.worker];
+    still_t& still = *this->still;
+    
+    // Nothing moved, the disparities are those of the last frame matched.
+    if (!frame.motion.changed) {
+      std::lock_guard<std::mutex> guard(still.lock);
+      
+      if (!still.disparity.empty()) {
+        frame.disparity = still.disparity;
+        frame.disparity_roi = still.roi;
+        frame.disparity_downscale = still.downscale;
+        return LI_SUCCESS;
+      }
+    }
+    
+    LI_TRACE_SCOPE("depth");
+    try {
+      estimator.compute(frame.left, frame.right, 
+        frame.disparity, frame.disparity_roi);
+    } catch (const cv::Exception&) {
+      return LI_UNSPECIFIED;
+    }
+    
+    frame.disparity_downscale = estimator.settings().downscale;
+    
+    // Only kept when motion gating is on (the frame then has tiles). The
+    // map is copied outside the lock, and the one it replaces is freed
+    // outside it too, once no frame uses it any more.
+    if (0 < frame.motion.grid.area()) {
+      cv::Mat disparity = frame.disparity.clone();
+      std::lock_guard<std::mutex> guard(still.lock);
+      
+      cv::swap(still.disparity, disparity);
+      still.roi = frame.disparity_roi;
+      still.downscale = frame.disparity_downscale;
+    }
+    
+    return LI_SUCCESS;
+  }
+};
+
+#ifdef LI_WITH_HIGHGUI
+// Settings of the preview, see LI_preview_stage.
+struct LI_preview_config {
+  // Highest rate the preview is refreshed at, frames coming faster being
+  // skipped (0 for no limit).
+  double max_fps;
+  
+  // Both images side by side in one window, or each in a window of its
+  // own.
+  bool side_by_side;
+  
+  // Colours the disparities of the depth stage (if any) over the left
+  // image, with the given opacity. The colours span the disparities from 0
+  // to disparity_range pixels (of the disparity map), or to the largest
+  // one of each frame if 0.
+  bool disparity_overlay;
+  double overlay_alpha;
+  int disparity_range;
+  
+  std::string window;
+  
+  LI_preview_config() :
+    max_fps(15),
+    side_by_side(true),
+    disparity_overlay(false),
+    overlay_alpha(0.5),
+    disparity_range(0),
+    window("LI Stereo Camera") {
+    
+  }
+};
+
+// Counters of an LI_preview_stage. Frames are either posted to the preview
+// thread, skipped by the rate limit, or skipped because the thread was
+// busy taking the previous one.
+struct LI_preview_stats {
+  unsigned long long posted;
+  unsigned long long decimated;
+  unsigned long long busy;
+  unsigned long long rendered;
+  
+  LI_preview_stats() :
+    posted(0),
+    decimated(0),
+    busy(0),
+    rendered(0) {
+    
+  }
+};
+
+/*
+ * Preview of the (annotated) images in HighGUI windows
+ *
+ * The stage only copies the images of a frame into a single-slot mailbox,
+ * at most max_fps times a second, and never waits: if the preview thread
+ * holds the mailbox the frame is skipped. The thread renders the latest
+ * frame posted, so a slow display drops frames rather than slowing the
+ * capture down. Copies of the stage share the mailbox and the thread,
+ * which stops with the last of them. HighGUI is not thread safe, so the
+ * threads of all the previews share one lock.
+ */
+class LI_preview_stage {
+  struct preview_t {
+    LI_preview_config config;
+    
+    // The mailbox: the images of the last frame posted, and whether the
+    // thread has yet to take them.
+    std::mutex lock;
+    std::condition_variable posted;
+    cv::Mat left, right, disparity;
+    cv::Rect disparity_roi;
+    int disparity_downscale;
+    bool pending;
+    bool stopping;
+    
+    std::atomic<int64_t> last_post;
+    std::atomic<unsigned long long> counters[4];
+    
+    std::thread thread;
+    
+    explicit preview_t(const LI_preview_config& config) :
+      config(config),
+      disparity_downscale(1),
+      pending(false),
+      stopping(false),
+      last_post(0) {
+      
+      for (int i = 0; i < 4; ++i)
+        this->counters[i] = 0;
+      this->thread = std::thread(&preview_t::render_loop, this);
+    }
+    
+    ~preview_t() {
+      {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->stopping = true;
+      }
+      this->posted.notify_one();
+      this->thread.join();
+    }
+    
+    // Copies a frame into the mailbox, unless too soon or the mailbox is
+    // busy.
+    void post(const LI_stereo_frame& frame) {
+      int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+      int64_t last = this->last_post.load(std::memory_order_relaxed);
+      
+      if (0 < this->config.max_fps && 
+          now - last < (int64_t) (1e6 / this->config.max_fps)) {
+        ++this->counters[1];
+        return;
+      }
+      
+      std::unique_lock<std::mutex> guard(this->lock, std::try_to_lock);
+      if (!guard.owns_lock() || 
+          !this->last_post.compare_exchange_strong(last, now)) {
+        ++this->counters[2];
+        return;
+      }
+      
+      frame.left.copyTo(this->left);
+      frame.right.copyTo(this->right);
+      frame.disparity.copyTo(this->disparity);
+      this->disparity_roi = frame.disparity_roi;
+      this->disparity_downscale = frame.disparity_downscale;
+      this->pending = true;
+      
+      guard.unlock();
+      this->posted.notify_one();
+      ++this->counters[0];
+    }
+    
+    // Colours the disparities over the left image, in 'view'.
+    void overlay(
+      const cv::Mat& disparity, const cv::Rect& roi, int downscale,
+      cv::Mat& view) const {
+      
+      cv::Rect area = roi & cv::Rect(0, 0, view.cols, view.rows);
+      if (disparity.empty() || area.empty())
+        return;
+      
+      double range = 16.0 * this->config.disparity_range;
+      if (0 >= range)
+        cv::minMaxLoc(disparity, NULL, &range);
+      if (0 >= range)
+        return;
+      
+      cv::Mat levels, colours;
+      disparity.convertTo(levels, CV_8U, 255.0 / range);
+      cv::applyColorMap(levels, colours, cv::COLORMAP_JET);
+      if (1 != downscale || colours.size() != area.size())
+        cv::resize(colours, colours, area.size(), 0, 0, cv::INTER_NEAREST);
+      
+      cv::Mat target = view(area);
+      cv::addWeighted(colours, this->config.overlay_alpha, 
+        target, 1 - this->config.overlay_alpha, 0, target);
+    }
+    
+    void render_loop() {
+      cv::Mat left, right, disparity, view, eyes[2];
+      cv::Rect roi;
+      int downscale;
+      
+      std::unique_lock<std::mutex> guard(this->lock);
+      
+      for (;;) {
+        this->posted.wait(guard, [this] { 
+          return this->pending || this->stopping; 
+        });
+        if (this->stopping)
+          break;
+        
+        // Take the images, leaving the buffers of the previous ones in the
+        // mailbox for the next frame.
+        cv::swap(left, this->left);
+        cv::swap(right, this->right);
+        cv::swap(disparity, this->disparity);
+        roi = this->disparity_roi;
+        downscale = this->disparity_downscale;
+        this->pending = false;
+        
+        guard.unlock();
+        
+        LI_TRACE_SCOPE("preview");
+        cv::cvtColor(left, eyes[0], cv::COLOR_GRAY2BGR);
+        cv::cvtColor(right, eyes[1], cv::COLOR_GRAY2BGR);
+        if (this->config.disparity_overlay)
+          this->overlay(disparity, roi, downscale, eyes[0]);
+        
+        {
+          std::lock_guard<std::mutex> highgui(LI_preview_stage::highgui_lock());
+          
+          if (this->config.side_by_side) {
+            cv::hconcat(eyes[0], eyes[1], view);
+            cv::imshow(this->config.window, view);
+          }
+          else {
+            cv::imshow(this->config.window + " (left)", eyes[0]);
+            cv::imshow(this->config.window + " (right)", eyes[1]);
+          }
+          cv::waitKey(1);
+        }
+        ++this->counters[3];
+        
+        guard.lock();
+      }
+    }
+  };
+  
+  std::shared_ptr<preview_t> preview;
+  
+  static std::mutex& highgui_lock() {
+    static std::mutex lock;
+    return lock;
+  }
+  
+public:
+  explicit LI_preview_stage(
+    const LI_preview_config& config = LI_preview_config()) : 
+    preview(new preview_t(config)) {
+    
+  }
+  
+  LI_error_t operator()(LI_stereo_frame& frame) {
+    this->preview->post(frame);
+    return LI_SUCCESS;
+  }
+  
+  LI_preview_stats stats() const {
+    LI_preview_stats stats;
+    stats.posted = this->preview->counters[0];
+    stats.decimated = this->preview->counters[1];
+    stats.busy = this->preview->counters[2];
+    stats.rendered = this->preview->counters[3];
+    return stats;
+  }
+};
+#endif
+
+// Counters of the hotplug events and of the connections they led to, see
+// LI_stereocamera::connection_stats(). The latency is the time from the
+// arrival of the camera to the delivery of its first frame.
+struct LI_connection_stats {
+  unsigned int arrivals;
+  unsigned int departures;
+  unsigned int connections;
+  unsigned int first_frames;
+  
+  std::chrono::microseconds last_latency;
+  std::chrono::microseconds max_latency;
+  
+  LI_connection_stats() :
+    arrivals(0),
+    departures(0),
+    connections(0),
+    first_frames(0),
+    last_latency(0),
+    max_latency(0) {
+    
+  }
+};
+
+// Counters of the frames and of their latencies, see LI_stereocamera::
+// frame_stats(). The latencies are those from the completion of a frame
+// by libuvc to the frame callback (capture), from the frame callback to
+// the start of the processing stages (queueing), of the stages themselves
+// (processing), and from the frame callback to the end of the stages
+// (delivery).
+struct LI_frame_stats {
+  // Frames received by the frame callback, and frames missing from the
+  // sequence in between (over as many gaps).
+  unsigned long long received;
+  unsigned long long missing;
+  unsigned long long gaps;
+  
+  // Frames dropped by the pipeline, and frames that went through it.
+  unsigned long long dropped;
+  unsigned long long delivered;
+  
+  LI_latency_histogram capture;
+  LI_latency_histogram queueing;
+  LI_latency_histogram processing;
+  LI_latency_histogram delivery;
+  
+  LI_frame_stats() :
+    received(0),
+    missing(0),
+    gaps(0),
+    dropped(0),
+    delivered(0) {
+    
+  }
+};
+
+// Counters of the frames offered to grab(), see LI_stereocamera::
+// grab_stats(): frames through the stages, frames grabbed, and frames
+// replaced by a newer one before anybody grabbed them. Frames the stages
+// left with images of another size or type are not offered, but counted
+// as unavailable.
+struct LI_grab_stats {
+  unsigned long long offered;
+  unsigned long long grabbed;
+  unsigned long long overwritten;
+  unsigned long long unavailable;
+  
+  LI_grab_stats() :
+    offered(0),
+    grabbed(0),
+    overwritten(0),
+    unavailable(0) {
+    
+  }
+};
+
 /*
  * Leopard Imaging Stereo Camera class
  */
 class LI_stereocamera {
 
-  static const int WIDTH = 640, HEIGHT = 480, FPS = 30;
+  // Workers sleeping on an empty pipeline recheck the queues at least this
+  // often, which bounds the cost of a missed wake-up (frame_callback does
+  // not take the lock when notifying them).
+  static const int WAKEUP_MS = 2;
+  
+  // Updated by the reconnector thread, read by LI_camera_manager.
+  std::atomic<bool> connected;
   
-  bool connected = false;
+  // Vendor and product IDs of the LI Stereo Camera.
+  static const uint16_t VENDOR_ID = 0x2A0B, PRODUCT_ID = 0x00F5;
+  
+  // Hotplug events are only recorded by the libusb callback, and handled
+  // on the reconnector thread: opening the camera and negotiating with it
+  // takes far longer than an event callback should, and libusb does not
+  // allow most of it from within one anyway.
+  struct hotplug_event_t {
+    libusb_device *device;
+    bool arrived;
+    std::chrono::steady_clock::time_point time;
+  };
+  
+  libusb_hotplug_callback_handle hotplug_handle;
+  std::vector<hotplug_event_t> hotplug_events;
+  std::mutex hotplug_lock;
+  std::condition_variable hotplug_wakeup;
+  std::thread reconnector;
+  bool reconnecting;
+  
+  // Time of the last connection, and whether its first frame is still to
+  // come. The stats are guarded by hotplug_lock.
+  std::chrono::steady_clock::time_point connect_time;
+  std::atomic<bool> awaiting_frame;
+  LI_connection_stats connection_counters;
   
   libusb_context *usb_context;
   uvc_context_t *uvc_context;
   
-  libusb_device *usb_device;
+  // Whether the library contexts are ours, as opposed to shared with
+  // other cameras by an LI_camera_manager, and the serial number of the
+  // camera to open (any LI Stereo Camera if empty).
+  bool owns_context;
+  std::string serial;
+  
+  // The libusb device is compared with departing devices by the manager.
+  std::atomic<libusb_device*> usb_device;
   uvc_device_t *uvc_device;
   
   uvc_device_handle_t *uvc_handle;
   uvc_stream_ctrl_t uvc_stream;
   
+  LI_config config;
+  
+  // Pre-allocated buffers, sized once the video mode is negotiated and
+  // recycled for every frame thereafter: raw YUYV copies taken by
+  // frame_callback, and the grey left/right images produced from them.
+  LI_framepool raw_pool;
+  LI_framepool frame_pool;
+  
+  // The frame pipeline: frame_callback hands raw frames to the conversion
+  // queue, the workers turn them into stereo pairs for the analysis queue
+  // and then analyse those.
+  LI_stage_queue<LI_framebuffer*> convert_queue;
+  LI_stage_queue<LI_framebuffer*> analyse_queue;
+  
+  std::vector<std::thread> workers;
+  std::atomic<bool> running;
+  
+  std::mutex wakeup_lock;
+  std::condition_variable wakeup;
+  
+  // Number of frames accepted by frame_callback which are not processed
+  // (or dropped) yet, used to drain the pipeline before disconnecting.
+  std::atomic<unsigned int> in_flight;
+  std::mutex drained_lock;
+  std::condition_variable drained;
+  
+  // The registered processing stages. The list is replaced as a whole
+  // whenever it changes, so that the workers can keep running through the
+  // copy they picked up at the start of a frame.
+  std::shared_ptr<const std::vector<LI_stage> > stages;
+  std::mutex stages_lock;
+  
+  // Whether frame_callback accepts frames, and how many calls of it are
+  // under way. on_disconnect() closes the gate and waits for the calls in
+  // progress, so that no frame enters the pipeline while it is drained and
+  // the stream torn down.
+  std::atomic<bool> accepting;
+  std::atomic<unsigned int> callbacks;
+  
+  // The libusb events, handled either by a thread of ours or by the
+  // application (through main_loop() or the poller).
+  LI_event_thread event_loop;
+  LI_event_poller poller;
+  
+  // The video modes advertised by the camera, the one negotiated, and the
+  // size of the images it delivers. Guarded by mode_lock since they are
+  // updated from the libusb event thread. The frame interval is copied
+  // out for the frame callback.
+  std::vector<LI_video_mode> modes;
+  LI_video_mode mode;
+  cv::Size frame_size;
+  mutable std::mutex mode_lock;
+  std::atomic<uint32_t> frame_interval;
+  
+  // Frame counters and latencies. The last sequence number is only
+  // meaningful once a frame was seen since the stream (re)started.
+  std::atomic<uint32_t> last_sequence;
+  std::atomic<bool> sequence_started;
+  std::atomic<unsigned long long> received_frames;
+  std::atomic<unsigned long long> missing_frames;
+  std::atomic<unsigned long long> sequence_gaps;
+  std::atomic<unsigned long long> delivered_frames;
+  LI_histogram capture_latency;
+  LI_histogram queueing_latency;
+  LI_histogram processing_latency;
+  LI_histogram delivery_latency;
+  
+  // Recorder of the raw stream, if recording. Swapped as a whole like the
+  // stages, so that the frame callback never waits on start or stop.
+  std::shared_ptr<LI_record_writer> recorder;
+  
+  // The latest frame through the stages, waiting for grab(). Only a
+  // reference to its pooled buffer is kept, which a newer frame replaces,
+  // along with its rectified images if it was rectified. The sequence
+  // number of the last frame offered keeps frames finished out of order by
+  // the workers from going back in time.
+  LI_frame_ref grab_slot;
+  cv::Mat grab_images[2];
+  uint32_t grab_sequence;
+  bool grab_started;
+  mutable std::mutex grab_lock;
+  std::condition_variable grab_wakeup;
+  LI_grab_stats grab_counters;
+  
+  // The stereo calibration with its rectification maps, replaced as a
+  // whole like the stages.
+  std::shared_ptr<const LI_rectifier> rectifier;
+  
+  // The cascade models, and the faces tracked from frame to frame.
+  LI_cascade_models models;
+  
+  // The generation of the last models reported as failing to load, so
+  // that a failed swap is reported once rather than on every frame.
+  std::atomic<unsigned int> failed_models;
+  
+  LI_face_tracker tracker;
+  
+  // The nested classifiers, lent to the eye scans of all the workers.
+  LI_eye_detector eye_detector;
+  
+  // The resolution the faces are detected at.
+  LI_resolution_controller resolution;
+  
+  // Tells the frames where something moved from those where nothing did.
+  // The latter get the faces of the last frame analysed, kept here and
+  // replaced as a whole like the stages.
+  LI_motion_gate motion;
+  std::shared_ptr<const std::vector<LI_face> > still_faces;
+  uint32_t still_sequence;
+  bool still_started;
+  std::mutex still_lock;
+  
+  // Everything a worker keeps from one frame to the next, so that the
+  // built-in stages neither share state nor allocate per frame.
+  struct worker_context {
+    // One set of classifiers per eye, loaded from the models, so that
+    // both eyes can be analysed concurrently.
+    LI_detector detectors[2];
+    
+    // Rectified images.
+    cv::Mat rectified[2];
+    
+    // Shrunk images compared by the motion gate.
+    cv::Mat shrunk[2];
+    
+    // Equalised images fed to the cascades and the faces found in them.
+    cv::Mat small[2];
+    std::vector<cv::Rect> hits[2];
+    std::vector<cv::Rect> flipped[2];
+    std::vector<cv::Rect> candidates;
+    std::vector<bool> used;
+    
+    // Where the tracked faces were last seen.
+    std::vector<cv::Rect> tracked;
+    
+    // Equalised faces fed to the nested cascade and the eyes found in them.
+    LI_eye_scratch eyes;
+    
+    // The faces of the last frame analysed, copied once from the shared
+    // ones ('still_source') and then lent to the frames where nothing
+    // moved, for as long as the stages run.
+    std::vector<LI_face> still_faces;
+    std::shared_ptr<const std::vector<LI_face> > still_source;
+    bool faces_lent;
+    
+    // The frame handed to the stages.
+    LI_stereo_frame frame;
+    
+    worker_context() :
+      faces_lent(false) {
+    
+    }
+  };
+  
+  std::vector<worker_context> contexts;
+  
+  // Threads helping the workers analyse both eyes at the same time.
+  LI_threadpool eye_pool;
+  
   // This class extends the error reporting functionality provided by 
   // the libuvc library, namely by adding a secondary error code of the
   // enumerated type LI_error_t when the primary (i.e. UVC) error code
   // is equal to UVC_ERROR_OTHER.
   LI_exception error;
+  
+  // Errors of the streaming path, see report().
+  LI_error_channel errors;
 
-  // The hotplug callback is called automatically whenever a device is
-  // plugged or unplugged. If registered with the flag LIBUSB_HOTPLUG_
+  // Whether a libusb device has the vendor and product IDs of the LI
+  // Stereo Camera. Only the cached device descriptor is read, which is
+  // allowed within hotplug callbacks.
+  static bool is_camera(libusb_device *device) {
+    libusb_device_descriptor descriptor;
+    
+    return LIBUSB_SUCCESS == libusb_get_device_descriptor(device, &descriptor) &&
+      LI_stereocamera::VENDOR_ID == descriptor.idVendor &&
+      LI_stereocamera::PRODUCT_ID == descriptor.idProduct;
+  }
+  
+  // The hotplug callback is called automatically whenever an LI Stereo
+  // Camera is plugged or unplugged (it is registered for its vendor and
+  // product IDs only). If registered with the flag LIBUSB_HOTPLUG_
   // NO_FLAGS then will only be called for any plugging or unplugging
   // of devices after the program started. If registered with LIBUSB_
   // HOTPLUG_ENUMERATE, on the other hand, then will result in an 
@@ -225,9 +1224,14 @@ class LI_stereocamera {
     // This is a substitute for the "this" pointer in a class method.
     LI_stereocamera *self = (LI_stereocamera*) user_data;
     
-    // This method is responsible of maintaining a valid handle to the
-    // Leopard Imaging Stereo Camera.
-    self->update_connection();
+    // Simulated events (and those of contexts shared with wider callbacks)
+    // may concern any device, only ours are of interest.
+    if (NULL != device && !LI_stereocamera::is_camera(device))
+      return 0;
+    
+    // The reconnector thread is responsible of maintaining a valid
+    // handle to the Leopard Imaging Stereo Camera.
+    self->post_hotplug(device, LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED == event);
     
     // A return value of '0' tells the libusb library that we are
     // still interested in getting hotplug notifications, as opposed
@@ -235,110 +1239,642 @@ class LI_stereocamera {
     return 0;
   }
   
-  // The frame callback is used to process frames from the camera
+  // The frame callback is used to process frames from the camera. It runs
+  // on the libusb event thread, so all it does is take a copy of the raw
+  // frame (libuvc reuses its buffer as soon as we return) and queue it,
+  // the conversion and the analysis are left to the worker threads.
   static void frame_callback(uvc_frame *frame, void *user_data) {
     
     // This is the equivalent of "this" in a nonstatic class method
     LI_stereocamera *self = (LI_stereocamera*) user_data;
     
-    frame->frame_format = UVC_FRAME_FORMAT_YUYV;
-
-    uvc_frame_t *greyLeft;
-    uvc_frame_t *greyRight;
-
-    /* We'll convert the image from YUV/JPEG to gray8, so allocate space */
-    greyLeft = uvc_allocate_frame(frame->width * frame->height);
-    greyRight = uvc_allocate_frame(frame->width * frame->height);
-    if (!greyLeft || !greyRight) {
-      self->error = LI_UNABLE_TO_ALLOCATE_FRAME;
-      return;
+    ++self->callbacks;
+    
+    // Nothing may unwind through libuvc, whatever escapes the frame is
+    // counted against it and the frame is skipped.
+    if (self->accepting) {
+      try {
+        self->receive_frame(frame);
+      } catch (...) {
+        self->report(LI_UNSPECIFIED, frame->sequence);
+      }
+    }
+    
+    --self->callbacks;
+  }
+  
+  void receive_frame(uvc_frame *frame) {
+    LI_TRACE_SCOPE("frame_callback");
+    
+    frame->frame_format = UVC_FRAME_FORMAT_YUYV;
+    
+    std::chrono::steady_clock::time_point arrival = 
+      std::chrono::steady_clock::now();
+    
+    if (this->awaiting_frame.load(std::memory_order_relaxed) &&
+        this->awaiting_frame.exchange(false))
+      this->first_frame();
+    
+    // Frames lost before reaching us only show as gaps in the sequence
+    // numbers. Those going backwards (a restarted stream) are no gap.
+    uint32_t gap = 0;
+    uint32_t previous = this->last_sequence.exchange(frame->sequence);
+    if (this->sequence_started.exchange(true) && 
+        (int32_t) (frame->sequence - previous) > 1) {
+      gap = frame->sequence - previous - 1;
+      this->missing_frames += gap;
+      ++this->sequence_gaps;
+    }
+    ++this->received_frames;
+    
+    int64_t capture_us = (int64_t) frame->capture_time.tv_sec * 1000000 + 
+      frame->capture_time.tv_usec;
+    if (0 != capture_us) {
+      int64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+      if (now_us > capture_us)
+        this->capture_latency.record((uint64_t) (now_us - capture_us));
     }
 
-    /* Do the BGR conversion */
-    LI_exception resultLeft(uvc_yuyv2y(frame, greyLeft));
-    LI_exception resultRight(uvc_yuyv2uv(frame, greyRight));
- 
-    if ((bool) resultLeft || (bool) resultRight) {
-      uvc_free_frame(greyLeft);
-      uvc_free_frame(greyRight);
+    // Take a recycled buffer for the raw frame. The pool never
+    // allocates, if it ran dry it has counted the event and the frame
+    // is simply dropped.
+    LI_framebuffer *raw = this->raw_pool.acquire();
+    if (NULL == raw)
+      return;
     
-      self->error = LI_UNABLE_TO_CONVERT_FRAME;
+    size_t step = (0 != frame->step) ? frame->step : 2 * (size_t) frame->width;
+    
+    if ((int) frame->width != raw->width ||
+        (int) frame->height != raw->height ||
+        frame->data_bytes < step * frame->height) {
+      this->raw_pool.release(raw);
+      
+      this->report(LI_UNABLE_TO_CONVERT_FRAME, frame->sequence);
       return;
     }
+    
+    if (step == raw->step)
+      std::memcpy(raw->plane[0], frame->data, raw->plane_bytes);
+    else
+      for (int y = 0; y < raw->height; ++y)
+        std::memcpy(raw->plane[0] + y * raw->step, 
+          (const uint8_t*) frame->data + y * step, raw->step);
+    
+    raw->info.sequence = frame->sequence;
+    raw->info.gap = gap;
+    raw->info.capture_us = capture_us;
+    raw->info.arrival = arrival;
+    raw->info.payload_bytes = frame->data_bytes;
+    raw->info.width = raw->width;
+    raw->info.height = raw->height;
+    raw->info.mode = LI_video_mode(LI_FOURCC_YUY2, raw->width, raw->height, 
+      this->frame_interval.load(std::memory_order_relaxed));
+    
+    // The recording is written by a thread of its own, from a reference to
+    // the raw copy.
+    std::shared_ptr<LI_record_writer> recorder = std::atomic_load(&this->recorder);
+    if (recorder && !recorder->push(this->raw_pool.share(raw)))
+      this->report(LI_UNABLE_TO_RECORD_FRAME, raw->info.sequence);
+    
+    ++this->in_flight;
+    this->enqueue(this->convert_queue, this->raw_pool, raw);
+  }
   
-    cv::Mat left(greyLeft->height, greyLeft->width, CV_8UC1, greyLeft->data);
-    cv::Mat right(greyRight->height, greyRight->width, CV_8UC1, greyRight->data);
+  // Conversion stage: splits a raw frame into the left (Y) and right (UV)
+  // images, writing both pooled planes in a single pass.
+  void convert_frame(LI_framebuffer *raw) {
+    LI_TRACE_SCOPE("convert");
+    
+    LI_framebuffer *buffer = this->frame_pool.acquire();
+    
+    if (NULL != buffer)
+      buffer->info = raw->info;
+    
+    if (NULL != buffer &&
+        !LI_deinterleave_yuyv(
+          raw->plane[0], raw->step, 
+          raw->width, raw->height,
+          buffer->plane[0], buffer->step,
+          buffer->plane[1], buffer->step)) {
+      this->frame_pool.release(buffer);
+      buffer = NULL;
+      
+      this->report(LI_UNABLE_TO_CONVERT_FRAME, raw->info.sequence);
+    }
+    
+    this->raw_pool.release(raw);
+    
+    if (NULL == buffer) {
+      this->frame_done();
+      return;
+    }
+    
+    this->enqueue(this->analyse_queue, this->frame_pool, buffer);
+  }
   
-    // Process the frame
-    self->error = self->process_frame(left, right);
+  // Analysis stage: runs a stereo pair through the processing stages.
+  void analyse_frame(LI_framebuffer *buffer, unsigned int worker) {
+    LI_TRACE_SCOPE("analyse");
+    
+    // The worker's frame is reused, so that the containers it holds keep
+    // their capacity from one frame to the next.
+    worker_context& context = this->contexts[worker];
+    LI_stereo_frame& frame = context.frame;
+    frame.left = cv::Mat(buffer->height, buffer->width, CV_8UC1, 
+      buffer->plane[0], buffer->step);
+    frame.right = cv::Mat(buffer->height, buffer->width, CV_8UC1, 
+      buffer->plane[1], buffer->step);
+    frame.info = buffer->info;
+    frame.disparity = cv::Mat();
+    frame.disparity_roi = cv::Rect();
+    frame.disparity_downscale = 1;
+    frame.faces.clear();
+    frame.worker = worker;
+    
+    std::shared_ptr<const std::vector<LI_stage> > stages = 
+      std::atomic_load(&this->stages);
+    
+    std::chrono::steady_clock::time_point start = 
+      std::chrono::steady_clock::now();
+    
+    if (this->motion.enabled()) {
+      LI_TRACE_SCOPE("motion");
+      this->motion.assess(frame.left, frame.right, 
+        context.shrunk, frame.motion);
+    }
+    else
+      frame.motion = LI_motion_map();
+    
+    // A stage failing (or throwing) skips the rest of the chain for this
+    // frame only.
+    for (unsigned int i = 0; i < stages->size(); ++i) {
+      LI_error_t result;
+      
+      try {
+        result = (*stages)[i](frame);
+      } catch (LI_exception *error) {
+        result = (const LI_error_t&) *error;
+        if (LI_SUCCESS == result)
+          result = LI_UNSPECIFIED;
+        error->clear();
+      } catch (...) {
+        result = LI_UNSPECIFIED;
+      }
+      
+      if (LI_SUCCESS != result) {
+        this->report(result, frame.info.sequence);
+        break;
+      }
+    }
+    
+    // Faces lent to the frame go back to the worker. Had a stage changed
+    // them, they are dropped, to be copied afresh for the next frame.
+    if (context.faces_lent) {
+      frame.faces.swap(context.still_faces);
+      context.faces_lent = false;
+      
+      if (context.still_source ? 
+          context.still_faces != *context.still_source : 
+          !context.still_faces.empty()) {
+        context.still_faces.clear();
+        context.still_source.reset();
+      }
+    }
+    
+    std::chrono::steady_clock::time_point end = 
+      std::chrono::steady_clock::now();
     
-    cv::imshow("Left", left);
-    cv::imshow("Right", right);
-    cvWaitKey(10);
+    this->queueing_latency.record(frame.info.arrival, start);
+    this->processing_latency.record(start, end);
+    this->delivery_latency.record(frame.info.arrival, end);
+    ++this->delivered_frames;
+    
+    if (0 < this->config.grab_handles)
+      this->offer(buffer, frame);
 
-    uvc_free_frame(greyLeft);
-    uvc_free_frame(greyRight);
+    this->frame_pool.release(buffer);
+    this->frame_done();
   }
   
-  // Core functionality is provided here.
-  LI_error_t process_frame(cv::Mat& left, cv::Mat& right) {
+  // Makes a frame the one grab() returns next, unless a later one was
+  // offered already. The frame it replaces, if nobody grabbed it, is
+  // released outside the lock.
+  //
+  // So that grab() hands out what the stages left, the worker's rectified
+  // images go along with the frame, the worker taking back those of the
+  // frame replaced, if any. Images the stages pointed elsewhere are first
+  // copied back into the buffer, which nobody else holds yet. Images of
+  // another size or type cannot be, and the frame is not offered.
+  void offer(LI_framebuffer *buffer, const LI_stereo_frame& frame) {
+    cv::Mat *rectified = this->contexts[frame.worker].rectified;
+    const cv::Mat *images[2] = { &frame.left, &frame.right };
+    bool handed[2] = { false, false };
     
-    std::string cascadeName = "./data/haarcascades/haarcascade_frontalface_alt.xml";
-    std::string nestedCascadeName = "./data/haarcascades/haarcascade_eye_tree_eyeglasses.xml";
-
-    cv::CascadeClassifier cascade, nestedCascade;
+    for (int eye = 0; eye < 2; ++eye) {
+      if (images[eye]->data == buffer->plane[eye])
+        continue;
+      
+      if (buffer->height != images[eye]->rows || 
+          buffer->width != images[eye]->cols ||
+          CV_8UC1 != images[eye]->type()) {
+        std::lock_guard<std::mutex> guard(this->grab_lock);
+        ++this->grab_counters.unavailable;
+        return;
+      }
+      
+      handed[eye] = images[eye]->data == rectified[eye].data && 
+        images[eye]->size() == rectified[eye].size();
+      if (handed[eye])
+        continue;
+      
+      cv::Mat plane(buffer->height, buffer->width, CV_8UC1, 
+        buffer->plane[eye], buffer->step);
+      images[eye]->copyTo(plane);
+    }
     
-    if (!cascade.load(cascadeName) ||
-        !nestedCascade.load(nestedCascadeName))
-      return LI_UNSPECIFIED;
+    LI_frame_ref ref = this->frame_pool.share(buffer);
+    cv::Mat dropped[2];
+    
+    {
+      std::lock_guard<std::mutex> guard(this->grab_lock);
+      ++this->grab_counters.offered;
+      
+      if (this->grab_started && 
+          (int32_t) (buffer->info.sequence - this->grab_sequence) < 0) {
+        ++this->grab_counters.overwritten;
+        return;
+      }
+      
+      if (this->grab_slot)
+        ++this->grab_counters.overwritten;
+      this->grab_slot.swap(ref);
+      this->grab_sequence = buffer->info.sequence;
+      this->grab_started = true;
+      
+      // Only headers are swapped under the lock.
+      for (int eye = 0; eye < 2; ++eye)
+        cv::swap(this->grab_images[eye], 
+          handed[eye] ? rectified[eye] : dropped[eye]);
+    }
+    
+    this->grab_wakeup.notify_one();
+  }
+  
+  // Errors raised while streaming cannot be thrown back at the
+  // application, so they go to the error channel instead. Exceptions are
+  // left to setup and teardown.
+  void report(LI_error_t error_code, uint32_t sequence = 0) noexcept {
+    this->errors.record(error_code, sequence);
+  }
+  
+  // Hands a buffer to the next stage according to the overflow policy.
+  // Whatever the queue refused or evicted goes back to its pool.
+  void enqueue(
+    LI_stage_queue<LI_framebuffer*>& queue, 
+    LI_framepool& pool, 
+    LI_framebuffer *buffer) {
+    
+    LI_framebuffer *evicted = NULL;
+    
+    switch (queue.push(buffer, evicted, this->running)) {
+      case LI_REJECTED:
+        evicted = buffer;
+        break;
+      case LI_QUEUED_EVICTED:
+        this->wakeup.notify_one();
+        break;
+      default:
+        this->wakeup.notify_one();
+        return;
+    }
+    
+    pool.release(evicted);
+    this->frame_done();
+  }
+  
+  void frame_done() {
+    if (1 == this->in_flight.fetch_sub(1)) {
+      std::lock_guard<std::mutex> guard(this->drained_lock);
+      this->drained.notify_all();
+    }
+  }
+  
+  // Blocks until every frame accepted so far is processed or dropped.
+  void drain() {
+    std::unique_lock<std::mutex> lock(this->drained_lock);
+    this->drained.wait(lock, [this] { 
+      return 0 == this->in_flight.load(); 
+    });
+  }
+  
+  // Body of the worker threads. Analysis is favoured over conversion so
+  // that finished frames leave the pipeline (and free their buffers)
+  // before new ones enter it.
+  void worker_loop(unsigned int worker) {
+    while (this->running) {
+      LI_framebuffer *buffer;
+      
+      if (this->analyse_queue.pop(buffer)) {
+        this->analyse_frame(buffer, worker);
+        continue;
+      }
+      
+      if (this->convert_queue.pop(buffer)) {
+        this->convert_frame(buffer);
+        continue;
+      }
+      
+      std::unique_lock<std::mutex> lock(this->wakeup_lock);
+      this->wakeup.wait_for(lock, 
+        std::chrono::milliseconds(LI_stereocamera::WAKEUP_MS), [this] {
+          return !this->running || 
+            !this->analyse_queue.empty() || !this->convert_queue.empty();
+        });
+    }
+  }
+  
+  void start_workers() {
+    this->running = true;
+    for (unsigned int i = 0; i < this->contexts.size(); ++i)
+      this->workers.push_back(
+        std::thread(&LI_stereocamera::worker_loop, this, i));
+  }
+  
+  void stop_workers() {
+    this->running = false;
+    this->wakeup.notify_all();
+    
+    for (unsigned int i = 0; i < this->workers.size(); ++i)
+      this->workers[i].join();
+    this->workers.clear();
+  }
+  
+  cv::Size image_size() const {
+    std::lock_guard<std::mutex> guard(this->mode_lock);
+    return this->frame_size;
+  }
+  
+  // Rebuilds the rectification maps (if a calibration was loaded) for a
+  // new image size.
+  void prepare_rectifier() {
+    std::shared_ptr<const LI_rectifier> current = 
+      std::atomic_load(&this->rectifier);
+    
+    cv::Size size = this->image_size();
+    if (!current || size == current->image_size())
+      return;
+    
+    std::shared_ptr<LI_rectifier> rectifier(new LI_rectifier(*current));
+    if (!rectifier->prepare(size))
+      this->error = LI_NOT_CALIBRATED;
+    
+    std::atomic_store(&this->rectifier, 
+      std::shared_ptr<const LI_rectifier>(rectifier));
+  }
+  
+  // Sizes both pools so that every queue slot, every worker and the frame
+  // callback can hold a buffer at the same time, plus the frames grabbed
+  // by the application and the one waiting to be. Must not be called while
+  // frames are in flight (grabbed frames do not count, their buffers stay
+  // valid through a reallocation).
+  bool size_pools(int width, int height) {
+    unsigned int capacity = 
+      this->convert_queue.stats().capacity + 
+      this->analyse_queue.stats().capacity + 
+      (unsigned int) this->workers.size() + 1;
+    unsigned int recorded = LI_record_writer::DEPTH;
+    unsigned int grabbed = (0 < this->config.grab_handles) ? 
+      this->config.grab_handles + 1 : 0;
+    
+    return 
+      this->raw_pool.allocate(capacity + recorded, width, height, 1, 2) &&
+      this->frame_pool.allocate(capacity + grabbed, width, height);
+  }
+  
+  // Brings one of a worker's detectors up to date with the face model
+  // (the nested one is left to the eye detector). The XML file is only
+  // parsed again if it was swapped. With no model loaded the frame cannot
+  // be analysed, and the error is left to the caller. Models that failed
+  // to replace loaded ones are reported once.
+  LI_error_t update_detector(LI_detector& detector) {
+    if (detector.update(this->models, false, true))
+      return LI_SUCCESS;
+    
+    if (!detector.ready())
+      return LI_UNABLE_TO_LOAD_MODEL;
+    
+    this->report_failed_models(detector.version());
+    return LI_SUCCESS;
+  }
+  
+  // Reports that the given generation of the models could not be loaded,
+  // unless that was done already.
+  void report_failed_models(unsigned int generation, uint32_t sequence = 0) {
+    if (generation != this->failed_models.exchange(generation))
+      this->report(LI_UNABLE_TO_LOAD_MODEL, sequence);
+  }
+  
+  // Core functionality is provided here: finds the faces of a stereo pair,
+  // records them in the frame and draws them onto both images.
+  //
+  // In LI_DETECT_DUAL mode both images are scanned in full (at the same
+  // time, unless configured otherwise) and the hits are paired up
+  // afterwards. In LI_DETECT_EPIPOLAR mode only the left image is scanned
+  // in full, each of its faces then being looked for in the right image
+  // within its epipolar band only, and at about the same size.
+  //
+  // With tracking enabled, only one frame in every tracking.interval gets
+  // a full scan. On the others the tracked faces are looked for around
+  // where they were last seen in the left image, then matched in the right
+  // one as in epipolar mode.
+  //
+  // With eye detection enabled, the faces found are then scanned for eyes
+  // with the nested cascade (see LI_eye_detector).
+  //
+  // Frames where nothing moved (see LI_motion_gate) are not scanned at
+  // all, they get the faces of the last frame that was.
+  LI_error_t process_frame(LI_stereo_frame& frame) {
+    LI_TRACE_SCOPE("face_detection");
+    
+    worker_context& context = this->contexts[frame.worker];
+    
+    // The faces are copied once per frame analysed and worker, not once
+    // per frame skipped: the worker lends its copy to the frame.
+    if (!frame.motion.changed) {
+      if (!context.faces_lent) {
+        std::shared_ptr<const std::vector<LI_face> > still;
+        {
+          std::lock_guard<std::mutex> guard(this->still_lock);
+          still = this->still_faces;
+        }
+        
+        if (still != context.still_source) {
+          if (still)
+            context.still_faces = *still;
+          else
+            context.still_faces.clear();
+          context.still_source = still;
+        }
+        
+        frame.faces.swap(context.still_faces);
+        context.faces_lent = true;
+      }
+      
+      LI_stereocamera::draw_faces(frame);
+      return LI_SUCCESS;
+    }
+    
+    cv::Mat *eyes[2] = { &frame.left, &frame.right };
+    LI_error_t results[2] = { LI_SUCCESS, LI_SUCCESS };
+    
+    std::chrono::steady_clock::time_point start = 
+      std::chrono::steady_clock::now();
     
-    double scale = 1;
+    LI_operating_point point = this->resolution.current();
+    double scale = point.scale;
     bool tryFlip = false;
+    bool full = this->tracker.plan(frame.info.sequence, context.tracked);
+    bool epipolar = !full || 
+      (LI_DETECT_EPIPOLAR == this->config.detect_mode);
+    
+    if (full)
+      LI_parallel_for(this->config.parallel, &this->eye_pool, epipolar ? 1 : 2, 
+        [&](int eye) {
+          results[eye] = this->detect(*eyes[eye], context, eye, 
+            scale, point.min_size, tryFlip);
+        });
+    else
+      results[0] = this->update_detector(context.detectors[0]);
+    
+    if (epipolar)
+      results[1] = this->update_detector(context.detectors[1]);
+    
+    // Report the first error in eye order, as the serial version did.
+    if (LI_SUCCESS != results[0])
+      return results[0];
+      
+    if (LI_SUCCESS != results[1])
+      return results[1];
+    
+    std::shared_ptr<const LI_rectifier> rectifier = 
+      std::atomic_load(&this->rectifier);
+    
+    frame.faces.clear();
+    
+    if (!full)
+      this->track_faces(frame.left, context, scale);
+    
+    if (epipolar) {
+      for (unsigned int i = 0; i < context.hits[0].size(); ++i) {
+        cv::Rect match;
+        this->match_face(frame.right, context, context.hits[0][i], scale, match);
+        frame.faces.push_back(
+          LI_make_face(context.hits[0][i], match, rectifier.get()));
+      }
+    }
+    else
+      LI_pair_faces(context.hits[0], context.hits[1], frame.right.size(), 
+        this->config.max_disparity, this->config.epipolar_margin, 
+        rectifier.get(), context.used, frame.faces);
     
-    LI_error_t result1 = this->detectAndDraw(left, cascade, nestedCascade, scale, tryFlip);
-    if (LI_SUCCESS != result1)
-      return result1;
+    this->tracker.update(frame.info.sequence, frame.faces, full);
+    
+    this->resolution.record(std::chrono::duration<double, std::micro>(
+      std::chrono::steady_clock::now() - start).count());
+    
+    // The eye scans of all the faces run at the same time, on the threads
+    // helping with the two images. Not finding the model only costs the
+    // eyes, and is reported once.
+    if (this->config.eyes.enabled && !frame.faces.empty()) {
+      LI_TRACE_SCOPE("eyes");
+      
+      if (!this->eye_detector.detect(this->models, this->config.eyes, 
+            frame.left, frame.right, frame.faces, context.eyes, 
+            this->config.parallel, &this->eye_pool))
+        this->report_failed_models(this->models.version(),
+          frame.info.sequence);
+    }
+    
+    // Keep the faces for the frames to come, unless a later frame was
+    // analysed meanwhile by another worker. They are copied outside the
+    // lock, and whichever copy is dropped is freed outside it too.
+    if (this->motion.enabled()) {
+      std::shared_ptr<const std::vector<LI_face> > faces(
+        new std::vector<LI_face>(frame.faces));
+      std::lock_guard<std::mutex> guard(this->still_lock);
       
-    LI_error_t result2 = this->detectAndDraw(right, cascade, nestedCascade, scale, tryFlip);
-    if (LI_SUCCESS != result2)
-      return result2;
+      if (!this->still_started || 
+          (int32_t) (frame.info.sequence - this->still_sequence) >= 0) {
+        this->still_faces.swap(faces);
+        this->still_sequence = frame.info.sequence;
+        this->still_started = true;
+      }
+    }
     
+    LI_stereocamera::draw_faces(frame);
     return LI_SUCCESS;
   }
   
-  LI_error_t detectAndDraw(
-    cv::Mat& img, 
-    cv::CascadeClassifier& cascade,
-    cv::CascadeClassifier& nestedCascade,
-    double scale, bool tryflip)
-  {
-    int i = 0;
-    double t = 0;
-    std::vector<cv::Rect> faces, faces2;
-    const static cv::Scalar colors[] =  {
-      CV_RGB(0,0,255),
-      CV_RGB(0,128,255),
-      CV_RGB(0,255,255),
-      CV_RGB(0,255,0),
-      CV_RGB(255,128,0),
-      CV_RGB(255,255,0),
-      CV_RGB(255,0,0),
-      CV_RGB(255,0,255)
-    };
-    cv::Mat gray, smallImg(cvRound (img.rows/scale), cvRound(img.cols/scale), CV_8UC1);
+  // Tracked faces keep their colour from frame to frame, and their eyes
+  // are drawn in the same colour.
+  static void draw_faces(LI_stereo_frame& frame) {
+    for (unsigned int i = 0; i < frame.faces.size(); ++i) {
+      const LI_face& face = frame.faces[i];
+      unsigned int color = (0 <= face.id) ? (unsigned int) face.id : i;
+      
+      LI_stereocamera::draw(frame.left, face.left, color);
+      LI_stereocamera::draw(frame.right, face.right, color);
+      
+      for (unsigned int j = 0; j < face.left_eyes.size(); ++j)
+        LI_stereocamera::draw(frame.left, face.left_eyes[j], color);
+      for (unsigned int j = 0; j < face.right_eyes.size(); ++j)
+        LI_stereocamera::draw(frame.right, face.right_eyes[j], color);
+    }
+  }
   
-    //cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
-    cv::resize(img, smallImg, smallImg.size(), 0, 0, cv::INTER_LINEAR);
-    cv::equalizeHist(smallImg, smallImg);
+  // Equalised (and, for scales above 1, shrunk) copy of an image as the
+  // cascades want it, written into a buffer reused from frame to frame.
+  static void preprocess(const cv::Mat& img, double scale, cv::Mat& small) {
+    LI_TRACE_SCOPE("preprocess");
+    
+    cv::Size size(cvRound(img.cols/scale), cvRound(img.rows/scale));
+    
+    if (size == img.size())
+      cv::equalizeHist(img, small);
+    else {
+      cv::resize(img, small, size, 0, 0, cv::INTER_LINEAR);
+      cv::equalizeHist(small, small);
+    }
+  }
   
-    t = (double) cvGetTickCount();
+  // Scans a whole image, shrunk by 'scale', for faces of at least min_size
+  // pixels in the shrunk image, leaving them in the worker's hits for that
+  // eye in full resolution coordinates.
+  LI_error_t detect(
+    const cv::Mat& img, 
+    worker_context& context, int eye,
+    double scale, int min_size, bool tryflip)
+  {
+    LI_error_t result = this->update_detector(context.detectors[eye]);
+    if (LI_SUCCESS != result)
+      return result;
+    
+    cv::CascadeClassifier& cascade = context.detectors[eye].cascade;
+    cv::Mat& smallImg = context.small[eye];
+    std::vector<cv::Rect>& faces = context.hits[eye];
+    std::vector<cv::Rect>& faces2 = context.flipped[eye];
+    
+    LI_stereocamera::preprocess(img, scale, smallImg);
+    
+    LI_TRACE_SCOPE("cascade");
     cascade.detectMultiScale(
       smallImg, faces,
       1.1, 2, 0
       //|cv::CASCADE_FIND_BIGGEST_OBJECT
       //|cv::CASCADE_DO_ROUGH_SEARCH
       |cv::CASCADE_SCALE_IMAGE,
-      cv::Size(30, 30));
+      cv::Size(min_size, min_size));
       
     if(tryflip) {
       cv::flip(smallImg, smallImg, 1);
@@ -348,54 +1884,122 @@ class LI_stereocamera {
         //|cv::CASCADE_FIND_BIGGEST_OBJECT
         //|cv::CASCADE_DO_ROUGH_SEARCH
         |cv::CASCADE_SCALE_IMAGE,
-        cv::Size(30, 30));
+        cv::Size(min_size, min_size));
         
       for(std::vector<cv::Rect>::const_iterator r = faces2.begin(); r != faces2.end(); r++)
         faces.push_back(cv::Rect(smallImg.cols - r->x - r->width, r->y, r->width, r->height));
     }
+    
+    for (std::vector<cv::Rect>::iterator r = faces.begin(); r != faces.end(); r++)
+      *r = cv::Rect(cvRound(r->x*scale), cvRound(r->y*scale), 
+        cvRound(r->width*scale), cvRound(r->height*scale));
+    
+    return LI_SUCCESS; 
+  }
+  
+  // Runs the cascade over part of an image only, with the object size
+  // bounded around that of a face expected there, and picks the hit
+  // closest to that face.
+  bool detect_near(
+    const cv::Mat& img, worker_context& context, int eye,
+    const cv::Rect& area, const cv::Rect& face, double scale, cv::Rect& match)
+  {
+    if (area.width < face.width || area.height < face.height)
+      return false;
+    
+    LI_stereocamera::preprocess(img(area), scale, context.small[eye]);
+    
+    std::vector<cv::Rect>& candidates = context.candidates;
+    int width = cvRound(face.width/scale), height = cvRound(face.height/scale);
+    
+    LI_TRACE_SCOPE("cascade_near");
+    context.detectors[eye].cascade.detectMultiScale(
+      context.small[eye], candidates,
+      1.1, 2, 0
+      |cv::CASCADE_SCALE_IMAGE,
+      cv::Size(width * 4 / 5, height * 4 / 5),
+      cv::Size(width * 5 / 4 + 1, height * 5 / 4 + 1));
+    
+    for (std::vector<cv::Rect>::iterator r = candidates.begin(); r != candidates.end(); r++)
+      *r = cv::Rect(area.x + cvRound(r->x*scale), area.y + cvRound(r->y*scale), 
+        cvRound(r->width*scale), cvRound(r->height*scale));
+    
+    int best = LI_closest_face(face, area, candidates, NULL);
+    if (-1 == best)
+      return false;
+    
+    match = candidates[best];
+    return true;
+  }
+  
+  // Looks for a left face in its epipolar band of the right image.
+  bool match_face(
+    const cv::Mat& right, worker_context& context,
+    const cv::Rect& face, double scale, cv::Rect& match)
+  {
+    return this->detect_near(right, context, 1, 
+      LI_epipolar_band(face, right.size(), this->config.max_disparity, 
+        this->config.epipolar_margin), face, scale, match);
+  }
+  
+  // Looks for the tracked faces around where they were last seen in the
+  // left image, leaving those found in the worker's hits for that eye.
+  void track_faces(const cv::Mat& left, worker_context& context, double scale) {
+    std::vector<cv::Rect>& faces = context.hits[0];
+    float margin = this->config.tracking.search_margin;
+    
+    faces.clear();
+    
+    for (unsigned int i = 0; i < context.tracked.size(); ++i) {
+      const cv::Rect& box = context.tracked[i];
+      int dx = cvRound(box.width * margin), dy = cvRound(box.height * margin);
+      cv::Rect area = cv::Rect(box.x - dx, box.y - dy, 
+        box.width + 2 * dx, box.height + 2 * dy) & 
+        cv::Rect(0, 0, left.cols, left.rows);
       
-    t = (double) cvGetTickCount() - t;
-    for(std::vector<cv::Rect>::const_iterator r = faces.begin(); r != faces.end(); r++, i++ ) {
-      cv::Mat smallImgROI;
-      std::vector<cv::Rect> nestedObjects;
-      cv::Point center;
-      cv::Scalar color = colors[i%8];
-      int radius;
-  
-      double aspect_ratio = (double)r->width/r->height;
-      if( 0.75 < aspect_ratio && aspect_ratio < 1.3 ) {
-        center.x = cvRound((r->x + r->width*0.5)*scale);
-        center.y = cvRound((r->y + r->height*0.5)*scale);
-        radius = cvRound((r->width + r->height)*0.25*scale);
-        circle( img, center, radius, color, 3, 8, 0 );
-      }
-      else
-        rectangle(img, cvPoint(cvRound(r->x*scale), cvRound(r->y*scale)),
-          cvPoint(cvRound((r->x + r->width-1)*scale), cvRound((r->y + r->height-1)*scale)),
-          color, 3, 8, 0);
-        
-      //if(nestedCascade.empty())
+      cv::Rect match;
+      if (!this->detect_near(left, context, 0, area, box, scale, match))
         continue;
-        
-      smallImgROI = smallImg(*r);
-      nestedCascade.detectMultiScale(
-        smallImgROI, nestedObjects,
-        1.1, 2, 0
-        //|cv::CASCADE_FIND_BIGGEST_OBJECT
-        //|cv::CASCADE_DO_ROUGH_SEARCH
-        //|cv::CASCADE_DO_CANNY_PRUNING
-        |cv::CASCADE_SCALE_IMAGE,
-        cv::Size(30, 30));
-         
-      for(std::vector<cv::Rect>::const_iterator nr = nestedObjects.begin(); nr != nestedObjects.end(); nr++) {
-        center.x = cvRound((r->x + nr->x + nr->width*0.5)*scale);
-        center.y = cvRound((r->y + nr->y + nr->height*0.5)*scale);
-        radius = cvRound((nr->width + nr->height)*0.25*scale);
-        circle(img, center, radius, color, 3, 8, 0);
-      }
+      
+      // Two tracks closing in on each other may find the same face.
+      bool seen = false;
+      for (unsigned int j = 0; j < faces.size() && !seen; ++j)
+        seen = 2 * (faces[j] & match).area() > match.area();
+      
+      if (!seen)
+        faces.push_back(match);
     }
+  }
+  
+  // Draws a face as a circle, or as a rectangle if it is too far from
+  // square, in one of eight colours.
+  static void draw(cv::Mat& img, const cv::Rect& r, unsigned int i) {
+    const static cv::Scalar colors[] =  {
+      CV_RGB(0,0,255),
+      CV_RGB(0,128,255),
+      CV_RGB(0,255,255),
+      CV_RGB(0,255,0),
+      CV_RGB(255,128,0),
+      CV_RGB(255,255,0),
+      CV_RGB(255,0,0),
+      CV_RGB(255,0,255)
+    };
     
-    return LI_SUCCESS; 
+    if (r.empty())
+      return;
+    
+    cv::Scalar color = colors[i%8];
+    
+    double aspect_ratio = (double)r.width/r.height;
+    if( 0.75 < aspect_ratio && aspect_ratio < 1.3 ) {
+      cv::Point center(cvRound(r.x + r.width*0.5), cvRound(r.y + r.height*0.5));
+      int radius = cvRound((r.width + r.height)*0.25);
+      circle( img, center, radius, color, 3, 8, 0 );
+    }
+    else
+      rectangle(img, cvPoint(r.x, r.y),
+        cvPoint(r.x + r.width-1, r.y + r.height-1),
+        color, 3, 8, 0);
   }
   
   // Those methods get called automatically upon losing and gaining
@@ -434,20 +2038,54 @@ class LI_stereocamera {
     this->usb_device = libusb_get_device(
       uvc_get_libusb_handle(this->uvc_handle));
     
-    // Negotiate an image size and a frame rate
+    // Pick a video mode among those the camera advertises. A camera
+    // advertising none is asked for the requested mode as is.
+    std::vector<LI_video_mode> modes;
+    LI_stereocamera::enumerate_modes(
+      uvc_get_format_descs(this->uvc_handle), modes);
+    
+    LI_video_mode mode;
+    if (!LI_choose_mode(modes, this->config.mode, mode))
+      this->error = LI_UNSUPPORTED_CAMERA_MODE;
+    
+    // Negotiate the image size and the frame rate
     try {
       LI_exception result;
       result = uvc_get_stream_ctrl_format_size(
         this->uvc_handle, 
         &this->uvc_stream,     /* result stored in uvc_stream */
         UVC_FRAME_FORMAT_YUYV, /* YUV 422, aka YUV 4:2:2. try _COMPRESSED */
-        LI_stereocamera::WIDTH, 
-        LI_stereocamera::HEIGHT, 
-        LI_stereocamera::FPS
+        mode.width, 
+        mode.height, 
+        mode.fps()
       );
     } catch (LI_exception *error) {
       this->error = LI_UNSUPPORTED_CAMERA_MODE;
     }
+    
+    // Size the frame buffer pools for the negotiated mode. This only hits
+    // the heap on the first connection (or if the mode ever changes).
+    if (!this->size_pools(mode.width, mode.height))
+      this->error = LI_UNABLE_TO_ALLOCATE_FRAME;
+    
+    {
+      std::lock_guard<std::mutex> guard(this->mode_lock);
+      this->modes.swap(modes);
+      this->mode = mode;
+      this->frame_size = cv::Size(mode.width, mode.height);
+    }
+    this->frame_interval = mode.interval;
+    this->sequence_started = false;
+    
+    // Sequence numbers start over with the stream.
+    this->tracker.reset();
+    this->motion.reset();
+    {
+      std::lock_guard<std::mutex> guard(this->grab_lock);
+      this->grab_started = false;
+    }
+    
+    this->prepare_rectifier();
    
     // Start streaming while registering a frame-processing callback
     // function, note that the callbck function is a static function
@@ -465,14 +2103,27 @@ class LI_stereocamera {
     uvc_set_saturation(this->uvc_handle, 0xFFFF);
   }
   
-  void on_disconnect() {
+  // Frames are accepted again once done, unless 'reopen' is false (on
+  // destruction). libuvc needs the events to be handled meanwhile to stop
+  // the stream.
+  void on_disconnect(bool reopen = true) {
     // Make sure we have a valid library context
     assert(this->usb_context != NULL && this->uvc_context != NULL);
     
     std::cout << "Connection to LI Sereo Camera is lost...\n";
     
-    // Stop streaming, since the camera was unplugged.
-    uvc_stop_streaming(this->uvc_handle);
+    // Turn away the frames still coming and wait for the frame callbacks
+    // under way, then stop streaming, since the camera was unplugged, and
+    // let the workers finish with the frames already in the pipeline.
+    this->awaiting_frame = false;
+    this->accepting = false;
+    while (0 != this->callbacks)
+      std::this_thread::yield();
+    
+    if (NULL != this->uvc_handle)
+      uvc_stop_streaming(this->uvc_handle);
+    this->drain();
+    
     // Reset stream control structure
     std::memset((void*) &this->uvc_stream, 0, sizeof(uvc_stream_ctrl_t));
     
@@ -491,81 +2142,242 @@ class LI_stereocamera {
       uvc_unref_device(this->uvc_device);
       this->uvc_device = NULL;
     }
+    
+    this->accepting = reopen;
   }
   
-  // This function closes and re-establishes the connection to the
-  // Stereo Camera in response to hot plugging/unplugging.
-  void update_connection() {
-    // Make sure we have a valid library context
-    assert(this->usb_context != NULL && this->uvc_context != NULL);
-    
+  // Looks up the libuvc device of a camera: the first device with the
+  // vendor and product IDs of the LI Stereo Camera, and our serial number
+  // if we have one. A libusb device (e.g. one reported by a hotplug event)
+  // restricts the search to the device with its bus number and address,
+  // which must pass the same checks. Returns NULL if there is no such
+  // device, otherwise a device the caller must unref.
+  //
+  // libuvc has no way to wrap a libusb device into a uvc_device_t, so even
+  // a hotplug arrival lists every USB device with uvc_get_device_list(),
+  // which reads the configuration descriptor of each. Only the camera's
+  // own arrivals get here (see init_context()), and the list is only
+  // walked up to the device reported.
+  uvc_device_t* find_device(libusb_device *usb_device) {
     // Obtain a list of all the connected video devices.
     uvc_device_t **uvc_device_list;
     this->error = uvc_get_device_list(this->uvc_context, &uvc_device_list);
     
-    // Find the Leopard Imaging Stereo Camera using its Vendor/Product
-    // ID combination (2a0b:00f5) but no specific serial number (NULL).
-    unsigned int i;
-    bool found = false;
-    for (i = 0; NULL != uvc_device_list[i]; ++i) {
+    uvc_device_t *found = NULL;
+    for (unsigned int i = 0; NULL != uvc_device_list[i] && NULL == found; ++i) {
+      
+      if (NULL != usb_device &&
+          (libusb_get_bus_number(usb_device) != 
+             uvc_get_bus_number(uvc_device_list[i]) ||
+           libusb_get_device_address(usb_device) != 
+             uvc_get_device_address(uvc_device_list[i])))
+        continue;
       
       uvc_device_descriptor *uvc_descriptor = NULL;
       try {
         LI_exception result;
         result = uvc_get_device_descriptor(uvc_device_list[i], &uvc_descriptor);
 
-        if ((uint16_t) 0x2A0B == uvc_descriptor->idVendor &&
-            (uint16_t) 0x00F5 == uvc_descriptor->idProduct)     
-          found = true;
+        if (LI_stereocamera::VENDOR_ID == uvc_descriptor->idVendor &&
+            LI_stereocamera::PRODUCT_ID == uvc_descriptor->idProduct &&
+            (this->serial.empty() || (NULL != uvc_descriptor->serialNumber &&
+              this->serial == uvc_descriptor->serialNumber)))
+          found = uvc_device_list[i];
         
         uvc_free_device_descriptor(uvc_descriptor);
       }
       catch (LI_exception *error) {
       }
-      
-      if (true == found)
-        break;
     }
     
-    // There are two possibilities here which are uninteresting to us,
-    // namely when an LI Stereo camera is found but we are already
-    // connected, and when an LI Stereo camera is not found but we are
-    // also disconnected. In which cases there is basically nothing to
-    // be done so we just deallocate the device list and end the call.
-    if (found == this->connected) {
-      uvc_free_device_list(uvc_device_list, 1 /* unref_devices */ );
-      return;
-    }
+    if (NULL != found)
+      uvc_ref_device(found);
     
-    // If the camera was not found, and we are connected (implicit),
+    uvc_free_device_list(uvc_device_list, 1 /* unref_devices */ );
+    return found;
+  }
+  
+  // Opens a camera and starts streaming from it, timing the delivery of
+  // its first frame from the given time on.
+  void connect(
+    uvc_device_t *uvc_device, std::chrono::steady_clock::time_point time) {
+    
+    {
+      std::lock_guard<std::mutex> guard(this->hotplug_lock);
+      ++this->connection_counters.connections;
+      this->connect_time = time;
+    }
+    this->awaiting_frame = true;
+    
+    this->on_connect(uvc_device);
+    this->connected = true;
+  }
+  
+  // Called by the frame callback on the first frame of a connection.
+  void first_frame() {
+    std::chrono::microseconds latency = 
+      std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - this->connect_time);
+    
+    std::lock_guard<std::mutex> guard(this->hotplug_lock);
+    
+    ++this->connection_counters.first_frames;
+    this->connection_counters.last_latency = latency;
+    this->connection_counters.max_latency = 
+      std::max(this->connection_counters.max_latency, latency);
+  }
+  
+  // This function closes and re-establishes the connection to the
+  // Stereo Camera, scanning for it from scratch. It is only used at
+  // startup, hotplug events go through handle_hotplug().
+  void update_connection() {
+    // Make sure we have a valid library context
+    assert(this->usb_context != NULL && this->uvc_context != NULL);
+    
+    // Find the Leopard Imaging Stereo Camera using its Vendor/Product
+    // ID combination (2a0b:00f5) and our serial number, if any.
+    uvc_device_t *uvc_device = this->find_device(NULL);
+    bool found = (NULL != uvc_device);
+    
+    // There are two possibilities here which are uninteresting to us,
+    // namely when an LI Stereo camera is found but we are already
+    // connected, and when an LI Stereo camera is not found but we are
+    // also disconnected. In which cases there is basically nothing to
+    // be done so we just release the device and end the call.
+    if (found == this->connected) {
+      if (found)
+        uvc_unref_device(uvc_device);
+      return;
+    }
+    
+    // If the camera was not found, and we are connected (implicit),
     // then call OnDisconnect, change connected to false and return.
     if (false == found) {
       // Lost connection to the Stereo Camera
       this->on_disconnect();
       this->connected = false;
-      
-      uvc_free_device_list(uvc_device_list, 1 /* unref_devices */ );
       return;
     }
     
     // Otherwise, the stereo camera is found and we are not connected
-    // to it, so we call OnConnect, change connected to true and return.
-    this->on_connect(uvc_device_list[i]);
-    this->connected = true;
+    // to it, so we connect to it and release our reference (on_connect
+    // takes its own).
+    try {
+      this->connect(uvc_device, std::chrono::steady_clock::now());
+    } catch (LI_exception *error) {
+      uvc_unref_device(uvc_device);
+      throw error;
+    }
+    uvc_unref_device(uvc_device);
+  }
+  
+  // Records a hotplug event for the reconnector thread. The device is
+  // referenced until the event is handled.
+  void post_hotplug(libusb_device *device, bool arrived) {
+    hotplug_event_t event;
+    event.device = (NULL != device) ? libusb_ref_device(device) : NULL;
+    event.arrived = arrived;
+    event.time = std::chrono::steady_clock::now();
+    
+    {
+      std::lock_guard<std::mutex> guard(this->hotplug_lock);
+      this->hotplug_events.push_back(event);
       
-    uvc_free_device_list(uvc_device_list, 1 /* unref_devices */ );
-    return;
+      if (arrived)
+        ++this->connection_counters.arrivals;
+      else
+        ++this->connection_counters.departures;
+    }
+    this->hotplug_wakeup.notify_one();
   }
   
-public:
-  LI_stereocamera() : 
-    usb_context(NULL),
-    uvc_context(NULL),
-    uvc_device(NULL),
-    usb_device(NULL),
-    uvc_handle(NULL),
-    error() {
+  // Handles one hotplug event. Departures compare the device with the
+  // one we are streaming from; arrivals open the device reported, when
+  // not connected already. A NULL device stands for the camera wherever
+  // it is (see simulate_hotplug()).
+  void handle_hotplug(const hotplug_event_t& event) {
+    if (!event.arrived) {
+      if (this->connected && 
+          (NULL == event.device || event.device == this->usb_device)) {
+        this->on_disconnect();
+        this->connected = false;
+      }
+      return;
+    }
+    
+    if (this->connected)
+      return;
+    
+    uvc_device_t *uvc_device = this->find_device(event.device);
+    if (NULL == uvc_device)
+      return;
     
+    try {
+      this->connect(uvc_device, event.time);
+    } catch (LI_exception *error) {
+      uvc_unref_device(uvc_device);
+      throw error;
+    }
+    uvc_unref_device(uvc_device);
+  }
+  
+  void reconnect_loop() {
+    std::unique_lock<std::mutex> guard(this->hotplug_lock);
+    
+    while (this->reconnecting) {
+      if (this->hotplug_events.empty()) {
+        this->hotplug_wakeup.wait(guard);
+        continue;
+      }
+      
+      hotplug_event_t event = this->hotplug_events.front();
+      this->hotplug_events.erase(this->hotplug_events.begin());
+      guard.unlock();
+      
+      // A failed connection is reported and torn down, the camera will
+      // be tried again when it is next plugged in.
+      try {
+        this->handle_hotplug(event);
+      } catch (LI_exception *error) {
+        std::cerr << *error << "\n";
+        this->error.clear();
+        
+        if (!this->connected && NULL != this->uvc_device)
+          this->on_disconnect();
+      }
+      
+      if (NULL != event.device)
+        libusb_unref_device(event.device);
+      
+      guard.lock();
+    }
+  }
+  
+  void start_reconnector() {
+    this->reconnecting = true;
+    this->reconnector = std::thread(&LI_stereocamera::reconnect_loop, this);
+  }
+  
+  // Stops the reconnector thread, dropping the events it did not handle.
+  void stop_reconnector() {
+    {
+      std::lock_guard<std::mutex> guard(this->hotplug_lock);
+      this->reconnecting = false;
+    }
+    this->hotplug_wakeup.notify_all();
+    
+    if (this->reconnector.joinable())
+      this->reconnector.join();
+    
+    for (unsigned int i = 0; i < this->hotplug_events.size(); ++i)
+      if (NULL != this->hotplug_events[i].device)
+        libusb_unref_device(this->hotplug_events[i].device);
+    this->hotplug_events.clear();
+  }
+  
+  // Initializes the libraries and registers for the hotplug events of
+  // the camera, when not sharing the contexts of an LI_camera_manager.
+  void init_context() {
     // Initialize the libusb-1.0 library and set its reporting level to
     // WARNING unless we are compiling for production.
     try {
@@ -578,7 +2390,875 @@ public:
       throw error;
     }
     
-    // Initialize the libuvc library
+    // From here on a failure releases what was initialized so far, as no
+    // destructor will run.
+    try {
+      // Initialize the libuvc library
+      try {
+        this->error = uvc_init(&this->uvc_context, this->usb_context);
+      } catch (LI_exception* error) {
+        this->uvc_context = NULL;
+        throw error;
+      }
+      
+      // Inquire the hotplog capability from the underlying libusb library
+      // (nonzero if the running library has the capability, 0 otherwise)
+      if (0 == libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+        this->error = LI_UNSUPPORTED_PLATFORM;
+      }
+      
+      // Register the hotplug callback for the LI Stereo Camera only, so
+      // that other devices coming and going do not concern us. The handle
+      // (last argument) allows us to refer to this particular callback to
+      // deregister it later.
+      this->error = (libusb_error) libusb_hotplug_register_callback(
+        this->usb_context, 
+        LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT_OR_ARRIVED, 
+        LIBUSB_HOTPLUG_NO_FLAGS, 
+        LI_stereocamera::VENDOR_ID, 
+        LI_stereocamera::PRODUCT_ID,
+        LIBUSB_HOTPLUG_MATCH_ANY, 
+        LI_stereocamera::hotplug_callback,
+        (void*) this /* user_data */, &this->hotplug_handle);
+    } catch (LI_exception* error) {
+      this->exit_context();
+      throw error;
+    }
+  }
+  
+  // Undoes init_context().
+  void exit_context() {
+    this->poller.attach(NULL);
+    
+    // Deinitialize the libuvc library.
+    if (NULL != this->uvc_context) {
+      uvc_exit(this->uvc_context);
+      this->uvc_context = NULL;
+    }
+    
+    // Deinitialize the libusb-1.0 library
+    if (NULL != this->usb_context) {
+      // Deregister the hotplug callback.
+      libusb_hotplug_deregister_callback(this->usb_context, this->hotplug_handle);
+      libusb_exit(this->usb_context);
+      this->usb_context = NULL;
+    }
+  }
+  
+  friend class LI_camera_manager;
+  
+public:
+  LI_stereocamera(const LI_config& config = LI_config()) : 
+    LI_stereocamera(NULL, NULL, "", config) {
+    
+  }
+  
+  // Opens the camera with the given serial number (any LI Stereo Camera
+  // if empty) through library contexts shared with other cameras, whose
+  // owner is then responsible for the hotplug events (see LI_camera_
+  // manager). With NULL contexts the camera initializes its own.
+  LI_stereocamera(
+    libusb_context *usb_context, 
+    uvc_context_t *uvc_context,
+    const std::string& serial,
+    const LI_config& config = LI_config()) : 
+    connected(false),
+    hotplug_handle(0),
+    reconnecting(false),
+    awaiting_frame(false),
+    usb_context(usb_context),
+    uvc_context(uvc_context),
+    owns_context(NULL == usb_context || NULL == uvc_context),
+    serial(serial),
+    usb_device(NULL),
+    uvc_device(NULL),
+    uvc_handle(NULL),
+    config(config),
+    convert_queue(config.queue_depth, config.overflow),
+    analyse_queue(config.queue_depth, config.overflow),
+    running(false),
+    in_flight(0),
+    stages(new std::vector<LI_stage>()),
+    accepting(true),
+    callbacks(0),
+    frame_size(config.mode.width, config.mode.height),
+    frame_interval(0),
+    last_sequence(0),
+    sequence_started(false),
+    received_frames(0),
+    missing_frames(0),
+    sequence_gaps(0),
+    delivered_frames(0),
+    grab_sequence(0),
+    grab_started(false),
+
+    models(config.face_cascade, config.nested_cascade),
+    failed_models(0),
+    tracker(config.tracking),
+    resolution(config.budget),
+    motion(config.motion),
+    still_sequence(0),
+    still_started(false),
+    contexts(std::max(1u, config.workers)),
+    eye_pool(LI_PARALLEL_THREADS == config.parallel ? 
+      config.parallel_threads : 0),
+    error() {
+    
+    if (this->owns_context)
+      this->init_context();
+    
+    // Once the contexts are up, their hotplug callback refers to the
+    // camera: whatever is thrown from here on, close what was opened and
+    // release the contexts, as no destructor will run.
+    try {
+      // Rectification has to come first, the other stages expect
+      // rectified images.
+      if (!this->config.calibration.empty()) {
+        this->load_calibration(
+          this->config.calibration, this->config.calibration_extrinsics);
+        this->add_stage(this->rectify_stage());
+      }
+      
+      // Face detection used to be hard-wired, it is now the default stage.
+      if (this->config.face_detection)
+        this->add_stage(this->face_detection_stage());
+      
+      // Parse the cascade models up front if asked to, rather than on the
+      // first frame analysed by each worker. Without the nested model the
+      // faces can still be found: that failure is only reported.
+      if (this->config.eager_load) {
+        for (unsigned int i = 0; i < this->contexts.size(); ++i)
+          for (int eye = 0; eye < 2; ++eye)
+            if (!this->contexts[i].detectors[eye].update(
+                  this->models, false, true))
+              this->error = LI_UNABLE_TO_LOAD_MODEL;
+        
+        if (this->config.eyes.enabled && 
+            !this->eye_detector.preload(this->models, this->contexts.size()))
+          this->report_failed_models(this->models.version());
+      }
+      
+      // Start the frame pipeline, sized for the requested video mode so
+      // that frames can be pushed through it even before a camera shows
+      // up.
+      this->start_workers();
+      
+      if (!this->size_pools(config.mode.width, config.mode.height))
+        this->error = LI_UNABLE_TO_ALLOCATE_FRAME;
+      
+      this->update_connection();
+    } catch (...) {
+      this->on_disconnect(false);
+      this->stop_workers();
+      if (this->owns_context)
+        this->exit_context();
+      throw;
+    }
+    
+    this->start_reconnector();
+    
+    // The poller of shared contexts is their owner's.
+    if (this->owns_context)
+      this->poller.attach(this->usb_context);
+    if (this->config.event_thread)
+      this->start_event_thread(this->config.events);
+  }
+  
+  ~LI_stereocamera() {
+    
+    // Stop handling hotplug events, then stop streaming and deallocate
+    // devices/handles. The events are still handled meanwhile, libuvc
+    // needs them to stop the stream.
+    this->stop_reconnector();
+    this->on_disconnect(false);
+    this->stop_event_thread();
+    
+    // The recording thread reports its errors through the camera.
+    this->stop_recording();
+    
+    // Stop the (now idle) frame pipeline.
+    this->stop_workers();
+    
+    // Leave shared contexts to their owner.
+    if (this->owns_context)
+      this->exit_context();
+  }
+  
+  // Handles the libusb events once (blocking until there are some), for
+  // applications running the event loop themselves.
+  void main_loop() {
+    libusb_handle_events_completed(this->usb_context, NULL);
+  }
+  
+  // Handles the libusb events on a thread of our own until stop_event_
+  // thread() (or the destruction of the camera). Returns false if it is
+  // already running, or if the contexts are shared (their owner handles
+  // the events then, see LI_camera_manager).
+  bool start_event_thread(const LI_event_config& config = LI_event_config()) {
+    if (!this->owns_context)
+      return false;
+    
+    return this->event_loop.start(this->usb_context, config);
+  }
+  
+  void stop_event_thread() {
+    this->event_loop.stop();
+  }
+  
+  // The event thread, e.g. to check whether its CPU affinity and priority
+  // could be applied.
+  const LI_event_thread& event_thread() const {
+    return this->event_loop;
+  }
+  
+  // The libusb descriptors and timeouts, for applications driving the
+  // events from their own reactor (with no event thread running). The
+  // camera has to be destroyed while the events are still handled. With
+  // shared contexts the poller is left detached, the events are those of
+  // the manager's poller.
+  LI_event_poller& event_poller() {
+    return this->poller;
+  }
+  
+  // Injects a hotplug event as if libusb had reported it, e.g. to exercise
+  // the reconnection without touching the cable. A NULL device stands for
+  // the camera wherever it is: its arrival scans for it, its departure
+  // disconnects from whichever camera is open. The events of devices
+  // other than LI Stereo Cameras are ignored (and not counted).
+  void simulate_hotplug(libusb_device *device, bool arrived) {
+    LI_stereocamera::hotplug_callback(this->usb_context, device, 
+      arrived ? LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED : 
+        LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT, 
+      (void*) this);
+  }
+  
+  LI_connection_stats connection_stats() {
+    std::lock_guard<std::mutex> guard(this->hotplug_lock);
+    return this->connection_counters;
+  }
+  
+  // Feeds a frame through the exact path taken by the frames streamed from
+  // the camera, e.g. synthetic YUYV frames when no camera is attached.
+  void push_frame(uvc_frame_t *frame) {
+    LI_stereocamera::frame_callback(frame, (void*) this);
+  }
+  
+  // Records the raw stream as delivered by the camera (frames pushed with
+  // push_frame() or replayed included) to a file, until stop_recording().
+  // The frames are written by a thread of their own (see LI_record_writer),
+  // those it cannot write or keep up with are reported as LI_UNABLE_TO_
+  // RECORD_FRAME errors.
+  bool start_recording(const std::string& path) {
+    std::shared_ptr<LI_record_writer> recorder(new LI_record_writer());
+    if (!recorder->open(path, [this](uint32_t sequence) {
+          this->report(LI_UNABLE_TO_RECORD_FRAME, sequence);
+        }))
+      return false;
+    
+    std::shared_ptr<LI_record_writer> previous = 
+      std::atomic_exchange(&this->recorder, recorder);
+    if (previous)
+      previous->close();
+    return true;
+  }
+  
+  // Writes the frames still queued and closes the recording, returns false
+  // if it could not be completed or frames were lost.
+  bool stop_recording() {
+    std::shared_ptr<LI_record_writer> recorder = 
+      std::atomic_exchange(&this->recorder, std::shared_ptr<LI_record_writer>());
+    return !recorder || recorder->close();
+  }
+  
+  // Counters of the recording under way (all 0 when not recording).
+  LI_recording_stats recording_stats() const {
+    std::shared_ptr<LI_record_writer> recorder = std::atomic_load(&this->recorder);
+    return recorder ? recorder->stats() : LI_recording_stats();
+  }
+  
+  // Feeds a recording through the frame callback, exactly like frames
+  // streamed from the camera, either at the recorded pace or as fast as
+  // the pipeline takes them (which, with a dropping overflow policy, may
+  // drop frames; LI_BLOCK gives repeatable runs). With no camera
+  // connected the pipeline is first resized for the recording. Only the
+  // 'count' frames from 'first' on are fed if given. Returns the number
+  // of frames fed.
+  size_t replay(const LI_replay& source, bool realtime = true, 
+    size_t first = 0, size_t count = (size_t) -1) {
+    
+    if (first >= source.frames())
+      return 0;
+    
+    size_t last = first + std::min(count, source.frames() - first);
+    
+    LI_record_header header;
+    source.frame(0, header);
+    
+    if (!this->connected && cv::Size(header.width, header.height) != 
+          this->image_size()) {
+      this->drain();
+      if (!this->size_pools(header.width, header.height))
+        this->error = LI_UNABLE_TO_ALLOCATE_FRAME;
+      
+      std::lock_guard<std::mutex> guard(this->mode_lock);
+      this->frame_size = cv::Size(header.width, header.height);
+    }
+    
+    std::chrono::steady_clock::time_point start = 
+      std::chrono::steady_clock::now();
+    
+    source.frame(first, header);
+    int64_t first_offset_us = header.offset_us;
+    
+    for (size_t i = first; i < last; ++i) {
+      const uint8_t *payload = source.frame(i, header);
+      
+      if (realtime)
+        std::this_thread::sleep_until(start + 
+          std::chrono::microseconds(header.offset_us - first_offset_us));
+      
+      uvc_frame_t frame;
+      std::memset(&frame, 0, sizeof(frame));
+      frame.data = (void*) payload;
+      frame.data_bytes = (size_t) header.payload_bytes;
+      frame.width = header.width;
+      frame.height = header.height;
+      frame.frame_format = UVC_FRAME_FORMAT_YUYV;
+      frame.step = header.step;
+      frame.sequence = header.sequence;
+      frame.capture_time.tv_sec = (time_t) (header.capture_us / 1000000);
+      frame.capture_time.tv_usec = (suseconds_t) (header.capture_us % 1000000);
+      
+      this->frame_interval = header.interval;
+      LI_stereocamera::frame_callback(&frame, (void*) this);
+    }
+    
+    return last - first;
+  }
+  
+  // Appends a processing stage to the chain run on every stereo pair, see
+  // LI_stage. This is safe while streaming, frames already being analysed
+  // finish with the previous chain.
+  void add_stage(const LI_stage& stage) {
+    std::lock_guard<std::mutex> guard(this->stages_lock);
+    
+    std::shared_ptr<std::vector<LI_stage> > stages(
+      new std::vector<LI_stage>(*std::atomic_load(&this->stages)));
+    stages->push_back(stage);
+    std::atomic_store(&this->stages, 
+      std::shared_ptr<const std::vector<LI_stage> >(stages));
+  }
+  
+  // Removes all the processing stages, including the default one.
+  void clear_stages() {
+    std::lock_guard<std::mutex> guard(this->stages_lock);
+    
+    std::atomic_store(&this->stages, 
+      std::shared_ptr<const std::vector<LI_stage> >(
+        new std::vector<LI_stage>()));
+  }
+  
+  // The built-in face detection (see process_frame) as a stage, e.g. to
+  // register it again after clear_stages().
+  LI_stage face_detection_stage() {
+    return [this](LI_stereo_frame& frame) {
+      return this->process_frame(frame);
+    };
+  }
+  
+  // An LI_depth_stage sized for this camera's workers. Note that stages
+  // drawing on the images (like the face detection) should come after it.
+  LI_stage depth_stage(const LI_depth_config& config = LI_depth_config()) {
+    return LI_depth_stage(config, (unsigned int) this->workers.size());
+  }
+  
+  // A stage publishing every stereo pair (with its metadata) to the shared
+  // memory ring of the publisher, for other processes to read (see
+  // LI_shm_reader). Stages drawing on the images should come after it.
+  //
+  // With several workers the pairs are published as their workers get to
+  // them, which may not be the order they were captured in: readers
+  // wanting that order go by the sequence numbers (or run a single worker).
+  //
+  // A frame that cannot be published (the ring closed, or made for another
+  // size) does not stop the stages after this one. The failure is reported
+  // once, and again only after a frame was published in between.
+  LI_stage publish_stage(const std::shared_ptr<LI_shm_publisher>& publisher) {
+    std::shared_ptr<std::atomic<bool> > failing(new std::atomic<bool>(false));
+    
+    return [this, publisher, failing](LI_stereo_frame& frame) {
+      LI_TRACE_SCOPE("publish");
+      
+      if (publisher->publish(frame.info,
+            frame.left.data, frame.left.step,
+            frame.right.data, frame.right.step,
+            frame.left.cols, frame.left.rows))
+        failing->store(false, std::memory_order_relaxed);
+      else if (!failing->exchange(true))
+        this->report(LI_UNABLE_TO_PUBLISH_FRAME, frame.info.sequence);
+      
+      return LI_SUCCESS;
+    };
+  }
+  
+  // Loads a stereo calibration (see LI_rectifier) and builds its fixed-point
+  // rectification maps for the current image size. This is safe while
+  // streaming, frames being rectified finish with the previous maps.
+  void load_calibration(
+    const std::string& path, const std::string& extrinsics = "") {
+    
+    std::shared_ptr<LI_rectifier> rectifier(new LI_rectifier());
+    if (!rectifier->load(path, extrinsics) || 
+        !rectifier->prepare(this->image_size()))
+      this->error = LI_NOT_CALIBRATED;
+    
+    std::atomic_store(&this->rectifier, 
+      std::shared_ptr<const LI_rectifier>(rectifier));
+  }
+  
+  // A stage rectifying both images (concurrently, like the eyes are
+  // analysed) into per-worker buffers, and pointing the frame at them.
+  LI_stage rectify_stage() {
+    return [this](LI_stereo_frame& frame) {
+      std::shared_ptr<const LI_rectifier> rectifier = 
+        std::atomic_load(&this->rectifier);
+      
+      if (!rectifier || !rectifier->ready() ||
+          rectifier->image_size() != frame.left.size())
+        return LI_NOT_CALIBRATED;
+      
+      LI_TRACE_SCOPE("rectify");
+      
+      cv::Mat *images[2] = { &frame.left, &frame.right };
+      cv::Mat *rectified = this->contexts[frame.worker].rectified;
+      
+      LI_parallel_for(this->config.parallel, &this->eye_pool, 2, 
+        [&](int eye) {
+          rectifier->remap(eye, *images[eye], rectified[eye]);
+        });
+      
+      frame.left = rectified[0];
+      frame.right = rectified[1];
+      return LI_SUCCESS;
+    };
+  }
+  
+  // Swaps the cascade models while streaming. Every worker reloads them
+  // before its next frame, keeping the previous models if that fails (an
+  // LI_UNABLE_TO_LOAD_MODEL error is then reported, once).
+  void set_cascades(const std::string& face, const std::string& nested) {
+    this->models.set(face, nested);
+  }
+  
+  // The video modes advertised by the camera last connected, and the one
+  // negotiated with it (with a zero frame interval until then).
+  std::vector<LI_video_mode> video_modes() const {
+    std::lock_guard<std::mutex> guard(this->mode_lock);
+    return this->modes;
+  }
+  
+  LI_video_mode video_mode() const {
+    std::lock_guard<std::mutex> guard(this->mode_lock);
+    return this->mode;
+  }
+  
+  // Lists the video modes of the format descriptors of a device (see
+  // uvc_get_format_descs()): every frame size of every format, with each
+  // of the frame intervals offered for it (the shortest, the default and
+  // the longest for continuously variable intervals).
+  static void enumerate_modes(
+    const uvc_format_desc_t *formats, std::vector<LI_video_mode>& modes) {
+    
+    modes.clear();
+    
+    for (const uvc_format_desc_t *format = formats; 
+         NULL != format; format = format->next) {
+      uint32_t fourcc = LI_FOURCC(format->fourccFormat[0], 
+        format->fourccFormat[1], format->fourccFormat[2], 
+        format->fourccFormat[3]);
+      
+      for (const uvc_frame_desc_t *frame = format->frame_descs; 
+           NULL != frame; frame = frame->next) {
+        if (0 != frame->bFrameIntervalType && NULL != frame->intervals) {
+          for (const uint32_t *interval = frame->intervals; 
+               0 != *interval; ++interval)
+            modes.push_back(LI_video_mode(fourcc, 
+              frame->wWidth, frame->wHeight, *interval));
+        }
+        else {
+          uint32_t intervals[3] = { frame->dwMinFrameInterval, 
+            frame->dwDefaultFrameInterval, frame->dwMaxFrameInterval };
+          
+          for (int i = 0; i < 3; ++i)
+            if (0 != intervals[i] && (0 == i || intervals[i] != intervals[i - 1]))
+              modes.push_back(LI_video_mode(fourcc, 
+                frame->wWidth, frame->wHeight, intervals[i]));
+        }
+      }
+    }
+  }
+  
+  // Counters of the queue feeding the given pipeline stage.
+  LI_queue_stats queue_stats(LI_stage_t stage) const {
+    return (LI_STAGE_CONVERT == stage) ?
+      this->convert_queue.stats() : this->analyse_queue.stats();
+  }
+  
+  // Counters of the buffer pool feeding the given pipeline stage: the raw
+  // frames for the conversion, the stereo pairs for the analysis.
+  LI_pool_stats pool_stats(LI_stage_t stage) const {
+    return (LI_STAGE_CONVERT == stage) ?
+      this->raw_pool.stats() : this->frame_pool.stats();
+  }
+  
+  // Number of frames dropped, either because every pooled buffer was in
+  // use or because of the queues' overflow policy.
+  unsigned long long dropped_frames() const {
+    return 
+      this->raw_pool.exhausted_count() + 
+      this->frame_pool.exhausted_count() +
+      this->convert_queue.stats().dropped + 
+      this->analyse_queue.stats().dropped;
+  }
+  
+  // Takes the latest frame through the stages, waiting up to 'timeout' for
+  // one if none came since the last grab. Frames are not queued: one not
+  // grabbed before the next is through is overwritten. The images are
+  // those the stages left, with the faces drawn: the rectified ones if the
+  // frame was rectified, the pooled buffer otherwise. Returns false, with
+  // 'frame' emptied, on timeout or if grab_handles is 0.
+  bool grab(LI_frame_handle& frame, std::chrono::milliseconds timeout) {
+    LI_frame_ref taken;
+    cv::Mat images[2];
+    
+    if (0 < this->config.grab_handles) {
+      std::unique_lock<std::mutex> lock(this->grab_lock);
+      
+      this->grab_wakeup.wait_for(lock, timeout, [this] { 
+        return (bool) this->grab_slot; 
+      });
+      
+      taken.swap(this->grab_slot);
+      if (taken)
+        ++this->grab_counters.grabbed;
+      
+      for (int eye = 0; eye < 2; ++eye)
+        cv::swap(images[eye], this->grab_images[eye]);
+    }
+    
+    frame.assign(std::move(taken));
+    
+    if (!frame.empty()) {
+      if (!images[0].empty())
+        frame.left = images[0];
+      if (!images[1].empty())
+        frame.right = images[1];
+    }
+    
+    return !frame.empty();
+  }
+  
+  // The same without waiting.
+  bool try_grab(LI_frame_handle& frame) {
+    return this->grab(frame, std::chrono::milliseconds(0));
+  }
+  
+  LI_grab_stats grab_stats() const {
+    std::lock_guard<std::mutex> guard(this->grab_lock);
+    return this->grab_counters;
+  }
+  
+  // Frame counters and latency histograms since construction (or the
+  // last reset_frame_stats()).
+  LI_frame_stats frame_stats() const {
+    LI_frame_stats stats;
+    
+    stats.received = this->received_frames;
+    stats.missing = this->missing_frames;
+    stats.gaps = this->sequence_gaps;
+    stats.dropped = this->dropped_frames();
+    stats.delivered = this->delivered_frames;
+    stats.capture = this->capture_latency.snapshot();
+    stats.queueing = this->queueing_latency.snapshot();
+    stats.processing = this->processing_latency.snapshot();
+    stats.delivery = this->delivery_latency.snapshot();
+    
+    return stats;
+  }
+  
+  // Resets the counters of frame_stats(), except for the dropped frames
+  // which are counted by the pools and the queues.
+  void reset_frame_stats() {
+    this->received_frames = 0;
+    this->missing_frames = 0;
+    this->sequence_gaps = 0;
+    this->delivered_frames = 0;
+    this->capture_latency.reset();
+    this->queueing_latency.reset();
+    this->processing_latency.reset();
+    this->delivery_latency.reset();
+  }
+  
+  // Errors raised while streaming (each skipping the frame it hit) since
+  // construction or the last reset_error_stats(). See LI_error_channel.
+  LI_error_stats error_stats() const {
+    return this->errors.snapshot();
+  }
+  
+  void reset_error_stats() {
+    this->errors.reset();
+  }
+  
+  // Calls the listener with every error raised while streaming, on the
+  // thread raising it. Returns an identifier for unsubscribe_errors().
+  unsigned int subscribe_errors(const LI_error_listener& listener) {
+    return this->errors.subscribe(listener);
+  }
+  
+  void unsubscribe_errors(unsigned int id) {
+    this->errors.unsubscribe(id);
+  }
+  
+  // The operating point of the face detection and the decisions taken to
+  // keep it within its time budget.
+  LI_budget_stats detection_budget() const {
+    return this->resolution.snapshot();
+  }
+  
+  // Changes the time budget of the face detection while streaming, which
+  // starts over from full resolution.
+  void set_detection_budget(const LI_budget_config& budget) {
+    this->resolution.configure(budget);
+  }
+  
+  // How many frames were skipped for nothing having moved in them, and
+  // the threshold that was applied.
+  LI_motion_stats motion_stats() const {
+    return this->motion.snapshot();
+  }
+  
+  // Changes the motion gating while streaming (a threshold of 0 turns it
+  // off), the next frame being analysed in any case.
+  void set_motion_gating(const LI_motion_config& motion) {
+    this->motion.configure(motion);
+  }
+  
+  bool is_connected() const {
+    return this->connected;
+  }
+  
+  // The serial number the camera was opened by (empty for any camera).
+  const std::string& serial_number() const {
+    return this->serial;
+  }
+};
+
+// Per-camera counters, see LI_camera_manager::stats().
+struct LI_camera_stats {
+  std::string serial;
+  bool connected;
+  
+  // Frames through the analysis stage, frames dropped on the way, errors
+  // raised while streaming, and frames not analysed for nothing having
+  // moved in them.
+  unsigned long long frames;
+  unsigned long long dropped;
+  unsigned long long errors;
+  unsigned long long skipped;
+  
+  LI_camera_stats() :
+    connected(false),
+    frames(0),
+    dropped(0),
+    errors(0),
+    skipped(0) {
+    
+  }
+};
+
+/*
+ * Manager of several LI Stereo Cameras
+ *
+ * Opens every LI Stereo Camera plugged in, each as an LI_stereocamera of
+ * its own (with its own pipeline, pools and workers) keyed by its serial
+ * number. All of them share one libusb/libuvc context, and so the single
+ * event loop run by main_loop(), and one hotplug callback. Cameras without
+ * a serial number cannot be told apart and are left alone (an
+ * LI_stereocamera of their own, with an empty serial, opens any of them).
+ *
+ * Hotplug events go to a dispatcher thread, which reads the serial number
+ * of arriving devices (which takes opening them, not something to do from
+ * the callback) and hands the event to the reconnector of that camera,
+ * creating it on its first arrival. Departures go to whichever camera
+ * streams from the departing device. Cameras are kept once created, so a
+ * camera plugged back in finds its pipeline and stages as it left them.
+ */
+class LI_camera_manager {
+  typedef std::map<std::string, std::unique_ptr<LI_stereocamera> > camera_map;
+  
+  libusb_context *usb_context;
+  uvc_context_t *uvc_context;
+  libusb_hotplug_callback_handle hotplug_handle;
+  
+  LI_config config;
+  
+  camera_map cameras;
+  mutable std::mutex cameras_lock;
+  
+  // Hotplug events waiting for the dispatcher. Arriving devices are
+  // referenced until dispatched.
+  std::vector<std::pair<libusb_device*, bool> > events;
+  std::mutex events_lock;
+  std::condition_variable events_wakeup;
+  std::thread dispatcher;
+  bool dispatching;
+  
+  // The events of the shared context, see LI_stereocamera::event_loop.
+  LI_event_thread event_loop;
+  LI_event_poller poller;
+  
+  LI_exception error;
+  
+  static int hotplug_callback(
+    libusb_context *context, 
+    libusb_device *device,
+    libusb_hotplug_event event, 
+    void *user_data) {
+    
+    LI_camera_manager *self = (LI_camera_manager*) user_data;
+    
+    {
+      std::lock_guard<std::mutex> guard(self->events_lock);
+      self->events.push_back(std::make_pair(libusb_ref_device(device), 
+        LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED == event));
+    }
+    self->events_wakeup.notify_one();
+    
+    return 0;
+  }
+  
+  // Reads the serial number of an LI Stereo Camera, given either its
+  // libuvc device or its libusb device. Returns false for other devices,
+  // and for cameras without a serial number.
+  bool read_serial(
+    uvc_device_t *uvc_device, libusb_device *usb_device, std::string& serial) {
+    
+    if (NULL == uvc_device) {
+      uvc_device_t **uvc_device_list;
+      if (UVC_SUCCESS != uvc_get_device_list(this->uvc_context, &uvc_device_list))
+        return false;
+      
+      bool found = false;
+      for (unsigned int i = 0; NULL != uvc_device_list[i] && !found; ++i)
+        if (libusb_get_bus_number(usb_device) == 
+              uvc_get_bus_number(uvc_device_list[i]) &&
+            libusb_get_device_address(usb_device) == 
+              uvc_get_device_address(uvc_device_list[i]))
+          found = this->read_serial(uvc_device_list[i], NULL, serial);
+      
+      uvc_free_device_list(uvc_device_list, 1 /* unref_devices */ );
+      return found;
+    }
+    
+    uvc_device_descriptor *uvc_descriptor = NULL;
+    if (UVC_SUCCESS != uvc_get_device_descriptor(uvc_device, &uvc_descriptor))
+      return false;
+    
+    bool match = LI_camera_manager::camera_serial(uvc_descriptor, serial);
+    
+    uvc_free_device_descriptor(uvc_descriptor);
+    return match;
+  }
+  
+  // The camera with the given serial number, created (and connected if
+  // plugged in) if there is none yet. Returns NULL if it cannot be.
+  LI_stereocamera* open(const std::string& serial) {
+    // An empty serial number would open any camera.
+    if (serial.empty())
+      return NULL;
+    
+    std::lock_guard<std::mutex> guard(this->cameras_lock);
+    
+    camera_map::iterator camera = this->cameras.find(serial);
+    if (this->cameras.end() != camera)
+      return camera->second.get();
+    
+    try {
+      std::unique_ptr<LI_stereocamera> created(new LI_stereocamera(
+        this->usb_context, this->uvc_context, serial, this->config));
+      return (this->cameras[serial] = std::move(created)).get();
+    } catch (LI_exception* error) {
+      // The exception lives in the camera that failed to construct.
+      std::cerr << "[LISTEREO] Unable to open camera " << serial << "\n";
+      return NULL;
+    }
+  }
+  
+  void dispatch(libusb_device *device, bool arrived) {
+    if (!arrived) {
+      std::lock_guard<std::mutex> guard(this->cameras_lock);
+      
+      for (camera_map::iterator camera = this->cameras.begin(); 
+           this->cameras.end() != camera; ++camera)
+        if (device == camera->second->usb_device)
+          camera->second->post_hotplug(device, false);
+      return;
+    }
+    
+    std::string serial;
+    if (!this->read_serial(NULL, device, serial))
+      return;
+    
+    // A camera seen for the first time connects as it is created.
+    bool known;
+    {
+      std::lock_guard<std::mutex> guard(this->cameras_lock);
+      known = (this->cameras.end() != this->cameras.find(serial));
+    }
+    
+    LI_stereocamera *camera = this->open(serial);
+    if (known && NULL != camera)
+      camera->post_hotplug(device, true);
+  }
+  
+  void dispatch_loop() {
+    std::unique_lock<std::mutex> guard(this->events_lock);
+    
+    while (this->dispatching) {
+      if (this->events.empty()) {
+        this->events_wakeup.wait(guard);
+        continue;
+      }
+      
+      std::pair<libusb_device*, bool> event = this->events.front();
+      this->events.erase(this->events.begin());
+      guard.unlock();
+      
+      this->dispatch(event.first, event.second);
+      libusb_unref_device(event.first);
+      
+      guard.lock();
+    }
+  }
+  
+public:
+  // Initializes the shared contexts and opens every LI Stereo Camera
+  // plugged in, each with the given settings.
+  explicit LI_camera_manager(const LI_config& config = LI_config()) :
+    usb_context(NULL),
+    uvc_context(NULL),
+    hotplug_handle(0),
+    config(config),
+    dispatching(false),
+    error() {
+    
+    try {
+      this->error = (libusb_error) libusb_init(&this->usb_context);
+    } catch (LI_exception* error) {
+      this->usb_context = NULL;
+      throw error;
+    }
+    
     try {
       this->error = uvc_init(&this->uvc_context, this->usb_context);
     } catch (LI_exception* error) {
@@ -586,54 +3266,155 @@ public:
       throw error;
     }
     
-    // Inquire the hotplog capability from the underlying libusb library
-    // (nonzero if the running library has the capability, 0 otherwise)
     if (0 == libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
       this->error = LI_UNSUPPORTED_PLATFORM;
     }
     
-    // Register the hotplug callback, note that we are passing NULL in
-    // place of the libusb context (which is different from the libuvc
-    // context) and NULL in place of the handler (last argument), which
-    // is simply an integer that allows us to refer to this particular
-    // callback to deregister it later.
     this->error = (libusb_error) libusb_hotplug_register_callback(
       this->usb_context, 
       LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT_OR_ARRIVED, 
       LIBUSB_HOTPLUG_NO_FLAGS, 
+      LI_stereocamera::VENDOR_ID, 
+      LI_stereocamera::PRODUCT_ID,
       LIBUSB_HOTPLUG_MATCH_ANY, 
-      LIBUSB_HOTPLUG_MATCH_ANY,
-      LIBUSB_HOTPLUG_MATCH_ANY, 
-      LI_stereocamera::hotplug_callback,
-      (void*) this /* user_data */, NULL /* handle */);
+      LI_camera_manager::hotplug_callback,
+      (void*) this /* user_data */, &this->hotplug_handle);
+    
+    // Open the cameras already plugged in.
+    uvc_device_t **uvc_device_list;
+    this->error = uvc_get_device_list(this->uvc_context, &uvc_device_list);
     
-    this->update_connection();
+    std::vector<std::string> serials;
+    for (unsigned int i = 0; NULL != uvc_device_list[i]; ++i) {
+      std::string serial;
+      if (this->read_serial(uvc_device_list[i], NULL, serial))
+        serials.push_back(serial);
+    }
+    uvc_free_device_list(uvc_device_list, 1 /* unref_devices */ );
+    
+    for (unsigned int i = 0; i < serials.size(); ++i)
+      this->open(serials[i]);
+    
+    this->dispatching = true;
+    this->dispatcher = std::thread(&LI_camera_manager::dispatch_loop, this);
+    
+    this->poller.attach(this->usb_context);
+    if (this->config.event_thread)
+      this->event_loop.start(this->usb_context, this->config.events);
   }
   
-  ~LI_stereocamera() {
+  ~LI_camera_manager() {
+    {
+      std::lock_guard<std::mutex> guard(this->events_lock);
+      this->dispatching = false;
+    }
+    this->events_wakeup.notify_all();
     
-    // Stop streaming and deallocate devices/handles.
-    this->on_disconnect();
+    if (this->dispatcher.joinable())
+      this->dispatcher.join();
     
-    // Deinitialize the libuvc library.
-    if (NULL != this->uvc_context) {
+    // The cameras go before the contexts they use, and before the event
+    // thread which they need to stop streaming.
+    this->cameras.clear();
+    this->event_loop.stop();
+    this->poller.attach(NULL);
+    
+    for (unsigned int i = 0; i < this->events.size(); ++i)
+      libusb_unref_device(this->events[i].first);
+    
+    if (NULL != this->uvc_context)
       uvc_exit(this->uvc_context);
-    }
     
-    // Deinitialize the libusb-1.0 library
     if (NULL != this->usb_context) {
-      // Deregister the hotplug callback. Note that we are passing a 
-      // callback handle of 0 (second argument) since we did not use a 
-      // "handle" to register our callback (last argument of libusb_
-      // hotplug_register_callback).
-      libusb_hotplug_deregister_callback(this->usb_context, 0);
+      libusb_hotplug_deregister_callback(this->usb_context, this->hotplug_handle);
       libusb_exit(this->usb_context);
     }
   }
   
+  LI_camera_manager(const LI_camera_manager&) = delete;
+  LI_camera_manager& operator=(const LI_camera_manager&) = delete;
+  
+  // The serial number of the device described, if it is an LI Stereo
+  // Camera with one. Returns false otherwise (a camera reporting an empty
+  // serial number or none could not be told from another).
+  static bool camera_serial(
+    const uvc_device_descriptor *descriptor, std::string& serial) {
+    
+    serial = (NULL != descriptor->serialNumber) ? descriptor->serialNumber : "";
+    
+    return LI_stereocamera::VENDOR_ID == descriptor->idVendor &&
+      LI_stereocamera::PRODUCT_ID == descriptor->idProduct &&
+      !serial.empty();
+  }
+  
+  // Runs the event loop shared by all the cameras.
   void main_loop() {
     libusb_handle_events_completed(this->usb_context, NULL);
   }
+  
+  // The event thread and the poller of the shared context, as those of
+  // LI_stereocamera.
+  bool start_event_thread(const LI_event_config& config = LI_event_config()) {
+    return this->event_loop.start(this->usb_context, config);
+  }
+  
+  void stop_event_thread() {
+    this->event_loop.stop();
+  }
+  
+  const LI_event_thread& event_thread() const {
+    return this->event_loop;
+  }
+  
+  LI_event_poller& event_poller() {
+    return this->poller;
+  }
+  
+  // The camera with the given serial number, or NULL if it was never
+  // plugged in.
+  LI_stereocamera* camera(const std::string& serial) const {
+    std::lock_guard<std::mutex> guard(this->cameras_lock);
+    
+    camera_map::const_iterator camera = this->cameras.find(serial);
+    return (this->cameras.end() != camera) ? camera->second.get() : NULL;
+  }
+  
+  // Adds a camera by serial number ahead of its arrival, e.g. to register
+  // its stages beforehand, or to feed it synthetic frames through
+  // push_frame() with no hardware at all. Returns NULL for an empty serial
+  // number.
+  LI_stereocamera* add_camera(const std::string& serial) {
+    return this->open(serial);
+  }
+  
+  std::vector<std::string> serials() const {
+    std::lock_guard<std::mutex> guard(this->cameras_lock);
+    
+    std::vector<std::string> serials;
+    for (camera_map::const_iterator camera = this->cameras.begin(); 
+         this->cameras.end() != camera; ++camera)
+      serials.push_back(camera->first);
+    return serials;
+  }
+  
+  // Counters of every camera. Their sum is the aggregate throughput.
+  std::vector<LI_camera_stats> stats() const {
+    std::lock_guard<std::mutex> guard(this->cameras_lock);
+    
+    std::vector<LI_camera_stats> stats;
+    for (camera_map::const_iterator camera = this->cameras.begin(); 
+         this->cameras.end() != camera; ++camera) {
+      LI_camera_stats entry;
+      entry.serial = camera->first;
+      entry.connected = camera->second->is_connected();
+      entry.frames = camera->second->queue_stats(LI_STAGE_ANALYSE).popped;
+      entry.dropped = camera->second->dropped_frames();
+      entry.errors = camera->second->error_stats().total;
+      entry.skipped = camera->second->motion_stats().skipped;
+      stats.push_back(entry);
+    }
+    return stats;
+  }
 };
 
 #endif
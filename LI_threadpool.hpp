@@ -0,0 +1,216 @@
+#ifndef LI_THREADPOOL_H
+#define LI_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+// How independent pieces of work within a frame (e.g. the two eyes) are
+// spread over the cores.
+enum LI_parallel_t {
+  LI_PARALLEL_NONE = 0,     /* one after the other, on the calling thread */
+  LI_PARALLEL_THREADS = 1,  /* on an LI_threadpool */
+  LI_PARALLEL_OPENCV = 2    /* with cv::parallel_for_ */
+};
+
+/*
+ * Fork-join thread pool
+ *
+ * run() splits a loop of 'count' iterations between the calling thread and
+ * the idle pool threads, and returns once every iteration is done. Any
+ * number of threads may call run() at the same time, and since the caller
+ * always takes part a batch completes even if all the pool threads are
+ * busy elsewhere. Batches live on the caller's stack, so no allocation
+ * takes place. The first exception thrown by an iteration is rethrown by
+ * run() once the batch is over.
+ */
+class LI_threadpool {
+  struct batch_t {
+    void (*invoke)(const void *body, int index);
+    const void *body;
+    int count;
+    std::atomic<int> next;
+
+    // Number of pool threads working on the batch, and the links of the
+    // list of open batches. All guarded by LI_threadpool::lock.
+    int helpers;
+    batch_t *prev, *link;
+
+    std::exception_ptr failure;
+    std::mutex failure_lock;
+  };
+
+  std::mutex lock;
+  std::condition_variable wakeup;
+  std::condition_variable finished;
+
+  batch_t *open;
+  bool stopping;
+
+  std::vector<std::thread> threads;
+
+  template <typename Body>
+  static void invoke(const void *body, int index) {
+    (*(const Body*) body)(index);
+  }
+
+  static void work(batch_t *batch) {
+    int index;
+
+    while ((index = batch->next++) < batch->count) {
+      try {
+        batch->invoke(batch->body, index);
+      } catch (...) {
+        std::lock_guard<std::mutex> guard(batch->failure_lock);
+        if (!batch->failure)
+          batch->failure = std::current_exception();
+      }
+    }
+  }
+
+  void thread_loop() {
+    std::unique_lock<std::mutex> guard(this->lock);
+
+    while (!this->stopping) {
+      batch_t *batch = this->open;
+      while (NULL != batch && batch->next.load() >= batch->count)
+        batch = batch->link;
+
+      if (NULL == batch) {
+        this->wakeup.wait(guard);
+        continue;
+      }
+
+      ++batch->helpers;
+      guard.unlock();
+
+      LI_threadpool::work(batch);
+
+      guard.lock();
+      if (0 == --batch->helpers)
+        this->finished.notify_all();
+    }
+  }
+
+public:
+  explicit LI_threadpool(unsigned int size) :
+    open(NULL),
+    stopping(false) {
+
+    for (unsigned int i = 0; i < size; ++i)
+      this->threads.push_back(
+        std::thread(&LI_threadpool::thread_loop, this));
+  }
+
+  ~LI_threadpool() {
+    {
+      std::lock_guard<std::mutex> guard(this->lock);
+      this->stopping = true;
+    }
+    this->wakeup.notify_all();
+
+    for (unsigned int i = 0; i < this->threads.size(); ++i)
+      this->threads[i].join();
+  }
+
+  LI_threadpool(const LI_threadpool&) = delete;
+  LI_threadpool& operator=(const LI_threadpool&) = delete;
+
+  unsigned int size() const {
+    return (unsigned int) this->threads.size();
+  }
+
+  // Calls body(i) for every i in [0, count).
+  template <typename Body>
+  void run(int count, const Body& body) {
+    if (count <= 1 || this->threads.empty()) {
+      for (int i = 0; i < count; ++i)
+        body(i);
+      return;
+    }
+
+    batch_t batch;
+    batch.invoke = &LI_threadpool::invoke<Body>;
+    batch.body = (const void*) &body;
+    batch.count = count;
+    batch.next = 0;
+    batch.helpers = 0;
+    batch.prev = NULL;
+
+    {
+      std::lock_guard<std::mutex> guard(this->lock);
+
+      batch.link = this->open;
+      if (NULL != this->open)
+        this->open->prev = &batch;
+      this->open = &batch;
+    }
+    this->wakeup.notify_all();
+
+    LI_threadpool::work(&batch);
+
+    // Unlink the batch so that no more threads join it, then wait for
+    // those which did to finish their iteration.
+    {
+      std::unique_lock<std::mutex> guard(this->lock);
+
+      if (NULL != batch.prev)
+        batch.prev->link = batch.link;
+      else
+        this->open = batch.link;
+      if (NULL != batch.link)
+        batch.link->prev = batch.prev;
+
+      this->finished.wait(guard, [&batch] { return 0 == batch.helpers; });
+    }
+
+    if (batch.failure)
+      std::rethrow_exception(batch.failure);
+  }
+};
+
+// Adapts a body taking an index to cv::parallel_for_.
+template <typename Body>
+class LI_parallel_body : public cv::ParallelLoopBody {
+  const Body& body;
+
+public:
+  explicit LI_parallel_body(const Body& body) : body(body) {
+
+  }
+
+  void operator()(const cv::Range& range) const {
+    for (int i = range.start; i < range.end; ++i)
+      this->body(i);
+  }
+};
+
+// Runs body(i) for every i in [0, count) with the given backend. The pool
+// is only used by LI_PARALLEL_THREADS and may be NULL otherwise.
+template <typename Body>
+void LI_parallel_for(
+  LI_parallel_t backend, LI_threadpool *pool, int count, const Body& body) {
+
+  switch (backend) {
+    case LI_PARALLEL_THREADS:
+      if (NULL != pool) {
+        pool->run(count, body);
+        break;
+      }
+      /* no pool, fall through */
+    case LI_PARALLEL_NONE:
+      for (int i = 0; i < count; ++i)
+        body(i);
+      break;
+    case LI_PARALLEL_OPENCV:
+      cv::parallel_for_(cv::Range(0, count), LI_parallel_body<Body>(body));
+      break;
+  }
+}
+
+#endif
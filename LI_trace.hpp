@@ -0,0 +1,286 @@
+#ifndef LI_TRACE_H
+#define LI_TRACE_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "LI_stats.hpp"
+
+/*
+ * Tracing of the frame path
+ *
+ * LI_TRACE_SCOPE("name") times the rest of the enclosing block as a span
+ * of the stage of that name. Spans go into a ring buffer of the thread
+ * (written by that thread only, with no lock) and into a latency histogram
+ * of the stage. LI_tracer::instance() then writes the spans still in the
+ * buffers as a Chrome trace (chrome://tracing, Perfetto) and the
+ * histograms as text metrics.
+ *
+ * Tracing is compiled in by defining LI_ENABLE_TRACING. Otherwise the
+ * macros expand to nothing and the frame path is left exactly as it was.
+ */
+
+// Spans kept per thread (the oldest being overwritten), and the most
+// stages that can be told apart.
+#define LI_TRACE_EVENTS 4096
+#define LI_TRACE_STAGES 64
+
+class LI_tracer {
+  // A span packed in two words, written with relaxed atomics so that a
+  // dump may read them while the thread goes on: its start, and its
+  // duration (48 bits, in nanoseconds) with the stage (16 bits).
+  struct event_t {
+    std::atomic<uint64_t> start_ns;
+    std::atomic<uint64_t> duration_stage;
+  };
+
+  struct thread_buffer {
+    unsigned int tid;
+    std::atomic<uint64_t> head;
+    event_t events[LI_TRACE_EVENTS];
+
+    explicit thread_buffer(unsigned int tid) :
+      tid(tid),
+      head(0) {
+
+    }
+  };
+
+  std::mutex lock;
+  std::vector<std::unique_ptr<thread_buffer> > buffers;
+
+  std::string names[LI_TRACE_STAGES];
+  std::atomic<unsigned int> stages;
+  LI_histogram histograms[LI_TRACE_STAGES];
+
+  std::chrono::steady_clock::time_point origin;
+
+  LI_tracer() :
+    stages(0),
+    origin(std::chrono::steady_clock::now()) {
+
+  }
+
+  // The buffer of the calling thread, created on its first span.
+  thread_buffer& buffer() {
+    static thread_local thread_buffer *buffer = NULL;
+
+    if (NULL == buffer) {
+      std::lock_guard<std::mutex> guard(this->lock);
+      this->buffers.push_back(std::unique_ptr<thread_buffer>(
+        new thread_buffer((unsigned int) this->buffers.size() + 1)));
+      buffer = this->buffers.back().get();
+    }
+    return *buffer;
+  }
+
+  static void escape(std::ostream& out, const std::string& text) {
+    for (size_t i = 0; i < text.size(); ++i) {
+      if ('"' == text[i] || '\\' == text[i])
+        out << '\\';
+      out << text[i];
+    }
+  }
+
+public:
+  static LI_tracer& instance() {
+    static LI_tracer tracer;
+    return tracer;
+  }
+
+  LI_tracer(const LI_tracer&) = delete;
+  LI_tracer& operator=(const LI_tracer&) = delete;
+
+  // The identifier of a stage, registered on first use. Stages beyond
+  // LI_TRACE_STAGES all share the last identifier.
+  unsigned int stage(const char *name) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    unsigned int count = this->stages;
+    for (unsigned int i = 0; i < count; ++i)
+      if (this->names[i] == name)
+        return i;
+
+    if (LI_TRACE_STAGES == count)
+      return LI_TRACE_STAGES - 1;
+
+    this->names[count] = name;
+    this->stages = count + 1;
+    return count;
+  }
+
+  // Records a span of a stage, on the thread it ran on.
+  void record(
+    unsigned int stage,
+    std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::time_point end) {
+
+    uint64_t start_ns = (uint64_t) std::chrono::duration_cast<
+      std::chrono::nanoseconds>(start - this->origin).count();
+    uint64_t duration_ns = (uint64_t) std::chrono::duration_cast<
+      std::chrono::nanoseconds>(end - start).count();
+
+    thread_buffer& buffer = this->buffer();
+    uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    event_t& event = buffer.events[head % LI_TRACE_EVENTS];
+
+    event.start_ns.store(start_ns, std::memory_order_relaxed);
+    event.duration_stage.store(
+      (duration_ns << 16) | (stage & 0xFFFF), std::memory_order_relaxed);
+    buffer.head.store(head + 1, std::memory_order_release);
+
+    this->histograms[stage].record(duration_ns / 1000);
+  }
+
+  // The latencies of a stage, by name. Empty if it never ran.
+  LI_latency_histogram histogram(const std::string& name) {
+    unsigned int count = this->stages;
+    for (unsigned int i = 0; i < count; ++i)
+      if (this->names[i] == name)
+        return this->histograms[i].snapshot();
+
+    return LI_latency_histogram();
+  }
+
+  // Writes the spans still in the buffers as a Chrome trace. Spans
+  // overwritten while being read are left out.
+  void write_chrome_trace(std::ostream& out) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    out << "{\"traceEvents\": [";
+    bool first = true;
+
+    for (unsigned int b = 0; b < this->buffers.size(); ++b) {
+      thread_buffer& buffer = *this->buffers[b];
+      uint64_t head = buffer.head.load(std::memory_order_acquire);
+      uint64_t begin = (head > LI_TRACE_EVENTS) ? head - LI_TRACE_EVENTS : 0;
+
+      std::vector<std::pair<uint64_t, uint64_t> > events;
+      events.reserve((size_t) (head - begin));
+      for (uint64_t i = begin; i < head; ++i) {
+        const event_t& event = buffer.events[i % LI_TRACE_EVENTS];
+        events.push_back(std::make_pair(
+          event.start_ns.load(std::memory_order_relaxed),
+          event.duration_stage.load(std::memory_order_relaxed)));
+      }
+
+      // The thread may have lapped us meanwhile.
+      uint64_t now = buffer.head.load(std::memory_order_acquire);
+      uint64_t valid = (now > LI_TRACE_EVENTS) ? now - LI_TRACE_EVENTS : 0;
+
+      for (uint64_t i = std::max(begin, valid); i < head; ++i) {
+        const std::pair<uint64_t, uint64_t>& event = events[i - begin];
+        unsigned int stage = (unsigned int) (event.second & 0xFFFF);
+
+        out << (first ? "" : ",") << "\n  {\"name\": \"";
+        LI_tracer::escape(out, this->names[stage]);
+        out << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer.tid <<
+          ", \"ts\": " << event.first / 1000.0 <<
+          ", \"dur\": " << (event.second >> 16) / 1000.0 << "}";
+        first = false;
+      }
+    }
+
+    out << "\n]}\n";
+  }
+
+  bool write_chrome_trace(const std::string& path) {
+    std::ofstream out(path.c_str());
+    this->write_chrome_trace(out);
+    return (bool) out;
+  }
+
+  // Writes the count and the mean, p50/p95/p99 and maximum latencies of
+  // every stage, one metric per line:
+  //
+  //   li_stage_count{stage="cascade"} 1200
+  //   li_stage_latency_us{stage="cascade",quantile="0.99"} 16384
+  //
+  // The percentiles are the upper bounds of the power-of-two buckets of
+  // LI_histogram. With 'reset' the histograms start over, so that each
+  // dump covers the time since the previous one.
+  void write_metrics(std::ostream& out, bool reset = false) {
+    static const double quantiles[] = { 0.5, 0.95, 0.99 };
+    unsigned int count = this->stages;
+
+    for (unsigned int i = 0; i < count; ++i) {
+      LI_latency_histogram histogram = this->histograms[i].snapshot();
+      if (reset)
+        this->histograms[i].reset();
+
+      out << "li_stage_count{stage=\"" << this->names[i] << "\"} " <<
+        histogram.count << "\n";
+      out << "li_stage_latency_mean_us{stage=\"" << this->names[i] <<
+        "\"} " << histogram.mean_us() << "\n";
+
+      for (int q = 0; q < 3; ++q)
+        out << "li_stage_latency_us{stage=\"" << this->names[i] <<
+          "\",quantile=\"" << quantiles[q] << "\"} " <<
+          histogram.percentile_us(quantiles[q]) << "\n";
+
+      out << "li_stage_latency_max_us{stage=\"" << this->names[i] <<
+        "\"} " << histogram.max_us << "\n";
+    }
+  }
+
+  bool write_metrics(const std::string& path, bool reset = false) {
+    std::ofstream out(path.c_str());
+    this->write_metrics(out, reset);
+    return (bool) out;
+  }
+
+  void write_metrics(
+    const std::function<void(const std::string&)>& callback,
+    bool reset = false) {
+
+    std::ostringstream out;
+    this->write_metrics(out, reset);
+    callback(out.str());
+  }
+};
+
+// Times the enclosing block, see LI_TRACE_SCOPE.
+class LI_trace_scope {
+  unsigned int stage;
+  std::chrono::steady_clock::time_point start;
+
+public:
+  explicit LI_trace_scope(unsigned int stage) :
+    stage(stage),
+    start(std::chrono::steady_clock::now()) {
+
+  }
+
+  ~LI_trace_scope() {
+    LI_tracer::instance().record(
+      this->stage, this->start, std::chrono::steady_clock::now());
+  }
+
+  LI_trace_scope(const LI_trace_scope&) = delete;
+  LI_trace_scope& operator=(const LI_trace_scope&) = delete;
+};
+
+#define LI_TRACE_CONCAT_(a, b) a##b
+#define LI_TRACE_CONCAT(a, b) LI_TRACE_CONCAT_(a, b)
+
+#ifdef LI_ENABLE_TRACING
+#define LI_TRACE_SCOPE(name) \
+  static const unsigned int LI_TRACE_CONCAT(li_trace_stage_, __LINE__) = \
+    LI_tracer::instance().stage(name); \
+  LI_trace_scope LI_TRACE_CONCAT(li_trace_scope_, __LINE__)( \
+    LI_TRACE_CONCAT(li_trace_stage_, __LINE__))
+#else
+#define LI_TRACE_SCOPE(name) do { } while (0)
+#endif
+
+#endif
@@ -0,0 +1,210 @@
+#ifndef LI_TRACKER_H
+#define LI_TRACKER_H
+
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "LI_frame.hpp"
+
+// Settings of the face tracking.
+struct LI_tracker_config {
+  // A full scan of the image runs every 'interval' frames, the frames in
+  // between only looking for the known faces around where they were. An
+  // interval of 1 (or 0) scans every frame in full.
+  unsigned int interval;
+
+  // Tracks not seen for more than this many frames are dropped.
+  unsigned int max_misses;
+
+  // Minimum overlap (intersection over union) between a face and a track
+  // for them to be taken as the same face.
+  float min_overlap;
+
+  // How far around a tracked face it is looked for, as a fraction of its
+  // size on each side.
+  float search_margin;
+
+  LI_tracker_config() :
+    interval(1),
+    max_misses(2),
+    min_overlap(0.3f),
+    search_margin(0.5f) {
+
+  }
+};
+
+/*
+ * Face tracks shared by all the workers
+ *
+ * Before a frame is analysed, plan() tells whether it needs a full scan or
+ * which boxes to look around instead. Afterwards update() matches the
+ * faces found with the tracks, giving each face the ID of its track.
+ *
+ * Besides the regular interval, a full scan is also forced as soon as a
+ * tracked face is lost, since it may merely have moved out of its search
+ * area. Frames may be analysed out of order by concurrent workers: the
+ * results of a frame older than the last one applied only get IDs, and
+ * leave the tracks as they are.
+ */
+class LI_face_tracker {
+  struct track_t {
+    int id;
+    cv::Rect left, right;
+    unsigned int misses;
+  };
+
+  std::mutex lock;
+
+  LI_tracker_config config;
+  std::vector<track_t> tracks;
+  std::vector<bool> used;
+
+  int next_id;
+  bool started;
+  bool rescan;
+  uint32_t last_scan;
+  uint32_t last_update;
+
+  // Sequence numbers wrap around, so they are compared by difference.
+  static int32_t after(uint32_t a, uint32_t b) {
+    return (int32_t) (a - b);
+  }
+
+  static float overlap(const cv::Rect& a, const cv::Rect& b) {
+    if (a.empty() || b.empty())
+      return 0;
+
+    float common = (float) (a & b).area();
+    return common / (a.area() + b.area() - common);
+  }
+
+  // Index of the unused track best overlapping a face, -1 if none does
+  // enough.
+  int associate(const LI_face& face) const {
+    int best = -1;
+    float best_overlap = this->config.min_overlap;
+
+    for (unsigned int i = 0; i < this->tracks.size(); ++i) {
+      if (this->used[i])
+        continue;
+
+      float score = face.left.empty() ?
+        LI_face_tracker::overlap(face.right, this->tracks[i].right) :
+        LI_face_tracker::overlap(face.left, this->tracks[i].left);
+
+      if (score >= best_overlap) {
+        best = (int) i;
+        best_overlap = score;
+      }
+    }
+
+    return best;
+  }
+
+public:
+  explicit LI_face_tracker(const LI_tracker_config& config = LI_tracker_config()) :
+    config(config) {
+
+    this->reset();
+  }
+
+  // Forgets every track, e.g. when the stream restarts.
+  void reset() {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    this->tracks.clear();
+    this->next_id = 0;
+    this->started = false;
+    this->rescan = true;
+    this->last_scan = 0;
+    this->last_update = 0;
+  }
+
+  // Returns true if the frame must be scanned in full. Otherwise 'boxes'
+  // receives where the tracked faces were last seen in the left image.
+  bool plan(uint32_t sequence, std::vector<cv::Rect>& boxes) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    boxes.clear();
+
+    if (this->rescan || this->config.interval <= 1 ||
+        LI_face_tracker::after(sequence, this->last_scan) >=
+          (int32_t) this->config.interval) {
+      this->rescan = false;
+      this->last_scan = sequence;
+      return true;
+    }
+
+    for (unsigned int i = 0; i < this->tracks.size(); ++i)
+      if (!this->tracks[i].left.empty())
+        boxes.push_back(this->tracks[i].left);
+
+    return false;
+  }
+
+  // Matches the faces found in a frame with the tracks and sets their IDs.
+  // 'full' tells whether the frame was scanned in full.
+  void update(uint32_t sequence, std::vector<LI_face>& faces, bool full) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    bool stale = this->started &&
+      LI_face_tracker::after(sequence, this->last_update) < 0;
+
+    this->used.assign(this->tracks.size(), false);
+
+    for (unsigned int i = 0; i < faces.size(); ++i) {
+      int match = this->associate(faces[i]);
+
+      if (-1 != match) {
+        this->used[match] = true;
+        faces[i].id = this->tracks[match].id;
+
+        if (!stale) {
+          this->tracks[match].left = faces[i].left;
+          this->tracks[match].right = faces[i].right;
+          this->tracks[match].misses = 0;
+        }
+      }
+      else if (!stale) {
+        track_t track;
+        track.id = this->next_id++;
+        track.left = faces[i].left;
+        track.right = faces[i].right;
+        track.misses = 0;
+
+        faces[i].id = track.id;
+        this->tracks.push_back(track);
+        this->used.push_back(true);
+      }
+    }
+
+    if (stale)
+      return;
+
+    this->started = true;
+    this->last_update = sequence;
+
+    unsigned int kept = 0;
+    for (unsigned int i = 0; i < this->tracks.size(); ++i) {
+      if (!this->used[i]) {
+        if (!full)
+          this->rescan = true;
+        if (++this->tracks[i].misses > this->config.max_misses)
+          continue;
+      }
+      this->tracks[kept++] = this->tracks[i];
+    }
+    this->tracks.resize(kept);
+  }
+
+  // Number of faces currently tracked.
+  unsigned int size() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return (unsigned int) this->tracks.size();
+  }
+};
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef LI_VIDEOMODE_H
+#define LI_VIDEOMODE_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+// Builds a FourCC code as found in the first bytes of UVC format GUIDs.
+#define LI_FOURCC(a, b, c, d) \
+  ((uint32_t) (uint8_t) (a) | ((uint32_t) (uint8_t) (b) << 8) | \
+  ((uint32_t) (uint8_t) (c) << 16) | ((uint32_t) (uint8_t) (d) << 24))
+
+// The only pixel format the frame pipeline can split into two images.
+#define LI_FOURCC_YUY2 LI_FOURCC('Y', 'U', 'Y', '2')
+
+// A video mode advertised by the camera: a format, a frame size and one of
+// the frame intervals offered for that size.
+struct LI_video_mode {
+  uint32_t fourcc;
+  int width, height;
+
+  // Frame interval, in units of 100ns as in the UVC descriptors.
+  uint32_t interval;
+
+  LI_video_mode() :
+    fourcc(0),
+    width(0),
+    height(0),
+    interval(0) {
+
+  }
+
+  LI_video_mode(uint32_t fourcc, int width, int height, uint32_t interval) :
+    fourcc(fourcc),
+    width(width),
+    height(height),
+    interval(interval) {
+
+  }
+
+  // Frame rate, rounded to the nearest integer.
+  int fps() const {
+    return (0 == this->interval) ? 0 :
+      (int) ((10000000u + this->interval / 2) / this->interval);
+  }
+};
+
+// How a mode is picked among those advertised.
+enum LI_mode_policy_t {
+  LI_MODE_EXACT = 0,          /* the requested size and rate, or nothing */
+  LI_MODE_CLOSEST = 1,        /* the closest size, then the closest rate */
+  LI_MODE_HIGHEST_FPS = 2,    /* the highest rate, then the closest size */
+  LI_MODE_LOWEST_LATENCY = 3  /* the highest rate, then the smallest size */
+};
+
+// The mode asked for, see LI_select_mode().
+struct LI_mode_request {
+  LI_mode_policy_t policy;
+  int width, height;
+  int fps;
+
+  LI_mode_request() :
+    policy(LI_MODE_CLOSEST),
+    width(640),
+    height(480),
+    fps(30) {
+
+  }
+};
+
+// Picks the mode that best fits the request among the YUY2 modes of the
+// list, returns false if none does (only possible with LI_MODE_EXACT, or
+// if the list has no YUY2 mode at all). Sizes are compared by the sum of
+// the differences of their widths and heights, ties being broken by the
+// order of the list.
+inline bool LI_select_mode(
+  const std::vector<LI_video_mode>& modes,
+  const LI_mode_request& request,
+  LI_video_mode& selected) {
+
+  int best = -1;
+  long best_key[2] = { 0, 0 };
+
+  for (unsigned int i = 0; i < modes.size(); ++i) {
+    const LI_video_mode& mode = modes[i];
+    if (LI_FOURCC_YUY2 != mode.fourcc || 0 == mode.interval)
+      continue;
+
+    long size_distance = std::labs((long) mode.width - request.width) +
+      std::labs((long) mode.height - request.height);
+    long fps_distance = std::labs((long) mode.fps() - request.fps);
+    long key[2];
+
+    switch (request.policy) {
+      case LI_MODE_EXACT:
+        if (0 != size_distance || 0 != fps_distance)
+          continue;
+        key[0] = key[1] = 0;
+        break;
+      case LI_MODE_CLOSEST:
+        key[0] = size_distance;
+        key[1] = fps_distance;
+        break;
+      case LI_MODE_HIGHEST_FPS:
+        key[0] = mode.interval;
+        key[1] = size_distance;
+        break;
+      case LI_MODE_LOWEST_LATENCY:
+      default:
+        key[0] = mode.interval;
+        key[1] = (long) mode.width * mode.height;
+        break;
+    }
+
+    if (-1 == best || key[0] < best_key[0] ||
+        (key[0] == best_key[0] && key[1] < best_key[1])) {
+      best = (int) i;
+      best_key[0] = key[0];
+      best_key[1] = key[1];
+    }
+  }
+
+  if (-1 == best)
+    return false;
+
+  selected = modes[best];
+  return true;
+}
+
+// The mode to ask the camera for: the one LI_select_mode() picks among
+// the modes it advertises, or the request as is (in YUY2) if it
+// advertises none. Returns false if none of the advertised modes fits,
+// 'chosen' then being the request too.
+inline bool LI_choose_mode(
+  const std::vector<LI_video_mode>& modes,
+  const LI_mode_request& request,
+  LI_video_mode& chosen) {
+
+  chosen = LI_video_mode(LI_FOURCC_YUY2, request.width, request.height,
+    10000000u / (uint32_t) std::max(1, request.fps));
+
+  return modes.empty() || LI_select_mode(modes, request, chosen);
+}
+
+#endif
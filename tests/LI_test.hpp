@@ -0,0 +1,114 @@
+#ifndef LI_TEST_H
+#define LI_TEST_H
+
+#include <stdint.h>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <libuvc/libuvc.h>
+
+/*
+ * Minimal test harness
+ *
+ * Every test is a program of its own, run by ctest (see CMakeLists.txt).
+ * CHECK() reports a failed condition and carries on, and main() returns
+ * LI_test_result(). Tests that cannot run on the machine (no display,
+ * say) return LI_TEST_SKIPPED instead.
+ */
+
+#define LI_TEST_SKIPPED 77
+
+inline int& LI_test_failures() {
+  static int failures = 0;
+  return failures;
+}
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition \
+        ") failed" << std::endl; \
+      ++LI_test_failures(); \
+    } \
+  } while (0)
+
+inline int LI_test_result() {
+  return (0 == LI_test_failures()) ? 0 : 1;
+}
+
+// Polls 'done' until it returns true or the timeout is over, so that a
+// stuck pipeline fails the test instead of hanging it. Returns the last
+// value of 'done'.
+inline bool LI_wait_for(
+  const std::function<bool()>& done,
+  std::chrono::milliseconds timeout = std::chrono::milliseconds(5000)) {
+
+  std::chrono::steady_clock::time_point deadline =
+    std::chrono::steady_clock::now() + timeout;
+
+  while (!done()) {
+    if (std::chrono::steady_clock::now() > deadline)
+      return done();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+/*
+ * Synthetic YUYV frame, as libuvc delivers them
+ *
+ * The left image of the OV580 is carried by the Y bytes and the right one
+ * by the U/V bytes, so pixel (x, y) of either image can be set on its own.
+ */
+class LI_test_frame {
+  std::vector<uint8_t> data;
+  uvc_frame_t frame;
+
+public:
+  LI_test_frame(int width, int height, uint8_t left = 0, uint8_t right = 0) :
+    data(2 * (size_t) width * height) {
+
+    std::memset(&this->frame, 0, sizeof(this->frame));
+    this->frame.data = &this->data[0];
+    this->frame.data_bytes = this->data.size();
+    this->frame.width = width;
+    this->frame.height = height;
+    this->frame.step = 2 * (size_t) width;
+    this->frame.frame_format = UVC_FRAME_FORMAT_YUYV;
+
+    this->fill(left, right);
+  }
+
+  void fill(uint8_t left, uint8_t right) {
+    for (size_t i = 0; i < this->data.size(); i += 2) {
+      this->data[i] = left;
+      this->data[i + 1] = right;
+    }
+  }
+
+  void set(int x, int y, uint8_t left, uint8_t right) {
+    uint8_t *pixel = &this->data[y * this->frame.step + 2 * x];
+    pixel[0] = left;
+    pixel[1] = right;
+  }
+
+  uint8_t left(int x, int y) const {
+    return this->data[y * this->frame.step + 2 * x];
+  }
+
+  uint8_t right(int x, int y) const {
+    return this->data[y * this->frame.step + 2 * x + 1];
+  }
+
+  // The frame to push, with the given sequence number.
+  uvc_frame_t* get(uint32_t sequence) {
+    this->frame.sequence = sequence;
+    return &this->frame;
+  }
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#include "LI_benchmark.hpp"
+
+/*
+ * The frame path benchmarks, on synthetic VGA frames
+ *
+ * Writes the results as JSON to the file given as the first argument (to
+ * the standard output otherwise), and as text to the standard error. The
+ * cascade benchmarks use OpenCV's models, when CMakeLists.txt found them
+ * (LI_TEST_FACE_CASCADE and LI_TEST_EYE_CASCADE). The replay benchmarks
+ * use the recording given as the second argument, if any (see
+ * LI_stereocamera::start_recording()), and a recording of the synthetic
+ * frame otherwise.
+ */
+
+static const int WIDTH = 640;
+static const int HEIGHT = 480;
+
+#ifdef LI_TEST_FACE_CASCADE
+static const char *FACE_CASCADE = LI_TEST_FACE_CASCADE;
+#else
+static const char *FACE_CASCADE = "";
+#endif
+
+#ifdef LI_TEST_EYE_CASCADE
+static const char *EYE_CASCADE = LI_TEST_EYE_CASCADE;
+#else
+static const char *EYE_CASCADE = "";
+#endif
+
+// A short recording of the synthetic frame, to be replayed.
+static bool record(
+  const std::string& path, const std::vector<uint8_t>& yuyv, int frames) {
+
+  LI_config config;
+  config.face_detection = false;
+  config.overflow = LI_BLOCK;
+  config.mode.width = WIDTH;
+  config.mode.height = HEIGHT;
+
+  LI_stereocamera camera(config);
+  if (!camera.start_recording(path))
+    return false;
+
+  uvc_frame_t frame;
+  std::memset(&frame, 0, sizeof(frame));
+  frame.data = (void*) &yuyv[0];
+  frame.data_bytes = yuyv.size();
+  frame.width = WIDTH;
+  frame.height = HEIGHT;
+  frame.step = 2 * (size_t) WIDTH;
+  frame.frame_format = UVC_FRAME_FORMAT_YUYV;
+
+  // One frame at a time, so that none is lost to the writer falling
+  // behind.
+  for (int i = 0; i < frames; ++i) {
+    frame.sequence = i;
+    camera.push_frame(&frame);
+
+    while (camera.recording_stats().recorded +
+           camera.recording_stats().lost < (unsigned int) i + 1)
+      std::this_thread::yield();
+  }
+  return camera.stop_recording();
+}
+
+int main(int argc, char **argv) {
+  LI_benchmark benchmark;
+
+  std::vector<uint8_t> yuyv;
+  LI_benchmark::synthetic_frame(WIDTH, HEIGHT, yuyv);
+  benchmark.deinterleave(yuyv, WIDTH, HEIGHT);
+
+  cv::Mat left, right;
+  LI_deinterleave_yuyv(cv::Mat(HEIGHT, WIDTH, CV_8UC2, &yuyv[0]), left, right);
+
+  std::vector<double> scales;
+  scales.push_back(1);
+  scales.push_back(2);
+  benchmark.preprocess(left, scales);
+
+  cv::Mat equalised;
+  cv::equalizeHist(left, equalised);
+
+  benchmark.rectification(left, right);
+
+  std::vector<LI_depth_config> depth(3);
+  depth[1].downscale = 2;
+  depth[2].algorithm = LI_DEPTH_SGBM;
+  depth[2].downscale = 2;
+  depth[2].block_size = 5;
+  benchmark.disparity(left, right, depth);
+
+  LI_config config;
+  config.face_detection = false;
+
+  if (0 != *FACE_CASCADE) {
+    benchmark.detection(equalised, FACE_CASCADE, scales);
+    benchmark.cascade_loading(equalised, FACE_CASCADE, EYE_CASCADE);
+
+    config.face_detection = true;
+    config.face_cascade = FACE_CASCADE;
+    config.nested_cascade = "";
+  }
+
+  if (0 != *EYE_CASCADE) {
+    std::vector<unsigned int> faces;
+    faces.push_back(1);
+    faces.push_back(4);
+    faces.push_back(12);
+    benchmark.eye_detection(equalised, EYE_CASCADE, faces, 2);
+  }
+
+  benchmark.end_to_end(config, yuyv, WIDTH, HEIGHT);
+  if (config.face_detection)
+    benchmark.dual_detection(config, yuyv, WIDTH, HEIGHT);
+
+  std::string recording = "LI_bench_recording.bin";
+  bool synthetic = argc <= 2;
+  if (!synthetic)
+    recording = argv[2];
+
+  LI_replay replay;
+  if ((!synthetic || record(recording, yuyv, 16)) && replay.open(recording)) {
+    benchmark.end_to_end(config, replay);
+    if (config.face_detection) {
+      benchmark.epipolar_detection(config, replay);
+      benchmark.tracking(config, replay, 5);
+    }
+  }
+  if (synthetic)
+    std::remove(recording.c_str());
+
+  benchmark.write_text(std::cerr);
+
+  if (argc > 1) {
+    std::ofstream out(argv[1]);
+    benchmark.write_json(out);
+    return out ? 0 : 1;
+  }
+
+  benchmark.write_json(std::cout);
+  return 0;
+}
@@ -0,0 +1,121 @@
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * The detection resolution driven by its time budget: the operating point
+ * climbs the ladder while the detection is over budget, comes back down
+ * once the rung below fits in the headroom, and holds every point for a
+ * few frames.
+ */
+
+// A short ladder: the scale doubles up to 4, then the minimum face size up
+// to 60, i.e. 4 rungs costing 1, 1/4, 1/16 and 1/64. The average is the
+// last detection time, so that every decision is plain.
+static LI_budget_config test_config() {
+  LI_budget_config config;
+  config.budget_us = 1000;
+  config.max_scale = 4;
+  config.min_size = 30;
+  config.max_min_size = 60;
+  config.step = 2;
+  config.headroom = 0.8;
+  config.smoothing = 1;
+  config.hold = 3;
+  return config;
+}
+
+static void record(LI_resolution_controller& controller, double us, int frames) {
+  for (int i = 0; i < frames; ++i)
+    controller.record(us);
+}
+
+// Over budget, one rung per 'hold' frames up to the last one, with the
+// average carried over to the cost of the new rung.
+static void test_climb() {
+  LI_resolution_controller controller(test_config());
+  CHECK(1 == controller.current().scale && 30 == controller.current().min_size);
+
+  record(controller, 2000, 2);
+  CHECK(0 == controller.snapshot().level);
+
+  record(controller, 2000, 1);
+  LI_budget_stats stats = controller.snapshot();
+  CHECK(1 == stats.level && 1 == stats.raised);
+  CHECK(2 == stats.point.scale && 30 == stats.point.min_size);
+  CHECK(500 == stats.average_us);
+
+  record(controller, 2000, 3);
+  CHECK(2 == controller.snapshot().level);
+  CHECK(4 == controller.current().scale && 30 == controller.current().min_size);
+
+  record(controller, 2000, 3);
+  CHECK(3 == controller.snapshot().level);
+  CHECK(4 == controller.current().scale && 60 == controller.current().min_size);
+  CHECK(240 == controller.current().min_face());
+
+  // There is no rung above the last one.
+  record(controller, 2000, 6);
+  stats = controller.snapshot();
+  CHECK(3 == stats.level && 3 == stats.raised && 0 == stats.lowered);
+  CHECK(15 == stats.frames && 15 == stats.over_budget);
+  CHECK(2000 == stats.last_us);
+}
+
+// Within budget, a rung is only given back once it would fit in the
+// headroom, then one per 'hold' frames down to full resolution.
+static void test_descend() {
+  LI_resolution_controller controller(test_config());
+  record(controller, 2000, 9);
+  CHECK(3 == controller.snapshot().level);
+
+  // 250 us would be 1000 us a rung down: within budget, not in the
+  // headroom.
+  record(controller, 250, 6);
+  CHECK(3 == controller.snapshot().level);
+  CHECK(0 == controller.snapshot().lowered);
+
+  // 150 us would be 600 us.
+  record(controller, 150, 1);
+  LI_budget_stats stats = controller.snapshot();
+  CHECK(2 == stats.level && 1 == stats.lowered);
+  CHECK(600 == stats.average_us);
+
+  // The hold applies on the way down too.
+  record(controller, 150, 2);
+  CHECK(2 == controller.snapshot().level);
+
+  record(controller, 150, 1);
+  CHECK(1 == controller.snapshot().level);
+  record(controller, 150, 3);
+  CHECK(0 == controller.snapshot().level);
+
+  record(controller, 150, 6);
+  stats = controller.snapshot();
+  CHECK(0 == stats.level && 3 == stats.lowered && 3 == stats.raised);
+  CHECK(1 == stats.point.scale && 30 == stats.point.min_size);
+}
+
+// Without a budget the images are always scanned at full resolution.
+static void test_no_budget() {
+  LI_budget_config config = test_config();
+  config.budget_us = 0;
+
+  LI_resolution_controller controller(config);
+  record(controller, 1e6, 20);
+
+  LI_budget_stats stats = controller.snapshot();
+  CHECK(0 == stats.level && 0 == stats.raised && 0 == stats.over_budget);
+  CHECK(20 == stats.frames);
+
+  // Configuring anew starts over.
+  controller.configure(test_config());
+  CHECK(0 == controller.snapshot().frames);
+  CHECK(1000 == controller.snapshot().budget_us);
+}
+
+int main() {
+  test_climb();
+  test_descend();
+  test_no_budget();
+  return LI_test_result();
+}
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * The stereo calibration: a calibration made at another resolution has
+ * its intrinsics scaled to the streamed one, the fixed-point remap tables
+ * are within one step (1 / cv::INTER_TAB_SIZE of a pixel) of float ones,
+ * and the focal length and baseline of the rectified pair are those of
+ * the rectification.
+ */
+
+static const int WIDTH = 160;
+static const int HEIGHT = 120;
+
+static const char *INTRINSICS = "test_calibration_intrinsics.yml";
+static const char *EXTRINSICS = "test_calibration_extrinsics.yml";
+
+struct test_calibration {
+  cv::Mat M[2], D[2];
+  cv::Mat R, T;
+
+  // Made at twice the streamed resolution, with lens distortion and a
+  // slight rotation between the cameras, 60 mm apart.
+  test_calibration() {
+    M[0] = (cv::Mat_<double>(3, 3) << 300, 0, 162, 0, 302, 118, 0, 0, 1);
+    M[1] = (cv::Mat_<double>(3, 3) << 305, 0, 158, 0, 304, 122, 0, 0, 1);
+    D[0] = (cv::Mat_<double>(1, 5) << -0.2, 0.05, 0.001, -0.001, 0);
+    D[1] = (cv::Mat_<double>(1, 5) << -0.15, 0.03, 0, 0.001, 0);
+    cv::Rodrigues(cv::Vec3d(0.01, -0.02, 0.005), R);
+    T = (cv::Mat_<double>(3, 1) << -60, 1, 0.5);
+  }
+
+  // Written as OpenCV's stereo_calib sample does, the intrinsics and the
+  // extrinsics in files of their own.
+  void write(int width, int height) const {
+    cv::FileStorage intrinsics(INTRINSICS, cv::FileStorage::WRITE);
+    intrinsics << "M1" << M[0] << "D1" << D[0] << "M2" << M[1] << "D2" << D[1];
+    if (0 != width)
+      intrinsics << "image_width" << width << "image_height" << height;
+
+    cv::FileStorage extrinsics(EXTRINSICS, cv::FileStorage::WRITE);
+    extrinsics << "R" << R << "T" << T;
+  }
+
+  // The intrinsics at another resolution, as the rectifier scales them.
+  cv::Mat scaled(int eye, double sx, double sy) const {
+    cv::Mat m = M[eye].clone();
+    m.at<double>(0, 0) *= sx;
+    m.at<double>(0, 2) *= sx;
+    m.at<double>(1, 1) *= sy;
+    m.at<double>(1, 2) *= sy;
+    return m;
+  }
+};
+
+// What cv::stereoRectify makes of the calibration, with the intrinsics
+// scaled by 's', for the given image size.
+struct test_rectification {
+  cv::Mat M[2], R_rect[2], P[2], Q;
+
+  test_rectification(const test_calibration& calibration, double s,
+    cv::Size size) {
+
+    for (int eye = 0; eye < 2; ++eye)
+      M[eye] = calibration.scaled(eye, s, s);
+
+    cv::stereoRectify(M[0], calibration.D[0], M[1], calibration.D[1], size,
+      calibration.R, calibration.T, R_rect[0], R_rect[1], P[0], P[1], Q,
+      cv::CALIB_ZERO_DISPARITY, 0);
+  }
+};
+
+static void remove_files() {
+  std::remove(INTRINSICS);
+  std::remove(EXTRINSICS);
+}
+
+// Loading needs every parameter, from one file or two.
+static void test_loading() {
+  test_calibration calibration;
+  calibration.write(2 * WIDTH, 2 * HEIGHT);
+
+  LI_rectifier rectifier;
+  CHECK(!rectifier.load("/nonexistent/calibration.yml"));
+  CHECK(!rectifier.load(INTRINSICS));
+  CHECK(!rectifier.prepare(cv::Size(WIDTH, HEIGHT)));
+  CHECK(!rectifier.ready());
+  CHECK(0 == rectifier.focal_length() && 0 == rectifier.baseline());
+
+  CHECK(rectifier.load(INTRINSICS, EXTRINSICS));
+  CHECK(rectifier.loaded() && !rectifier.ready());
+  CHECK(0 == rectifier.focal_length() && 0 == rectifier.baseline());
+
+  CHECK(rectifier.prepare(cv::Size(WIDTH, HEIGHT)));
+  CHECK(rectifier.ready());
+  CHECK(cv::Size(WIDTH, HEIGHT) == rectifier.image_size());
+
+  remove_files();
+}
+
+// Made at twice the resolution streamed, the intrinsics are halved: the
+// rectification is that of the halved intrinsics. Without the resolution
+// of the calibration, they are taken as they are.
+static void test_scaled_intrinsics() {
+  test_calibration calibration;
+  cv::Size size(WIDTH, HEIGHT);
+
+  calibration.write(2 * WIDTH, 2 * HEIGHT);
+  LI_rectifier rectifier;
+  CHECK(rectifier.load(INTRINSICS, EXTRINSICS) && rectifier.prepare(size));
+
+  test_rectification halved(calibration, 0.5, size);
+  CHECK(std::abs(halved.P[1].at<double>(0, 0) - rectifier.focal_length()) < 1e-9);
+  CHECK(0 == cv::norm(halved.Q, rectifier.reprojection(), cv::NORM_INF));
+
+  test_rectification unscaled(calibration, 1, size);
+  CHECK(std::abs(unscaled.P[1].at<double>(0, 0) - rectifier.focal_length()) > 1);
+
+  calibration.write(0, 0);
+  LI_rectifier as_is;
+  CHECK(as_is.load(INTRINSICS, EXTRINSICS) && as_is.prepare(size));
+  CHECK(std::abs(unscaled.P[1].at<double>(0, 0) - as_is.focal_length()) < 1e-9);
+  CHECK(0 == cv::norm(unscaled.Q, as_is.reprojection(), cv::NORM_INF));
+
+  // Prepared for the resolution of the calibration, nothing is scaled.
+  calibration.write(2 * WIDTH, 2 * HEIGHT);
+  LI_rectifier native;
+  CHECK(native.load(INTRINSICS, EXTRINSICS));
+  CHECK(native.prepare(cv::Size(2 * WIDTH, 2 * HEIGHT)));
+  test_rectification full(calibration, 1, cv::Size(2 * WIDTH, 2 * HEIGHT));
+  CHECK(std::abs(full.P[1].at<double>(0, 0) - native.focal_length()) < 1e-9);
+
+  remove_files();
+}
+
+// The fixed-point tables point where float ones do, to within one step of
+// the interpolation weights.
+static void test_fixed_point_maps() {
+  test_calibration calibration;
+  cv::Size size(WIDTH, HEIGHT);
+
+  calibration.write(2 * WIDTH, 2 * HEIGHT);
+  LI_rectifier rectifier;
+  CHECK(rectifier.load(INTRINSICS, EXTRINSICS) && rectifier.prepare(size));
+  test_rectification expected(calibration, 0.5, size);
+
+  const double step = 1.0 / cv::INTER_TAB_SIZE;
+  for (int eye = 0; eye < 2; ++eye) {
+    cv::Mat map_x, map_y;
+    cv::initUndistortRectifyMap(expected.M[eye], calibration.D[eye],
+      expected.R_rect[eye], expected.P[eye], size, CV_32FC1, map_x, map_y);
+
+    cv::Mat xy, weights;
+    rectifier.maps(eye, xy, weights);
+    CHECK(CV_16SC2 == xy.type() && CV_16UC1 == weights.type());
+    CHECK(size == xy.size() && size == weights.size());
+
+    double worst = 0;
+    for (int y = 0; y < HEIGHT; ++y)
+      for (int x = 0; x < WIDTH; ++x) {
+        cv::Vec2s integer = xy.at<cv::Vec2s>(y, x);
+        int index = weights.at<uint16_t>(y, x);
+
+        double fx = integer[0] + (index % cv::INTER_TAB_SIZE) * step;
+        double fy = integer[1] + (index / cv::INTER_TAB_SIZE) * step;
+        worst = std::max(worst, std::abs(fx - map_x.at<float>(y, x)));
+        worst = std::max(worst, std::abs(fy - map_y.at<float>(y, x)));
+      }
+    CHECK(worst <= step + 1e-3);
+  }
+
+  remove_files();
+}
+
+// The focal length and baseline are those of the rectified right camera,
+// the baseline being the distance between the cameras.
+static void test_focal_length_and_baseline() {
+  test_calibration calibration;
+  cv::Size size(WIDTH, HEIGHT);
+
+  calibration.write(2 * WIDTH, 2 * HEIGHT);
+  LI_rectifier rectifier;
+  CHECK(rectifier.load(INTRINSICS, EXTRINSICS) && rectifier.prepare(size));
+  test_rectification expected(calibration, 0.5, size);
+
+  double focal = expected.P[1].at<double>(0, 0);
+  CHECK(0 < focal && std::abs(focal - rectifier.focal_length()) < 1e-9);
+
+  double distance = cv::norm(calibration.T);
+  CHECK(std::abs(distance - rectifier.baseline()) < 1e-6 * distance);
+  CHECK(std::abs(-expected.P[1].at<double>(0, 3) / focal -
+    rectifier.baseline()) < 1e-9);
+
+  remove_files();
+}
+
+int main() {
+  test_loading();
+  test_scaled_intrinsics();
+  test_fixed_point_maps();
+  test_focal_length_and_baseline();
+  return LI_test_result();
+}
@@ -0,0 +1,137 @@
+#include <random>
+
+#include "LI_test.hpp"
+#include "LI_deinterleave.hpp"
+
+/*
+ * The YUYV split: every kernel the CPU supports must give the same images
+ * as the scalar one, whatever the width (odd ones included), the padding
+ * of the rows and the alignment of the buffers, and the packed images the
+ * libuvc converters give.
+ */
+
+static std::mt19937 random_engine(580);
+
+static int random_int(int low, int high) {
+  return std::uniform_int_distribution<int>(low, high)(random_engine);
+}
+
+static const LI_simd_t SIMD[] = {
+  LI_SIMD_SCALAR, LI_SIMD_SSE2, LI_SIMD_AVX2, LI_SIMD_NEON
+};
+
+// One conversion of a random geometry: the source and both images start
+// at random offsets from 64-byte boundaries, with random row padding. The
+// bytes around the images must be left alone.
+static void test_random_geometry(LI_simd_t simd) {
+  const int width = random_int(1, 257);
+  const int height = random_int(1, 7);
+
+  size_t src_offset = random_int(0, 63);
+  size_t src_step = 2 * (size_t) width + random_int(0, 1) * random_int(1, 19);
+  size_t offsets[2] = {
+    (size_t) random_int(0, 63), (size_t) random_int(0, 63)
+  };
+  size_t steps[2] = {
+    (size_t) width + random_int(0, 1) * random_int(1, 19),
+    (size_t) width + random_int(0, 1) * random_int(1, 19)
+  };
+
+  std::vector<uint8_t> src(src_offset + src_step * height + 64);
+  for (size_t i = 0; i < src.size(); ++i)
+    src[i] = (uint8_t) random_int(0, 255);
+
+  std::vector<uint8_t> expected[2], actual[2];
+  for (int eye = 0; eye < 2; ++eye) {
+    expected[eye].assign(offsets[eye] + steps[eye] * height + 64, 0xA5);
+    actual[eye] = expected[eye];
+  }
+
+  CHECK(LI_deinterleave_yuyv(&src[src_offset], src_step, width, height,
+    &expected[0][offsets[0]], steps[0], &expected[1][offsets[1]], steps[1],
+    LI_SIMD_SCALAR));
+  CHECK(LI_deinterleave_yuyv(&src[src_offset], src_step, width, height,
+    &actual[0][offsets[0]], steps[0], &actual[1][offsets[1]], steps[1],
+    simd));
+
+  for (int eye = 0; eye < 2; ++eye)
+    CHECK(expected[eye] == actual[eye]);
+
+  // The scalar kernel itself against the definition of the format.
+  bool split = true;
+  for (int y = 0; y < height; ++y)
+    for (int x = 0; x < width; ++x)
+      for (int eye = 0; eye < 2; ++eye)
+        split = split && expected[eye][offsets[eye] + y * steps[eye] + x] ==
+          src[src_offset + y * src_step + 2 * x + eye];
+  CHECK(split);
+
+  bool untouched = true;
+  for (int eye = 0; eye < 2; ++eye)
+    for (size_t i = 0; i < expected[eye].size(); ++i) {
+      size_t position = i - offsets[eye];
+      bool inside = i >= offsets[eye] &&
+        position < steps[eye] * height &&
+        position % steps[eye] < (size_t) width;
+      if (!inside)
+        untouched = untouched && 0xA5 == expected[eye][i];
+    }
+  CHECK(untouched);
+}
+
+// A packed frame split by libuvc's two converters, and by the kernel.
+static void test_against_libuvc(LI_simd_t simd) {
+  const int width = random_int(1, 161);
+  const int height = random_int(1, 9);
+
+  uvc_frame_t *in = uvc_allocate_frame(2 * (size_t) width * height);
+  uvc_frame_t *out[2] = { uvc_allocate_frame(0), uvc_allocate_frame(0) };
+
+  in->width = width;
+  in->height = height;
+  in->step = 2 * (size_t) width;
+  in->frame_format = UVC_FRAME_FORMAT_YUYV;
+  for (size_t i = 0; i < in->data_bytes; ++i)
+    ((uint8_t*) in->data)[i] = (uint8_t) random_int(0, 255);
+
+  CHECK(UVC_SUCCESS == uvc_yuyv2y(in, out[0]));
+  CHECK(UVC_SUCCESS == uvc_yuyv2uv(in, out[1]));
+
+  cv::Mat src(height, width, CV_8UC2, in->data, in->step);
+  cv::Mat images[2];
+  CHECK(LI_deinterleave_yuyv(src, images[0], images[1], simd));
+
+  for (int eye = 0; eye < 2; ++eye) {
+    CHECK((size_t) width * height <= out[eye]->data_bytes);
+
+    bool same = true;
+    for (int y = 0; y < height; ++y)
+      same = same && 0 == std::memcmp(images[eye].ptr(y),
+        (const uint8_t*) out[eye]->data + y * (size_t) width, width);
+    CHECK(same);
+  }
+
+  uvc_free_frame(in);
+  uvc_free_frame(out[0]);
+  uvc_free_frame(out[1]);
+}
+
+int main() {
+  CHECK(LI_simd_supported(LI_SIMD_SCALAR));
+  CHECK(LI_simd_supported(LI_simd_best()));
+  CHECK(LI_SIMD_AUTO != LI_simd_best());
+
+  for (unsigned int i = 0; i < sizeof(SIMD) / sizeof(SIMD[0]); ++i) {
+    if (!LI_simd_supported(SIMD[i])) {
+      CHECK(NULL == LI_deinterleave_kernel(SIMD[i]));
+      continue;
+    }
+
+    for (int run = 0; run < 500; ++run)
+      test_random_geometry(SIMD[i]);
+    for (int run = 0; run < 50; ++run)
+      test_against_libuvc(SIMD[i]);
+  }
+
+  return LI_test_result();
+}
@@ -0,0 +1,197 @@
+#include <cstdlib>
+#include <random>
+
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * The disparity computation: on a textured pair whose right image is the
+ * left one shifted by a known number of pixels, the disparities found are
+ * that shift, over the whole image, over a region of interest (cropped
+ * with enough of a margin to be matched up to its edges) and on shrunk
+ * images. The depth stage reuses the disparities of the last frame that
+ * changed on frames where nothing moved.
+ */
+
+static const int WIDTH = 160;
+static const int HEIGHT = 120;
+
+// Disparity of the pair, in pixels of the full resolution images.
+static const int SHIFT = 8;
+
+static std::mt19937 random_engine(580);
+
+struct test_pair {
+  cv::Mat left, right;
+
+  // Random texture, seen SHIFT pixels further left in the right image.
+  test_pair() :
+    left(HEIGHT, WIDTH, CV_8UC1),
+    right(HEIGHT, WIDTH, CV_8UC1) {
+
+    std::uniform_int_distribution<int> byte(0, 255);
+    cv::Mat wide(HEIGHT, WIDTH + SHIFT, CV_8UC1);
+    for (int y = 0; y < wide.rows; ++y)
+      for (int x = 0; x < wide.cols; ++x)
+        wide.at<uint8_t>(y, x) = (uint8_t) byte(random_engine);
+
+    wide(cv::Rect(0, 0, WIDTH, HEIGHT)).copyTo(this->left);
+    wide(cv::Rect(SHIFT, 0, WIDTH, HEIGHT)).copyTo(this->right);
+  }
+};
+
+static LI_depth_config depth_config() {
+  LI_depth_config config;
+  config.num_disparities = 32;
+  config.block_size = 9;
+  return config;
+}
+
+// Share of the disparities (with their 4 fractional bits) within a pixel
+// of the expected one.
+static double share_near(const cv::Mat& disparity, int expected) {
+  if (disparity.empty())
+    return 0;
+
+  int hits = 0;
+  for (int y = 0; y < disparity.rows; ++y)
+    for (int x = 0; x < disparity.cols; ++x)
+      hits += std::abs(disparity.at<int16_t>(y, x) - 16 * expected) <= 16;
+  return (double) hits / disparity.total();
+}
+
+// Over the whole image, away from the edges the matcher cannot reach.
+static void test_shift() {
+  test_pair pair;
+  LI_depth_estimator estimator(depth_config());
+
+  cv::Mat disparity;
+  cv::Rect roi;
+  estimator.compute(pair.left, pair.right, disparity, roi);
+
+  CHECK(cv::Rect(0, 0, WIDTH, HEIGHT) == roi);
+  CHECK(cv::Size(WIDTH, HEIGHT) == disparity.size());
+  CHECK(CV_16S == disparity.type());
+
+  cv::Rect inner(32 + 8, 8, WIDTH - 32 - 16, HEIGHT - 16);
+  CHECK(0.95 <= share_near(disparity(inner), SHIFT));
+}
+
+// A region of interest is matched up to its edges, the images being
+// cropped around it with the margin the matching needs. Where the images
+// end, the margin does too.
+static void test_roi() {
+  test_pair pair;
+  LI_depth_config config = depth_config();
+  config.roi = cv::Rect(60, 40, 64, 32);
+  LI_depth_estimator estimator(config);
+
+  cv::Mat disparity;
+  cv::Rect roi;
+  estimator.compute(pair.left, pair.right, disparity, roi);
+
+  CHECK(config.roi == roi);
+  CHECK(roi.size() == disparity.size());
+  CHECK(0.99 <= share_near(disparity, SHIFT));
+
+  // Clipped to the images, and left without a margin on the left.
+  config.roi = cv::Rect(-10, 100, 64, 40);
+  LI_depth_estimator clipped(config);
+  clipped.compute(pair.left, pair.right, disparity, roi);
+
+  CHECK(cv::Rect(0, 100, 54, 20) == roi);
+  CHECK(roi.size() == disparity.size());
+}
+
+// Shrunk images: a map as many times smaller, with disparities in pixels
+// of the shrunk images, and the region in full resolution coordinates.
+static void test_downscale() {
+  test_pair pair;
+  LI_depth_config config = depth_config();
+  config.downscale = 2;
+  config.roi = cv::Rect(80, 40, 64, 32);
+  LI_depth_estimator estimator(config);
+  CHECK(2 == estimator.settings().downscale);
+
+  cv::Mat disparity;
+  cv::Rect roi;
+  estimator.compute(pair.left, pair.right, disparity, roi);
+
+  CHECK(config.roi == roi);
+  CHECK(cv::Size(32, 16) == disparity.size());
+  CHECK(0.95 <= share_near(disparity, SHIFT / 2));
+
+  // The stage tells the frames about it.
+  LI_depth_stage stage(config);
+  LI_stereo_frame frame;
+  frame.left = pair.left;
+  frame.right = pair.right;
+  CHECK(LI_SUCCESS == stage(frame));
+  CHECK(2 == frame.disparity_downscale);
+  CHECK(config.roi == frame.disparity_roi);
+  CHECK(cv::Size(32, 16) == frame.disparity.size());
+}
+
+// With motion gating, a frame where nothing moved gets the disparities of
+// the last frame that changed, whatever its images, shared rather than
+// copied. Frames matched later leave them as they were. Without gating,
+// every frame is matched.
+static void test_still_frames() {
+  test_pair pair;
+  LI_depth_stage stage(depth_config(), 2);
+
+  LI_stereo_frame moved;
+  moved.left = pair.left;
+  moved.right = pair.right;
+  moved.motion.grid = cv::Size(4, 3);
+  CHECK(LI_SUCCESS == stage(moved));
+  cv::Mat expected = moved.disparity.clone();
+
+  cv::Mat blank(HEIGHT, WIDTH, CV_8UC1, cv::Scalar(0));
+  LI_stereo_frame stills[2];
+  for (unsigned int worker = 0; worker < 2; ++worker) {
+    LI_stereo_frame& still = stills[worker];
+    still.left = blank;
+    still.right = blank;
+    still.motion.grid = cv::Size(4, 3);
+    still.motion.changed = false;
+    still.worker = worker;
+
+    CHECK(LI_SUCCESS == stage(still));
+    CHECK(expected.size() == still.disparity.size());
+    CHECK(0 == cv::norm(expected, still.disparity, cv::NORM_INF));
+    CHECK(moved.disparity_roi == still.disparity_roi);
+    CHECK(1 == still.disparity_downscale);
+  }
+  CHECK(stills[0].disparity.data == stills[1].disparity.data);
+
+  // The blank pair matched by the same worker, the still frames holding
+  // on to the disparities of the textured one.
+  moved.left = blank;
+  moved.right = blank;
+  CHECK(LI_SUCCESS == stage(moved));
+  CHECK(0 < cv::norm(expected, moved.disparity, cv::NORM_INF));
+  for (unsigned int worker = 0; worker < 2; ++worker)
+    CHECK(0 == cv::norm(expected, stills[worker].disparity, cv::NORM_INF));
+
+  // A worker the stage was not sized for is an error.
+  LI_stereo_frame other = moved;
+  other.worker = 2;
+  CHECK(LI_SUCCESS != stage(other));
+
+  // Not gated: the blank pair is matched, and found no disparity.
+  LI_depth_stage ungated(depth_config());
+  LI_stereo_frame still;
+  still.left = blank;
+  still.right = blank;
+  CHECK(LI_SUCCESS == ungated(still));
+  CHECK(0.5 > share_near(still.disparity, SHIFT));
+}
+
+int main() {
+  test_shift();
+  test_roi();
+  test_downscale();
+  test_still_frames();
+  return LI_test_result();
+}
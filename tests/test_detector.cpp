@@ -0,0 +1,149 @@
+#include <atomic>
+
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * The cascade models: a model that fails to load keeps failing until the
+ * paths change, and each failure is reported once. The faces are found
+ * whether or not the nested model loads. The parts needing a model that
+ * loads use LI_TEST_FACE_CASCADE, defined by CMakeLists.txt when OpenCV's
+ * own models are found.
+ */
+
+static const int WIDTH = 32;
+static const int HEIGHT = 24;
+
+static const char *MISSING = "/nonexistent/haarcascade_frontalface_alt.xml";
+static const char *MISSING_NESTED = "/nonexistent/haarcascade_eye_tree_eyeglasses.xml";
+
+static void test_sticky_failure() {
+  LI_cascade_models models(MISSING, "");
+  LI_detector detector;
+
+  CHECK(!detector.update(models));
+  CHECK(!detector.update(models));
+  CHECK(!detector.ready());
+  CHECK(models.version() == detector.version());
+
+  models.set(std::string(MISSING) + ".2", "");
+  CHECK(!detector.update(models));
+  CHECK(models.version() == detector.version());
+}
+
+static LI_config test_config(const std::string& face) {
+  LI_config config;
+  config.workers = 2;
+  config.overflow = LI_BLOCK;
+  config.face_cascade = face;
+  config.nested_cascade = "";
+  config.mode.width = WIDTH;
+  config.mode.height = HEIGHT;
+  return config;
+}
+
+// With no model to scan with, every frame fails, and is reported once.
+static void test_missing_model() {
+  LI_stereocamera camera(test_config(MISSING));
+
+  LI_test_frame frame(WIDTH, HEIGHT);
+  for (uint32_t i = 0; i < 6; ++i)
+    camera.push_frame(frame.get(i));
+
+  CHECK(LI_wait_for([&] { return 6 == camera.frame_stats().delivered; }));
+
+  LI_error_stats errors = camera.error_stats();
+  CHECK(6 == errors.count(LI_UNABLE_TO_LOAD_MODEL));
+  CHECK(6 == errors.total);
+}
+
+#ifdef LI_TEST_FACE_CASCADE
+// A swap to models that fail keeps the previous ones, and is reported
+// once per swap rather than per frame and worker.
+static void test_failed_swap(const std::string& face) {
+  LI_config config = test_config(face);
+  config.eager_load = true;
+
+  LI_stereocamera camera(config);
+  std::atomic<unsigned int> analysed(0);
+  camera.add_stage([&analysed](LI_stereo_frame&) {
+    ++analysed;
+    return LI_SUCCESS;
+  });
+
+  LI_test_frame frame(WIDTH, HEIGHT);
+  uint32_t sequence = 0;
+  auto push = [&](unsigned int count) {
+    unsigned long long delivered = camera.frame_stats().delivered;
+    for (unsigned int i = 0; i < count; ++i)
+      camera.push_frame(frame.get(sequence++));
+    CHECK(LI_wait_for([&] {
+      return delivered + count == camera.frame_stats().delivered;
+    }));
+  };
+
+  push(4);
+  CHECK(0 == camera.error_stats().total);
+
+  camera.set_cascades(MISSING, "");
+  push(8);
+  CHECK(1 == camera.error_stats().count(LI_UNABLE_TO_LOAD_MODEL));
+
+  camera.set_cascades(face, "");
+  push(4);
+  CHECK(1 == camera.error_stats().total);
+
+  camera.set_cascades(std::string(MISSING) + ".2", "");
+  push(4);
+  CHECK(2 == camera.error_stats().total);
+
+  // The faces were still looked for with the models kept.
+  CHECK(20 == analysed);
+}
+
+// The face detectors only load the face model, the nested one being left
+// to the eye detector: a nested model that does not load costs the eyes,
+// not the faces, and only when they are looked for.
+static void test_face_only(const std::string& face) {
+  LI_cascade_models models(face, MISSING_NESTED);
+
+  LI_detector detector;
+  CHECK(detector.update(models, false, true));
+  CHECK(detector.ready() && !detector.cascade.empty());
+  CHECK(detector.nested_cascade.empty());
+
+  LI_detector both, nested;
+  CHECK(!both.update(models));
+  CHECK(!nested.update(models, true));
+
+  // Parsed up front, with the eyes off, and then on.
+  LI_config config = test_config(face);
+  config.nested_cascade = MISSING_NESTED;
+  config.eager_load = true;
+
+  for (int eyes = 0; eyes < 2; ++eyes) {
+    config.eyes.enabled = (1 == eyes);
+    LI_stereocamera camera(config);
+    CHECK(eyes == (int) camera.error_stats().count(LI_UNABLE_TO_LOAD_MODEL));
+
+    LI_test_frame frame(WIDTH, HEIGHT);
+    for (uint32_t i = 0; i < 4; ++i)
+      camera.push_frame(frame.get(i));
+
+    CHECK(LI_wait_for([&] { return 4 == camera.frame_stats().delivered; }));
+    CHECK(eyes == (int) camera.error_stats().total);
+  }
+}
+#endif
+
+int main() {
+  test_sticky_failure();
+  test_missing_model();
+
+#ifdef LI_TEST_FACE_CASCADE
+  test_failed_swap(LI_TEST_FACE_CASCADE);
+  test_face_only(LI_TEST_FACE_CASCADE);
+#endif
+
+  return LI_test_result();
+}
@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * The error channel of the streaming path: errors hitting frames are
+ * counted per code and handed to the listeners, never thrown.
+ */
+
+static const int WIDTH = 64;
+static const int HEIGHT = 48;
+
+static LI_config test_config() {
+  LI_config config;
+  config.workers = 2;
+  config.face_detection = false;
+  config.overflow = LI_BLOCK;
+  config.mode.width = WIDTH;
+  config.mode.height = HEIGHT;
+  return config;
+}
+
+// The channel on its own: one counter per code, the codes past the last
+// one sharing a counter, and the last error kept.
+static void test_channel() {
+  LI_error_channel channel;
+
+  channel.record(LI_SUCCESS, 1);
+  CHECK(0 == channel.snapshot().total);
+
+  std::vector<LI_error_event> events;
+  unsigned int id = channel.subscribe([&events](const LI_error_event& event) {
+    events.push_back(event);
+  });
+
+  channel.record(LI_UNABLE_TO_CONVERT_FRAME, 3);
+  channel.record(LI_UNABLE_TO_CONVERT_FRAME, 4);
+  channel.record(LI_UNABLE_TO_LOAD_MODEL);
+  channel.record(LI_UNSPECIFIED, 5);
+  channel.record((LI_error_t) 50, 6);
+
+  LI_error_stats stats = channel.snapshot();
+  CHECK(5 == stats.total);
+  CHECK(2 == stats.count(LI_UNABLE_TO_CONVERT_FRAME));
+  CHECK(1 == stats.count(LI_UNABLE_TO_LOAD_MODEL));
+  CHECK(0 == stats.count(LI_NOT_CALIBRATED));
+  CHECK(2 == stats.count(LI_UNSPECIFIED));
+  CHECK(stats.count(LI_UNSPECIFIED) == stats.count((LI_error_t) 50));
+  CHECK((LI_error_t) 50 == stats.last.code && 6 == stats.last.sequence);
+
+  CHECK(5 == events.size());
+  if (5 == events.size()) {
+    CHECK(LI_UNABLE_TO_CONVERT_FRAME == events[0].code);
+    CHECK(3 == events[0].sequence && 4 == events[1].sequence);
+    CHECK(LI_UNABLE_TO_LOAD_MODEL == events[2].code && 0 == events[2].sequence);
+  }
+
+  // Unsubscribed listeners hear nothing more, and failing ones do not
+  // take the caller down.
+  channel.unsubscribe(id);
+  channel.subscribe([](const LI_error_event&) {
+    throw std::runtime_error("listener failure");
+  });
+  channel.record(LI_NOT_CALIBRATED, 7);
+  CHECK(5 == events.size());
+  CHECK(1 == channel.snapshot().count(LI_NOT_CALIBRATED));
+
+  channel.reset();
+  stats = channel.snapshot();
+  CHECK(0 == stats.total && 0 == stats.count(LI_UNABLE_TO_CONVERT_FRAME));
+  CHECK(LI_SUCCESS == stats.last.code);
+}
+
+// Errors of the camera, raised by its stages on the workers and by the
+// frame callback, reach the counters and the listeners with the sequence
+// number of the frame they hit.
+static void test_camera() {
+  LI_stereocamera camera(test_config());
+
+  std::mutex lock;
+  std::vector<uint32_t> failed;
+  unsigned int id = camera.subscribe_errors([&](const LI_error_event& event) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (LI_UNABLE_TO_LOAD_MODEL == event.code)
+      failed.push_back(event.sequence);
+  });
+
+  camera.add_stage([](LI_stereo_frame& frame) {
+    return (0 == frame.info.sequence % 3) ?
+      LI_UNABLE_TO_LOAD_MODEL : LI_SUCCESS;
+  });
+
+  LI_test_frame frame(WIDTH, HEIGHT);
+  for (uint32_t i = 1; i <= 12; ++i)
+    camera.push_frame(frame.get(i));
+
+  // A frame of the wrong size is turned away by the frame callback.
+  LI_test_frame wrong(WIDTH / 2, HEIGHT);
+  camera.push_frame(wrong.get(100));
+
+  CHECK(LI_wait_for([&camera] {
+    return 12 == camera.frame_stats().delivered;
+  }));
+
+  LI_error_stats stats = camera.error_stats();
+  CHECK(5 == stats.total);
+  CHECK(4 == stats.count(LI_UNABLE_TO_LOAD_MODEL));
+  CHECK(1 == stats.count(LI_UNABLE_TO_CONVERT_FRAME));
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    std::sort(failed.begin(), failed.end());
+    CHECK((std::vector<uint32_t> { 3, 6, 9, 12 }) == failed);
+  }
+
+  camera.unsubscribe_errors(id);
+  camera.reset_error_stats();
+  CHECK(0 == camera.error_stats().total);
+
+  camera.push_frame(frame.get(15));
+  CHECK(LI_wait_for([&camera] {
+    return 1 == camera.error_stats().count(LI_UNABLE_TO_LOAD_MODEL);
+  }));
+  CHECK(15 == camera.error_stats().last.sequence);
+
+  std::lock_guard<std::mutex> guard(lock);
+  CHECK(4 == failed.size());
+}
+
+int main() {
+  test_channel();
+  test_camera();
+  return LI_test_result();
+}
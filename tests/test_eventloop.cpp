@@ -0,0 +1,139 @@
+#include <chrono>
+#include <vector>
+
+#include <poll.h>
+
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * The events of a libusb context, on a context of the test's own: the
+ * descriptors of the poller become ready when the context has something
+ * to handle, and handling it makes them quiet again. The event thread
+ * stops without waiting for its timeout where libusb can interrupt it.
+ */
+
+// Polls the descriptors of the poller, returns how many are ready.
+static int ready(const LI_event_poller& poller, int timeout_ms) {
+  std::vector<libusb_pollfd> fds;
+  poller.fds(fds);
+
+  std::vector<struct pollfd> polled;
+  for (unsigned int i = 0; i < fds.size(); ++i) {
+    struct pollfd fd;
+    fd.fd = fds[i].fd;
+    fd.events = fds[i].events;
+    fd.revents = 0;
+    polled.push_back(fd);
+  }
+
+  if (polled.empty())
+    return 0;
+  return poll(&polled[0], polled.size(), timeout_ms);
+}
+
+// The descriptors are there to be polled, and quiet while nothing is
+// pending.
+static void test_fds(LI_event_poller& poller) {
+  std::vector<libusb_pollfd> fds;
+  poller.fds(fds);
+  CHECK(!fds.empty());
+
+  for (unsigned int i = 0; i < fds.size(); ++i) {
+    CHECK(0 <= fds[i].fd);
+    CHECK(0 != (fds[i].events & POLLIN));
+  }
+
+  CHECK(LIBUSB_SUCCESS == poller.handle());
+  CHECK(0 == ready(poller, 0));
+
+  // Without transfers under way there is no timeout to honour.
+  if (poller.supported())
+    CHECK(-1 == poller.timeout_ms());
+}
+
+// A pending event makes a descriptor ready, handle() consumes it.
+static void test_readiness(libusb_context *context, LI_event_poller& poller) {
+#if LIBUSB_API_VERSION >= 0x01000105
+  libusb_interrupt_event_handler(context);
+  CHECK(0 < ready(poller, 1000));
+
+  // libusb may tell the interruption apart.
+  int result = poller.handle();
+  CHECK(LIBUSB_SUCCESS == result || LIBUSB_ERROR_INTERRUPTED == result);
+  CHECK(0 == ready(poller, 0));
+#else
+  (void) context;
+  (void) poller;
+  std::cerr << "No libusb_interrupt_event_handler, readiness not tested\n";
+#endif
+}
+
+// The notifiers are the listener's while watched only, and a detached
+// poller has nothing to offer.
+static void test_watch(libusb_context *context, LI_event_poller& poller) {
+  int calls = 0;
+  poller.watch([&calls](int, short, bool) { ++calls; });
+  CHECK(LIBUSB_SUCCESS == poller.handle());
+  poller.unwatch();
+  CHECK(0 == calls);
+
+  poller.attach(NULL);
+  std::vector<libusb_pollfd> fds;
+  poller.fds(fds);
+  CHECK(fds.empty());
+  CHECK(0 > poller.handle());
+
+  poller.attach(context);
+  poller.fds(fds);
+  CHECK(!fds.empty());
+}
+
+// The thread runs until stopped, once at a time.
+static void test_thread(libusb_context *context) {
+  LI_event_config config;
+  config.timeout_ms = 2000;
+
+  LI_event_thread thread;
+  CHECK(!thread.is_running());
+  CHECK(thread.start(context, config));
+  CHECK(thread.is_running());
+  CHECK(!thread.start(context, config));
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  thread.stop();
+  CHECK(!thread.is_running());
+
+#if LIBUSB_API_VERSION >= 0x01000105
+  CHECK(std::chrono::steady_clock::now() - start <
+    std::chrono::milliseconds(config.timeout_ms / 2));
+#else
+  (void) start;
+#endif
+
+  // And may be started again.
+  CHECK(thread.start(context, config));
+  thread.stop();
+  CHECK(!thread.is_running());
+}
+
+int main() {
+  libusb_context *context = NULL;
+  if (LIBUSB_SUCCESS != libusb_init(&context)) {
+    std::cerr << "No libusb context\n";
+    return LI_TEST_SKIPPED;
+  }
+
+  {
+    LI_event_poller poller(context);
+    test_fds(poller);
+    test_readiness(context, poller);
+    test_watch(context, poller);
+  }
+  test_thread(context);
+
+  libusb_exit(context);
+  return LI_test_result();
+}
@@ -0,0 +1,191 @@
+#include <thread>
+#include <vector>
+
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * The eye detection: the faces picked are the largest ones, and the eyes
+ * found are handed to the faces in slot order, whichever pool thread ran
+ * which scan. The scans themselves need the nested model, given by
+ * LI_TEST_EYE_CASCADE when CMakeLists.txt finds OpenCV's own models.
+ */
+
+static const int WIDTH = 640;
+static const int HEIGHT = 360;
+
+static const char *MISSING = "/nonexistent/haarcascade_eye.xml";
+
+// A cartoon face: a lighter oval with two eyes under their brows.
+static void draw_face(cv::Mat& image, const cv::Rect& box) {
+  cv::Point centre(box.x + box.width / 2, box.y + box.height / 2);
+  cv::ellipse(image, centre, cv::Size(box.width * 2 / 5, box.height / 2),
+    0, 0, 360, cv::Scalar(170), -1);
+
+  int unit = box.width / 10;
+  for (int side = -1; side <= 1; side += 2) {
+    cv::Point eye(centre.x + side * 2 * unit, centre.y - unit);
+    cv::line(image, eye + cv::Point(-unit, -unit * 3 / 2),
+      eye + cv::Point(unit, -unit * 3 / 2), cv::Scalar(60), unit / 2 + 1);
+    cv::ellipse(image, eye, cv::Size(unit, unit / 2 + 1), 0, 0, 360,
+      cv::Scalar(230), -1);
+    cv::circle(image, eye, unit / 2 + 1, cv::Scalar(40), -1);
+    cv::circle(image, eye, unit / 4 + 1, cv::Scalar(10), -1);
+  }
+}
+
+// Faces of various sizes over both images, the right ones 12 pixels to the
+// left. The last one is only seen in the left image.
+struct test_scene {
+  cv::Mat left, right;
+  std::vector<LI_face> faces;
+
+  test_scene() :
+    left(HEIGHT, WIDTH, CV_8UC1, cv::Scalar(90)),
+    right(HEIGHT, WIDTH, CV_8UC1, cv::Scalar(90)) {
+
+    const int sizes[] = { 100, 140, 120, 90, 160, 110 };
+    for (int i = 0; i < 6; ++i) {
+      LI_face face;
+      face.left = cv::Rect(20 + 200 * (i % 3), 10 + 180 * (i / 3),
+        sizes[i], sizes[i]);
+      face.right = face.left - cv::Point(12, 0);
+      if (5 == i)
+        face.right = cv::Rect();
+
+      draw_face(this->left, face.left);
+      if (!face.right.empty())
+        draw_face(this->right, face.right);
+      this->faces.push_back(face);
+    }
+  }
+};
+
+// Eyes left over from a previous frame, to tell the faces scanned from
+// those left alone.
+static void mark(std::vector<LI_face>& faces) {
+  for (unsigned int i = 0; i < faces.size(); ++i) {
+    faces[i].left_eyes.assign(1, cv::Rect(0, 0, 1, 1));
+    faces[i].right_eyes.assign(1, cv::Rect(0, 0, 1, 1));
+  }
+}
+
+// The largest max_faces faces are picked (ties to the first ones), the
+// others keep their eyes. Without the nested model no eyes are found.
+static void test_selection() {
+  test_scene scene;
+  scene.faces[3].left = scene.faces[0].left;
+
+  LI_cascade_models models("", MISSING);
+  LI_eye_detector detector;
+  LI_eye_scratch scratch;
+
+  LI_eye_config config;
+  config.enabled = true;
+  config.max_faces = 3;
+
+  mark(scene.faces);
+  CHECK(!detector.detect(models, config, scene.left, scene.right,
+    scene.faces, scratch, LI_PARALLEL_NONE, NULL));
+
+  // Faces 4, 1 and 2 are the largest, before 5 and then 0 and 3 (which
+  // tie).
+  const bool picked[] = { false, true, true, false, true, false };
+  for (unsigned int i = 0; i < scene.faces.size(); ++i) {
+    CHECK(picked[i] == scene.faces[i].left_eyes.empty());
+    CHECK(picked[i] == scene.faces[i].right_eyes.empty());
+  }
+
+  // Then 5, and 0 before 3.
+  config.max_faces = 5;
+  mark(scene.faces);
+  detector.detect(models, config, scene.left, scene.right,
+    scene.faces, scratch, LI_PARALLEL_NONE, NULL);
+  CHECK(scene.faces[0].left_eyes.empty());
+  CHECK(!scene.faces[3].left_eyes.empty());
+
+  // One slot per box, the one missing from the right image excepted.
+  config.max_faces = 0;
+  detector.detect(models, config, scene.left, scene.right,
+    scene.faces, scratch, LI_PARALLEL_NONE, NULL);
+  CHECK(11 <= scratch.scans.size());
+}
+
+#ifdef LI_TEST_EYE_CASCADE
+static bool inside(const std::vector<cv::Rect>& eyes, const cv::Rect& face) {
+  for (unsigned int i = 0; i < eyes.size(); ++i)
+    if ((eyes[i] & face) != eyes[i])
+      return false;
+  return true;
+}
+
+static bool same_eyes(
+  const std::vector<LI_face>& a, const std::vector<LI_face>& b) {
+  bool same = a.size() == b.size();
+  for (unsigned int i = 0; same && i < a.size(); ++i)
+    same = a[i].left_eyes == b[i].left_eyes &&
+      a[i].right_eyes == b[i].right_eyes;
+  return same;
+}
+
+// Spread over a pool, from two callers at a time, the scans give the
+// faces the eyes a serial run gives them.
+static void test_slot_order(const std::string& nested) {
+  test_scene scene;
+  LI_cascade_models models("", nested);
+
+  LI_eye_config config;
+  config.enabled = true;
+  config.max_faces = 0;
+
+  std::vector<LI_face> expected = scene.faces;
+  {
+    LI_eye_detector detector;
+    LI_eye_scratch scratch;
+    CHECK(detector.detect(models, config, scene.left, scene.right,
+      expected, scratch, LI_PARALLEL_NONE, NULL));
+    CHECK(1 == detector.classifiers());
+  }
+
+  unsigned int found = 0;
+  for (unsigned int i = 0; i < expected.size(); ++i) {
+    CHECK(inside(expected[i].left_eyes, expected[i].left));
+    CHECK(inside(expected[i].right_eyes, expected[i].right));
+    found += (unsigned int) (expected[i].left_eyes.size() +
+      expected[i].right_eyes.size());
+  }
+  if (0 == found)
+    std::cerr << "No eyes found in the synthetic faces, the order was only "
+      "checked on empty results\n";
+
+  LI_threadpool pool(4);
+  LI_eye_detector detector;
+
+  auto caller = [&]() {
+    LI_eye_scratch scratch;
+    for (int run = 0; run < 20; ++run) {
+      std::vector<LI_face> faces = scene.faces;
+      mark(faces);
+      CHECK(detector.detect(models, config, scene.left, scene.right,
+        faces, scratch, LI_PARALLEL_THREADS, &pool));
+      CHECK(same_eyes(expected, faces));
+    }
+  };
+
+  std::thread other(caller);
+  caller();
+  other.join();
+
+  // The stock only grows up to the scans running at the same time.
+  CHECK(1 <= detector.classifiers());
+  CHECK(2 * 11 >= detector.classifiers());
+}
+#endif
+
+int main() {
+  test_selection();
+#ifdef LI_TEST_EYE_CASCADE
+  test_slot_order(LI_TEST_EYE_CASCADE);
+#endif
+  return LI_test_result();
+}
@@ -0,0 +1,199 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * The frame pools: recycling buffers must not allocate, and neither must
+ * the pipeline once it is warmed up (synthetic YUYV frames are pushed
+ * through it). A pool running dry must count the frames it drops rather
+ * than grow.
+ */
+
+// Every heap allocation of the program, on any thread. Not inlined, so
+// that the compiler does not pair new expressions with free().
+static std::atomic<unsigned long long> heap_allocations(0);
+
+__attribute__((noinline))
+void* operator new(std::size_t size) {
+  ++heap_allocations;
+
+  void *memory = std::malloc((0 == size) ? 1 : size);
+  if (NULL == memory)
+    throw std::bad_alloc();
+  return memory;
+}
+
+__attribute__((noinline))
+void operator delete(void *memory) noexcept {
+  std::free(memory);
+}
+
+static const int WIDTH = 64;
+static const int HEIGHT = 48;
+
+// The pool on its own: aligned planes, one allocation for its lifetime,
+// and NULL (counted) once every buffer is out.
+static void test_pool() {
+  const unsigned int capacity = 4;
+
+  LI_framepool pool;
+  CHECK(pool.allocate(capacity, WIDTH, HEIGHT));
+
+  // Sizing it again for the same frames keeps the buffers.
+  CHECK(pool.allocate(capacity, WIDTH, HEIGHT));
+
+  LI_pool_stats initial = pool.stats();
+  CHECK(capacity == initial.capacity && capacity == initial.available);
+  CHECK(1 == initial.allocations && 0 == initial.exhausted);
+
+  LI_framebuffer *buffers[capacity];
+  for (unsigned int i = 0; i < capacity; ++i) {
+    buffers[i] = pool.acquire();
+    CHECK(NULL != buffers[i]);
+    if (NULL == buffers[i])
+      return;
+
+    CHECK(WIDTH == buffers[i]->width && HEIGHT == buffers[i]->height);
+    for (unsigned int p = 0; p < 2; ++p)
+      CHECK(0 == (uintptr_t) buffers[i]->plane[p] % LI_framepool::ALIGNMENT);
+  }
+
+  CHECK(NULL == pool.acquire());
+  CHECK(NULL == pool.acquire());
+
+  LI_pool_stats starved = pool.stats();
+  CHECK(0 == starved.available && 2 == starved.exhausted);
+
+  for (unsigned int i = 0; i < capacity; ++i)
+    pool.release(buffers[i]);
+  CHECK(capacity == pool.stats().available);
+
+  // Recycling the buffers takes nothing from the heap.
+  unsigned long long before = heap_allocations.load();
+
+  for (int i = 0; i < 1000; ++i) {
+    LI_framebuffer *buffer = pool.acquire();
+    CHECK(NULL != buffer);
+    pool.release(buffer);
+  }
+
+  CHECK(before == heap_allocations.load());
+  CHECK(1 == pool.stats().allocations);
+  CHECK(2 == pool.stats().exhausted);
+}
+
+static LI_config test_config() {
+  LI_config config;
+  config.face_detection = false;
+  config.overflow = LI_BLOCK;
+  config.mode.width = WIDTH;
+  config.mode.height = HEIGHT;
+  return config;
+}
+
+static LI_error_t count_frame(LI_stereo_frame& frame) {
+  return (WIDTH == frame.left.cols && HEIGHT == frame.right.rows) ?
+    LI_SUCCESS : LI_UNSPECIFIED;
+}
+
+static void test_no_allocation_per_frame() {
+  LI_config config = test_config();
+  config.grab_handles = 0;
+
+  LI_stereocamera camera(config);
+  camera.add_stage(count_frame);
+
+  CHECK(1 == camera.pool_stats(LI_STAGE_CONVERT).allocations);
+  CHECK(1 == camera.pool_stats(LI_STAGE_ANALYSE).allocations);
+
+  LI_test_frame frame(WIDTH, HEIGHT, 16, 32);
+  uint32_t sequence = 0;
+
+  // The first frames size whatever the workers keep from frame to frame.
+  for (int i = 0; i < 20; ++i)
+    camera.push_frame(frame.get(sequence++));
+  CHECK(LI_wait_for([&] { return 20 == camera.frame_stats().delivered; }));
+
+  // Polled by hand, so that the test itself does not allocate meanwhile.
+  unsigned long long before = heap_allocations.load();
+
+  for (int i = 0; i < 200; ++i)
+    camera.push_frame(frame.get(sequence++));
+
+  std::chrono::steady_clock::time_point deadline =
+    std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (220 != camera.frame_stats().delivered &&
+         std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  unsigned long long after = heap_allocations.load();
+
+  CHECK(220 == camera.frame_stats().delivered);
+  CHECK(before == after);
+
+  for (int stage = LI_STAGE_CONVERT; stage <= LI_STAGE_ANALYSE; ++stage) {
+    LI_pool_stats pool = camera.pool_stats((LI_stage_t) stage);
+    CHECK(1 == pool.allocations);
+    CHECK(0 == pool.exhausted);
+  }
+  CHECK(0 == camera.dropped_frames());
+  CHECK(0 == camera.error_stats().total);
+}
+
+static void test_exhaustion() {
+  LI_config config = test_config();
+  config.workers = 1;
+  config.grab_handles = 1;
+
+  LI_stereocamera camera(config);
+
+  LI_pool_stats initial = camera.pool_stats(LI_STAGE_ANALYSE);
+  CHECK(0 < initial.capacity);
+  CHECK(initial.capacity == initial.available);
+
+  // Holding on to every frame grabbed starves the pool, which then drops
+  // the frames instead of allocating more buffers.
+  LI_test_frame frame(WIDTH, HEIGHT);
+  std::vector<LI_frame_handle> held;
+
+  for (unsigned int i = 0; i < initial.capacity + 4; ++i) {
+    camera.push_frame(frame.get(i));
+    CHECK(LI_wait_for([&] {
+      return i + 1 == camera.grab_stats().offered +
+        camera.pool_stats(LI_STAGE_ANALYSE).exhausted;
+    }));
+
+    LI_frame_handle handle;
+    if (camera.try_grab(handle))
+      held.push_back(handle);
+  }
+
+  LI_pool_stats starved = camera.pool_stats(LI_STAGE_ANALYSE);
+  CHECK(0 < starved.exhausted);
+  CHECK(0 == starved.available);
+  CHECK(initial.capacity == starved.capacity);
+  CHECK(1 == starved.allocations);
+  CHECK(starved.exhausted == camera.dropped_frames());
+
+  // Every frame offered was grabbed, so once the handles are released all
+  // the buffers are back in the pool, and frames go through again.
+  held.clear();
+  CHECK(initial.capacity == camera.pool_stats(LI_STAGE_ANALYSE).available);
+
+  unsigned long long offered = camera.grab_stats().offered;
+  camera.push_frame(frame.get(initial.capacity + 4));
+  CHECK(LI_wait_for([&] {
+    return offered + 1 == camera.grab_stats().offered;
+  }));
+  CHECK(1 == camera.pool_stats(LI_STAGE_ANALYSE).allocations);
+}
+
+int main() {
+  test_pool();
+  test_no_allocation_per_frame();
+  test_exhaustion();
+  return LI_test_result();
+}
@@ -0,0 +1,264 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * Pulling frames with grab(): the latest frame wins, a held handle pins
+ * its pooled buffer until released, and the images handed out are those
+ * the stages left, rectified ones included. Rectified images are handed
+ * out as they are, not copied, and recycled while nobody grabs them.
+ */
+
+static const int WIDTH = 64;
+static const int HEIGHT = 48;
+
+static LI_config test_config() {
+  LI_config config;
+  config.workers = 1;
+  config.face_detection = false;
+  config.overflow = LI_BLOCK;
+  config.mode.width = WIDTH;
+  config.mode.height = HEIGHT;
+  config.grab_handles = 2;
+  return config;
+}
+
+static bool uniform(const cv::Mat& image, int value) {
+  return !image.empty() && 0 == cv::countNonZero(image != value);
+}
+
+static void push(LI_stereocamera& camera, LI_test_frame& frame,
+  uint32_t first, uint32_t last) {
+
+  unsigned long long delivered = camera.frame_stats().delivered;
+  for (uint32_t i = first; i <= last; ++i) {
+    frame.fill((uint8_t) (10 * i), (uint8_t) (100 + 10 * i));
+    camera.push_frame(frame.get(i));
+  }
+
+  CHECK(LI_wait_for([&camera, delivered, first, last] {
+    return delivered + last - first + 1 == camera.frame_stats().delivered;
+  }));
+}
+
+// Waits for the buffers of the frames through the stages to be back in
+// the pool, but for 'held' ones.
+static bool pool_holds(LI_stereocamera& camera, unsigned int held) {
+  return LI_wait_for([&camera, held] {
+    LI_pool_stats stats = camera.pool_stats(LI_STAGE_ANALYSE);
+    return stats.available + held == stats.capacity;
+  });
+}
+
+// A held handle keeps its images while newer frames come and go, and its
+// buffer goes back to the pool with the last copy of the handle.
+static void test_handles() {
+  LI_stereocamera camera(test_config());
+  LI_test_frame frame(WIDTH, HEIGHT);
+
+  LI_frame_handle first;
+  CHECK(!camera.try_grab(first) && first.empty());
+
+  push(camera, frame, 1, 1);
+  CHECK(camera.try_grab(first));
+  CHECK(1 == first.info.sequence);
+  CHECK(uniform(first.left, 10) && uniform(first.right, 110));
+
+  // Nothing new since.
+  LI_frame_handle second;
+  CHECK(!camera.try_grab(second) && second.empty());
+  CHECK(pool_holds(camera, 1));
+
+  push(camera, frame, 2, 6);
+  CHECK(uniform(first.left, 10) && uniform(first.right, 110));
+
+  CHECK(camera.try_grab(second));
+  CHECK(6 == second.info.sequence);
+  CHECK(uniform(second.left, 60) && uniform(second.right, 160));
+  CHECK(first.left.data != second.left.data);
+
+  LI_grab_stats stats = camera.grab_stats();
+  CHECK(6 == stats.offered && 2 == stats.grabbed && 4 == stats.overwritten);
+  CHECK(0 == stats.unavailable);
+
+  CHECK(pool_holds(camera, 2));
+  first.release();
+  CHECK(first.empty() && first.left.empty());
+  CHECK(pool_holds(camera, 1));
+
+  LI_frame_handle copy = second;
+  second.release();
+  CHECK(pool_holds(camera, 1));
+  CHECK(uniform(copy.left, 60));
+  copy.release();
+  CHECK(pool_holds(camera, 0));
+
+  // Grabbing anew empties the handle when nothing came.
+  CHECK(camera.try_grab(first) == false && first.empty());
+}
+
+// grab() waits for the next frame, up to its timeout.
+static void test_wait() {
+  LI_stereocamera camera(test_config());
+  LI_test_frame frame(WIDTH, HEIGHT);
+  LI_frame_handle handle;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  CHECK(!camera.grab(handle, std::chrono::milliseconds(50)));
+  CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(50));
+
+  std::thread pusher([&camera, &frame] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    frame.fill(70, 170);
+    camera.push_frame(frame.get(7));
+  });
+  CHECK(camera.grab(handle, std::chrono::milliseconds(5000)));
+  CHECK(7 == handle.info.sequence && uniform(handle.left, 70));
+  pusher.join();
+
+  // Without handles there is nothing to grab.
+  LI_config config = test_config();
+  config.grab_handles = 0;
+  LI_stereocamera headless(config);
+  push(headless, frame, 1, 1);
+  CHECK(!headless.try_grab(handle) && handle.empty());
+}
+
+// Images a stage replaced are handed out in place of the converted ones,
+// still from the pooled buffer. Images of another size cannot be.
+static void test_replaced_images() {
+  LI_stereocamera camera(test_config());
+  cv::Mat left(HEIGHT, WIDTH, CV_8UC1, cv::Scalar(77));
+  cv::Mat right(HEIGHT, WIDTH, CV_8UC1, cv::Scalar(177));
+  std::atomic<bool> shrink(false);
+
+  camera.add_stage([&](LI_stereo_frame& frame) {
+    frame.left = shrink ? left(cv::Rect(0, 0, WIDTH / 2, HEIGHT)) : left;
+    frame.right = right;
+    return LI_SUCCESS;
+  });
+
+  LI_test_frame frame(WIDTH, HEIGHT);
+  push(camera, frame, 1, 1);
+
+  LI_frame_handle handle;
+  CHECK(camera.try_grab(handle));
+  CHECK(uniform(handle.left, 77) && uniform(handle.right, 177));
+  CHECK(handle.left.data != left.data && handle.right.data != right.data);
+  handle.release();
+
+  shrink = true;
+  push(camera, frame, 2, 2);
+  CHECK(!camera.try_grab(handle));
+  CHECK(1 == camera.grab_stats().unavailable);
+  CHECK(1 == camera.grab_stats().offered);
+}
+
+// With a calibration loaded, the frames grabbed are rectified, in the very
+// images the stages saw. Frames nobody grabs leave their images to the
+// next ones, while a held handle keeps its own.
+static void test_rectified() {
+  std::string path = "test_grab_calibration.yml";
+  {
+    cv::FileStorage storage(path, cv::FileStorage::WRITE);
+    cv::Mat M = (cv::Mat_<double>(3, 3) <<
+      WIDTH, 0, WIDTH / 2.0, 0, WIDTH, HEIGHT / 2.0, 0, 0, 1);
+    storage << "M1" << M << "M2" << M;
+    storage << "D1" << (cv::Mat_<double>(1, 5) << -0.3, 0.1, 0, 0, 0);
+    storage << "D2" << (cv::Mat_<double>(1, 5) << 0.2, 0, 0, 0, 0);
+    storage << "R" << cv::Mat::eye(3, 3, CV_64F);
+    storage << "T" << (cv::Mat_<double>(3, 1) << -1, 0, 0);
+    storage << "image_width" << WIDTH << "image_height" << HEIGHT;
+  }
+
+  // Gradients, for the rectification to move something.
+  LI_test_frame frame(WIDTH, HEIGHT);
+  cv::Mat raw[2] = {
+    cv::Mat(HEIGHT, WIDTH, CV_8UC1), cv::Mat(HEIGHT, WIDTH, CV_8UC1)
+  };
+  for (int y = 0; y < HEIGHT; ++y)
+    for (int x = 0; x < WIDTH; ++x) {
+      raw[0].at<uint8_t>(y, x) = (uint8_t) (4 * x + y);
+      raw[1].at<uint8_t>(y, x) = (uint8_t) (2 * x + 3 * y);
+      frame.set(x, y, raw[0].at<uint8_t>(y, x), raw[1].at<uint8_t>(y, x));
+    }
+
+  LI_rectifier rectifier;
+  CHECK(rectifier.load(path) && rectifier.prepare(cv::Size(WIDTH, HEIGHT)));
+  cv::Mat expected[2];
+  for (int eye = 0; eye < 2; ++eye) {
+    rectifier.remap(eye, raw[eye], expected[eye]);
+    CHECK(0 < cv::norm(raw[eye], expected[eye], cv::NORM_INF));
+  }
+
+  LI_config config = test_config();
+  config.calibration = path;
+  LI_stereocamera camera(config);
+
+  std::mutex lock;
+  std::set<const uint8_t*> seen;
+  camera.add_stage([&](LI_stereo_frame& frame) {
+    std::lock_guard<std::mutex> guard(lock);
+    seen.insert(frame.left.data);
+    return LI_SUCCESS;
+  });
+
+  // Pushed as they are, where push() would fill them, and waited for
+  // until offered to grab().
+  auto push_as_is = [&](uint32_t first, uint32_t last) {
+    for (uint32_t i = first; i <= last; ++i)
+      camera.push_frame(frame.get(i));
+    CHECK(LI_wait_for([&camera, last] {
+      return last == camera.grab_stats().offered;
+    }));
+  };
+
+  // Not grabbed: two pairs of images go round, the one waiting to be
+  // grabbed and the one the worker rectifies into.
+  push_as_is(1, 6);
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    CHECK(2 == seen.size());
+    seen.clear();
+  }
+
+  LI_frame_handle handle;
+  CHECK(camera.try_grab(handle));
+  CHECK(0 == camera.error_stats().count(LI_NOT_CALIBRATED));
+  CHECK(6 == handle.info.sequence);
+
+  if (!handle.empty()) {
+    CHECK(0 == cv::norm(handle.left, expected[0], cv::NORM_INF));
+    CHECK(0 == cv::norm(handle.right, expected[1], cv::NORM_INF));
+  }
+
+  // The held images are not rectified into again.
+  frame.fill(0, 0);
+  push_as_is(7, 10);
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    CHECK(0 == seen.count(handle.left.data));
+  }
+  CHECK(0 == cv::norm(handle.left, expected[0], cv::NORM_INF));
+  CHECK(0 == cv::norm(handle.right, expected[1], cv::NORM_INF));
+
+  LI_frame_handle next;
+  CHECK(camera.try_grab(next));
+  CHECK(10 == next.info.sequence && uniform(next.left, 0));
+
+  std::remove(path.c_str());
+}
+
+int main() {
+  test_handles();
+  test_wait();
+  test_replaced_images();
+  test_rectified();
+  return LI_test_result();
+}
@@ -0,0 +1,126 @@
+#include <chrono>
+
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * The hotplug events, injected with simulate_hotplug(): those of other
+ * devices are ignored, and those of the camera are handed to the
+ * reconnector thread rather than handled within the callback. Without an
+ * LI Stereo Camera plugged in, the reconnection itself is not exercised.
+ */
+
+static LI_config test_config() {
+  LI_config config;
+  config.face_detection = false;
+  config.overflow = LI_BLOCK;
+  config.mode.width = 64;
+  config.mode.height = 48;
+  return config;
+}
+
+// An event must be posted, not handled, by the callback: connecting takes
+// far longer than this.
+static const std::chrono::milliseconds CALLBACK_BUDGET(50);
+
+static bool simulate(LI_stereocamera& camera, libusb_device *device, bool arrived) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  camera.simulate_hotplug(device, arrived);
+  return std::chrono::steady_clock::now() - start < CALLBACK_BUDGET;
+}
+
+// The devices on the buses which are not LI Stereo Cameras (hubs, most
+// likely) come and go without the camera noticing.
+static void test_foreign_devices(LI_stereocamera& camera) {
+  libusb_context *context = NULL;
+  if (LIBUSB_SUCCESS != libusb_init(&context)) {
+    std::cerr << "No USB buses, foreign devices not tested\n";
+    return;
+  }
+
+  libusb_device **devices = NULL;
+  ssize_t count = libusb_get_device_list(context, &devices);
+  bool connected = camera.is_connected();
+  unsigned int foreign = 0;
+
+  for (ssize_t i = 0; i < count; ++i) {
+    libusb_device_descriptor descriptor;
+    if (LIBUSB_SUCCESS != libusb_get_device_descriptor(devices[i], &descriptor) ||
+        (0x2A0B == descriptor.idVendor && 0x00F5 == descriptor.idProduct))
+      continue;
+
+    LI_connection_stats before = camera.connection_stats();
+    CHECK(simulate(camera, devices[i], false));
+    CHECK(simulate(camera, devices[i], true));
+
+    LI_connection_stats after = camera.connection_stats();
+    CHECK(before.arrivals == after.arrivals);
+    CHECK(before.departures == after.departures);
+    CHECK(before.connections == after.connections);
+    ++foreign;
+  }
+
+  // A foreign arrival must not open another camera, nor a departure close
+  // ours.
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  CHECK(connected == camera.is_connected());
+
+  if (0 == foreign)
+    std::cerr << "No foreign USB devices, none tested\n";
+
+  if (count > 0)
+    libusb_free_device_list(devices, 1);
+  libusb_exit(context);
+}
+
+// The camera leaving and coming back: both events are counted as they are
+// posted, and handled on the reconnector thread.
+static void test_reconnect(LI_stereocamera& camera) {
+  bool plugged = camera.is_connected();
+  LI_connection_stats before = camera.connection_stats();
+
+  CHECK(simulate(camera, NULL, false));
+  CHECK(before.departures + 1 == camera.connection_stats().departures);
+  CHECK(LI_wait_for([&camera] { return !camera.is_connected(); }));
+
+  CHECK(simulate(camera, NULL, true));
+  CHECK(before.arrivals + 1 == camera.connection_stats().arrivals);
+
+  if (!plugged) {
+    // The scan finds nothing to connect to.
+    CHECK(!LI_wait_for([&camera] { return camera.is_connected(); },
+      std::chrono::milliseconds(200)));
+    CHECK(before.connections == camera.connection_stats().connections);
+    return;
+  }
+
+  CHECK(LI_wait_for([&camera] { return camera.is_connected(); }));
+  CHECK(before.connections + 1 == camera.connection_stats().connections);
+  CHECK(LI_wait_for([&camera, &before] {
+    return before.first_frames < camera.connection_stats().first_frames;
+  }));
+}
+
+// The pipeline goes on through the events, with the frames of the camera
+// if it is back, or with frames pushed.
+static void test_pipeline_survives(LI_stereocamera& camera) {
+  LI_test_frame frame(64, 48);
+  unsigned long long delivered = camera.frame_stats().delivered;
+
+  if (!camera.is_connected())
+    camera.push_frame(frame.get(1000));
+  CHECK(LI_wait_for([&camera, delivered] {
+    return camera.frame_stats().delivered > delivered;
+  }));
+}
+
+int main() {
+  LI_stereocamera camera(test_config());
+  if (!camera.is_connected())
+    std::cerr << "No LI Stereo Camera, reconnection not tested\n";
+
+  test_foreign_devices(camera);
+  test_reconnect(camera);
+  test_pipeline_survives(camera);
+  return LI_test_result();
+}
@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <cstring>
+
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * The camera manager: cameras are told apart by their serial numbers, so
+ * devices without one are left alone, and the cameras sharing its
+ * context leave its events to it. No camera needs to be plugged in, the
+ * device descriptors are simulated.
+ */
+
+static LI_config test_config() {
+  LI_config config;
+  config.face_detection = false;
+  config.overflow = LI_BLOCK;
+  config.mode.width = 64;
+  config.mode.height = 48;
+  return config;
+}
+
+static uvc_device_descriptor descriptor(
+  uint16_t vendor, uint16_t product, const char *serial) {
+
+  uvc_device_descriptor result;
+  std::memset(&result, 0, sizeof(result));
+  result.idVendor = vendor;
+  result.idProduct = product;
+  result.serialNumber = serial;
+  return result;
+}
+
+// Only LI Stereo Cameras with a serial number are managed.
+static void test_serials() {
+  std::string serial = "unchanged";
+
+  uvc_device_descriptor camera = descriptor(0x2A0B, 0x00F5, "LI0042");
+  CHECK(LI_camera_manager::camera_serial(&camera, serial));
+  CHECK("LI0042" == serial);
+
+  uvc_device_descriptor anonymous = descriptor(0x2A0B, 0x00F5, NULL);
+  CHECK(!LI_camera_manager::camera_serial(&anonymous, serial));
+
+  uvc_device_descriptor empty = descriptor(0x2A0B, 0x00F5, "");
+  CHECK(!LI_camera_manager::camera_serial(&empty, serial));
+
+  uvc_device_descriptor webcam = descriptor(0x046D, 0x0825, "LI0042");
+  CHECK(!LI_camera_manager::camera_serial(&webcam, serial));
+
+  uvc_device_descriptor other = descriptor(0x2A0B, 0x00F6, "LI0042");
+  CHECK(!LI_camera_manager::camera_serial(&other, serial));
+}
+
+// Cameras are created once per serial number, never for an empty one
+// (which would stand for any camera).
+static void test_cameras(LI_camera_manager& manager) {
+  CHECK(NULL == manager.add_camera(""));
+  CHECK(NULL == manager.camera(""));
+
+  LI_stereocamera *a = manager.add_camera("A");
+  LI_stereocamera *b = manager.add_camera("B");
+  CHECK(NULL != a && NULL != b && a != b);
+  if (NULL == a || NULL == b)
+    return;
+
+  CHECK(a == manager.add_camera("A"));
+  CHECK(a == manager.camera("A"));
+  CHECK("A" == a->serial_number() && "B" == b->serial_number());
+
+  std::vector<std::string> serials = manager.serials();
+  CHECK(1 == std::count(serials.begin(), serials.end(), "A"));
+  CHECK(1 == std::count(serials.begin(), serials.end(), "B"));
+  CHECK(0 == std::count(serials.begin(), serials.end(), ""));
+
+  // Each camera has a pipeline of its own.
+  LI_test_frame frame(64, 48);
+  a->push_frame(frame.get(0));
+  CHECK(LI_wait_for([a] { return 1 == a->frame_stats().delivered; }));
+  CHECK(0 == b->frame_stats().delivered);
+}
+
+// The events of the shared context are the manager's: the pollers of its
+// cameras are detached, so that watching them (or destroying them) leaves
+// the manager's notifiers alone.
+static void test_shared_poller(LI_camera_manager& manager) {
+  LI_stereocamera *camera = manager.add_camera("C");
+  CHECK(NULL != camera);
+  if (NULL == camera)
+    return;
+
+  LI_event_poller& poller = camera->event_poller();
+  CHECK(!poller.supported());
+  CHECK(-1 == poller.timeout_ms());
+  CHECK(0 > poller.handle());
+
+  std::vector<libusb_pollfd> fds;
+  poller.fds(fds);
+  CHECK(fds.empty());
+
+  bool called = false;
+  poller.watch([&called](int, short, bool) { called = true; });
+  poller.unwatch();
+  CHECK(!called);
+}
+
+int main() {
+  test_serials();
+
+  LI_camera_manager manager(test_config());
+  test_cameras(manager);
+  test_shared_poller(manager);
+  return LI_test_result();
+}
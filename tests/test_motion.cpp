@@ -0,0 +1,262 @@
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * The motion gating: frames where nothing moved since the last frame
+ * analysed are skipped, a tile that moved in either image gets the frame
+ * analysed, and so does a frame after 'refresh' skipped ones. Every SAD
+ * kernel the CPU supports sums as the scalar one does. The faces lent to
+ * skipped frames are checked with LI_TEST_FACE_CASCADE, defined by
+ * CMakeLists.txt when OpenCV's own models are found.
+ */
+
+static const int WIDTH = 64;
+static const int HEIGHT = 48;
+
+static std::mt19937 random_engine(580);
+
+// Shrunk by 2 into 32x24 images, i.e. a grid of 4x3 tiles of 8 pixels.
+static LI_motion_config gate_config() {
+  LI_motion_config config;
+  config.threshold = 4;
+  config.downscale = 2;
+  config.tile = 8;
+  config.min_tiles = 1;
+  config.refresh = 0;
+  return config;
+}
+
+struct test_pair {
+  cv::Mat left, right;
+
+  test_pair(uint8_t level = 50) :
+    left(HEIGHT, WIDTH, CV_8UC1, cv::Scalar(level)),
+    right(HEIGHT, WIDTH, CV_8UC1, cv::Scalar(level)) {
+
+  }
+};
+
+static LI_motion_map assess(LI_motion_gate& gate, const test_pair& pair) {
+  static cv::Mat small[2];
+  LI_motion_map motion;
+  gate.assess(pair.left, pair.right, small, motion);
+  return motion;
+}
+
+// Static frames are skipped, sensor noise below the threshold too.
+static void test_static() {
+  LI_motion_gate gate(gate_config());
+  CHECK(gate.enabled());
+
+  test_pair still;
+  LI_motion_map motion = assess(gate, still);
+  CHECK(motion.changed);
+  CHECK(cv::Size(4, 3) == motion.grid && 12 == motion.tiles.size());
+
+  for (int i = 0; i < 10; ++i) {
+    motion = assess(gate, still);
+    CHECK(!motion.changed && 0 == motion.changed_tiles);
+    CHECK(motion.region.empty());
+  }
+
+  test_pair noisy(52);
+  CHECK(!assess(gate, noisy).changed);
+
+  LI_motion_stats stats = gate.snapshot();
+  CHECK(12 == stats.frames && 11 == stats.skipped && 0 == stats.refreshed);
+  CHECK(12 == stats.tiles && 0 == stats.changed_tiles);
+
+  // Without a threshold there is no gating.
+  gate.configure(LI_motion_config());
+  CHECK(!gate.enabled());
+}
+
+// A moved tile in either image gets the frame analysed, and the frame
+// becomes the reference.
+static void test_moved_tile() {
+  LI_motion_gate gate(gate_config());
+  test_pair still;
+  assess(gate, still);
+
+  test_pair moved;
+  moved.left(cv::Rect(32, 16, 16, 16)) = cv::Scalar(200);
+
+  LI_motion_map motion = assess(gate, moved);
+  CHECK(motion.changed && 1 == motion.changed_tiles);
+  CHECK(1 == motion.tiles[1 * 4 + 2]);
+  CHECK(cv::Rect(32, 16, 16, 16) == motion.region);
+
+  CHECK(!assess(gate, moved).changed);
+
+  // In the right image, in another tile: two tiles against the reference.
+  moved.right(cv::Rect(0, 0, 16, 16)) = cv::Scalar(0);
+  motion = assess(gate, moved);
+  CHECK(motion.changed && 1 == motion.changed_tiles && 1 == motion.tiles[0]);
+
+  motion = assess(gate, still);
+  CHECK(motion.changed && 2 == motion.changed_tiles);
+  CHECK(cv::Rect(0, 0, 48, 32) == motion.region);
+
+  // A frame of another size cannot be compared.
+  test_pair larger;
+  larger.left = cv::Mat(2 * HEIGHT, 2 * WIDTH, CV_8UC1, cv::Scalar(50));
+  larger.right = larger.left.clone();
+  CHECK(assess(gate, larger).changed);
+
+  // Fewer changed tiles than min_tiles are not enough.
+  LI_motion_config config = gate_config();
+  config.min_tiles = 2;
+  gate.configure(config);
+  assess(gate, still);
+
+  test_pair one;
+  one.left(cv::Rect(0, 0, 16, 16)) = cv::Scalar(200);
+  motion = assess(gate, one);
+  CHECK(!motion.changed && 1 == motion.changed_tiles);
+}
+
+// After 'refresh' frames skipped in a row, the next one is analysed.
+static void test_refresh() {
+  LI_motion_config config = gate_config();
+  config.refresh = 5;
+  LI_motion_gate gate(config);
+
+  test_pair still;
+  CHECK(assess(gate, still).changed);
+
+  for (int round = 1; round <= 2; ++round) {
+    for (int i = 0; i < 4; ++i)
+      CHECK(!assess(gate, still).changed);
+
+    CHECK(assess(gate, still).changed);
+    CHECK((unsigned int) round == gate.snapshot().refreshed);
+  }
+
+  LI_motion_stats stats = gate.snapshot();
+  CHECK(11 == stats.frames && 8 == stats.skipped);
+  CHECK(8.0 / 11 == stats.skip_rate());
+}
+
+// The kernels agree on random rows of every length.
+static void test_kernels() {
+  const LI_simd_t simd[] = {
+    LI_SIMD_SSE2, LI_SIMD_AVX2, LI_SIMD_NEON
+  };
+  std::uniform_int_distribution<int> byte(0, 255);
+
+  for (unsigned int k = 0; k < sizeof(simd) / sizeof(simd[0]); ++k) {
+    LI_sad_fn kernel = LI_sad_kernel(simd[k]);
+    if (!LI_simd_supported(simd[k])) {
+      CHECK(NULL == kernel);
+      continue;
+    }
+
+    for (size_t count = 1; count <= 200; ++count) {
+      std::vector<uint8_t> a(count), b(count);
+      for (size_t i = 0; i < count; ++i) {
+        a[i] = (uint8_t) byte(random_engine);
+        b[i] = (uint8_t) byte(random_engine);
+      }
+
+      size_t blocks = (count + LI_SAD_BLOCK - 1) / LI_SAD_BLOCK;
+      std::vector<uint32_t> expected(blocks, 1), sums(blocks, 1);
+      LI_sad_row_scalar(&a[0], &b[0], count, &expected[0]);
+      kernel(&a[0], &b[0], count, &sums[0]);
+      CHECK(expected == sums);
+    }
+  }
+}
+
+static LI_config camera_config() {
+  LI_config config;
+  config.workers = 1;
+  config.face_detection = false;
+  config.overflow = LI_BLOCK;
+  config.mode.width = WIDTH;
+  config.mode.height = HEIGHT;
+  config.motion = gate_config();
+  return config;
+}
+
+// Through the camera, the stages see what the gate made of each frame.
+static void test_camera() {
+  LI_stereocamera camera(camera_config());
+
+  std::mutex lock;
+  std::vector<bool> changed;
+  camera.add_stage([&](LI_stereo_frame& frame) {
+    std::lock_guard<std::mutex> guard(lock);
+    changed.push_back(frame.motion.changed);
+    return LI_SUCCESS;
+  });
+
+  LI_test_frame frame(WIDTH, HEIGHT, 50, 50);
+  for (uint32_t i = 0; i < 4; ++i)
+    camera.push_frame(frame.get(i));
+
+  for (int y = 16; y < 32; ++y)
+    for (int x = 32; x < 48; ++x)
+      frame.set(x, y, 200, 50);
+  camera.push_frame(frame.get(4));
+
+  CHECK(LI_wait_for([&camera] {
+    return 5 == camera.frame_stats().delivered;
+  }));
+
+  std::lock_guard<std::mutex> guard(lock);
+  CHECK((std::vector<bool> { true, false, false, false, true }) == changed);
+  CHECK(3 == camera.motion_stats().skipped);
+}
+
+#ifdef LI_TEST_FACE_CASCADE
+// The faces lent to frames where nothing moved are those of the frame
+// analysed, even when a stage changes them: the next frame gets them as
+// they were.
+static void test_lent_faces() {
+  LI_config config = camera_config();
+  config.face_detection = true;
+  config.face_cascade = LI_TEST_FACE_CASCADE;
+  config.nested_cascade = "";
+
+  LI_stereocamera camera(config);
+
+  std::mutex lock;
+  std::vector<size_t> seen;
+  camera.add_stage([&](LI_stereo_frame& frame) {
+    std::lock_guard<std::mutex> guard(lock);
+    seen.push_back(frame.faces.size());
+    frame.faces.push_back(LI_face());
+    return LI_SUCCESS;
+  });
+
+  LI_test_frame frame(WIDTH, HEIGHT, 50, 50);
+  for (uint32_t i = 0; i < 4; ++i)
+    camera.push_frame(frame.get(i));
+
+  CHECK(LI_wait_for([&camera] {
+    return 4 == camera.frame_stats().delivered;
+  }));
+
+  std::lock_guard<std::mutex> guard(lock);
+  CHECK((std::vector<size_t> { 0, 0, 0, 0 }) == seen);
+  CHECK(3 == camera.motion_stats().skipped);
+}
+#endif
+
+int main() {
+  test_static();
+  test_moved_tile();
+  test_refresh();
+  test_kernels();
+  test_camera();
+
+#ifdef LI_TEST_FACE_CASCADE
+  test_lent_faces();
+#endif
+
+  return LI_test_result();
+}
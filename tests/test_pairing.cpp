@@ -0,0 +1,235 @@
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * The matching of faces between the two images: faces placed at known
+ * disparities are paired up with their own, whatever the order they are
+ * found in, faces outside the epipolar band of a left face are not taken
+ * for it, and faces on the same rows go to the left face whose band they
+ * lie in. The disparity is the shift between the boxes, and the range
+ * that of the calibration.
+ */
+
+static const int WIDTH = 640;
+static const int HEIGHT = 480;
+
+static const char *CALIBRATION = "test_pairing_calibration.yml";
+
+// The defaults of the camera.
+static const int MAX_DISPARITY = LI_config().max_disparity;
+static const int MARGIN = LI_config().epipolar_margin;
+
+// A square face at (x, y) in the left image, and as seen 'disparity'
+// pixels further left in the right one.
+static cv::Rect left_at(int x, int y, int size = 60) {
+  return cv::Rect(x, y, size, size);
+}
+
+static cv::Rect right_of(const cv::Rect& left, int disparity, int dy = 0) {
+  return left - cv::Point(disparity, -dy);
+}
+
+struct test_pairing {
+  std::vector<cv::Rect> left, right;
+  std::vector<bool> used;
+  std::vector<LI_face> faces;
+
+  void pair(const LI_rectifier* rectifier = NULL) {
+    this->faces.clear();
+    LI_pair_faces(this->left, this->right, cv::Size(WIDTH, HEIGHT),
+      MAX_DISPARITY, MARGIN, rectifier, this->used, this->faces);
+  }
+
+  // The face recorded for a left box, if any.
+  const LI_face* find(const cv::Rect& box) const {
+    for (unsigned int i = 0; i < this->faces.size(); ++i)
+      if (box == this->faces[i].left)
+        return &this->faces[i];
+    return NULL;
+  }
+
+  // Whether a right box was recorded on its own.
+  bool alone(const cv::Rect& box) const {
+    for (unsigned int i = 0; i < this->faces.size(); ++i)
+      if (this->faces[i].left.empty() && box == this->faces[i].right)
+        return 0 == this->faces[i].disparity && 0 == this->faces[i].range;
+    return false;
+  }
+};
+
+// Two cameras 60 mm apart, without distortion.
+static bool calibrate(LI_rectifier& rectifier) {
+  {
+    cv::FileStorage storage(CALIBRATION, cv::FileStorage::WRITE);
+    cv::Mat M = (cv::Mat_<double>(3, 3) <<
+      500, 0, WIDTH / 2.0, 0, 500, HEIGHT / 2.0, 0, 0, 1);
+    storage << "M1" << M << "M2" << M;
+    storage << "D1" << cv::Mat::zeros(1, 5, CV_64F);
+    storage << "D2" << cv::Mat::zeros(1, 5, CV_64F);
+    storage << "R" << cv::Mat::eye(3, 3, CV_64F);
+    storage << "T" << (cv::Mat_<double>(3, 1) << -60, 0, 0);
+    storage << "image_width" << WIDTH << "image_height" << HEIGHT;
+  }
+
+  bool ready = rectifier.load(CALIBRATION) &&
+    rectifier.prepare(cv::Size(WIDTH, HEIGHT));
+  std::remove(CALIBRATION);
+  return ready;
+}
+
+// The band spans max_disparity pixels to the left of the face and the
+// margin around it, clipped to the image.
+static void test_band() {
+  CHECK(cv::Rect(300 - MAX_DISPARITY - MARGIN, 100 - MARGIN,
+    60 + MAX_DISPARITY + 2 * MARGIN, 60 + 2 * MARGIN) ==
+    LI_epipolar_band(left_at(300, 100), cv::Size(WIDTH, HEIGHT),
+      MAX_DISPARITY, MARGIN));
+
+  CHECK(cv::Rect(0, 0, 60 + 20 + MARGIN, 60 + 4 + MARGIN) ==
+    LI_epipolar_band(left_at(20, 4), cv::Size(WIDTH, HEIGHT),
+      MAX_DISPARITY, MARGIN));
+}
+
+// Faces at known disparities, found in another order in the right image,
+// are paired up with their own. Their range is that of the calibration,
+// and unknown without one.
+static void test_known_disparities() {
+  test_pairing pairing;
+  const int disparities[] = { 10, 45, 100 };
+  pairing.left.push_back(left_at(100, 20));
+  pairing.left.push_back(left_at(300, 180, 80));
+  pairing.left.push_back(left_at(500, 360, 50));
+  for (int i = 2; i >= 0; --i)
+    pairing.right.push_back(right_of(pairing.left[i], disparities[i], i - 1));
+
+  LI_rectifier rectifier;
+  CHECK(calibrate(rectifier));
+  CHECK(0 < rectifier.focal_length());
+  CHECK(std::abs(60 - rectifier.baseline()) < 1e-3);
+
+  pairing.pair(&rectifier);
+  CHECK(3 == pairing.faces.size());
+
+  for (int i = 0; i < 3; ++i) {
+    const LI_face* face = pairing.find(pairing.left[i]);
+    CHECK(NULL != face);
+    if (NULL == face)
+      continue;
+
+    CHECK(pairing.right[2 - i] == face->right);
+    CHECK(disparities[i] == face->disparity);
+
+    float range = (float) (rectifier.focal_length() * 60 / disparities[i]);
+    CHECK(std::abs(range - face->range) < 1e-3f * range);
+    CHECK(-1 == face->id);
+  }
+
+  pairing.pair();
+  CHECK(3 == pairing.faces.size());
+  for (unsigned int i = 0; i < pairing.faces.size(); ++i)
+    CHECK(0 < pairing.faces[i].disparity && 0 == pairing.faces[i].range);
+
+  // A rectifier not prepared yet tells no range either.
+  LI_rectifier unprepared;
+  pairing.pair(&unprepared);
+  for (unsigned int i = 0; i < pairing.faces.size(); ++i)
+    CHECK(0 == pairing.faces[i].range);
+}
+
+// Faces too far left, on other rows or to the right of the left face are
+// not taken for it: both are recorded on their own, without disparity.
+static void test_outside_band() {
+  cv::Rect face = left_at(300, 200);
+  const cv::Rect outside[] = {
+    right_of(face, MAX_DISPARITY + MARGIN + 1),
+    right_of(face, 40, MARGIN + 1),
+    right_of(face, 40, -MARGIN - 1),
+    right_of(face, -MARGIN - 1)
+  };
+
+  for (int i = 0; i < 4; ++i) {
+    test_pairing pairing;
+    pairing.left.push_back(face);
+    pairing.right.push_back(outside[i]);
+    pairing.pair();
+
+    CHECK(2 == pairing.faces.size());
+    const LI_face* left = pairing.find(face);
+    CHECK(NULL != left && left->right.empty() && 0 == left->disparity);
+    CHECK(pairing.alone(outside[i]));
+  }
+
+  // Just within the band, to either side and on either edge of the rows.
+  const cv::Rect inside[] = {
+    right_of(face, MAX_DISPARITY + MARGIN),
+    right_of(face, 40, MARGIN),
+    right_of(face, 40, -MARGIN),
+    right_of(face, -MARGIN)
+  };
+  const int disparities[] = { MAX_DISPARITY + MARGIN, 40, 40, -MARGIN };
+
+  for (int i = 0; i < 4; ++i) {
+    test_pairing pairing;
+    pairing.left.push_back(face);
+    pairing.right.push_back(inside[i]);
+    pairing.pair();
+
+    CHECK(1 == pairing.faces.size());
+    const LI_face* left = pairing.find(face);
+    CHECK(NULL != left && inside[i] == left->right);
+    CHECK(NULL != left && disparities[i] == left->disparity);
+  }
+}
+
+// Two faces on the same rows each get the right face within their own
+// band, the nearer one's lying outside the band of the farther one. Where
+// one right face lies in the bands of both, it goes to the first left
+// face only.
+static void test_same_rows() {
+  test_pairing pairing;
+  cv::Rect nearer = left_at(300, 100), farther = left_at(400, 100);
+  pairing.left.push_back(nearer);
+  pairing.left.push_back(farther);
+  pairing.right.push_back(right_of(farther, 30));
+  pairing.right.push_back(right_of(nearer, 40));
+
+  LI_rectifier rectifier;
+  CHECK(calibrate(rectifier));
+  pairing.pair(&rectifier);
+  CHECK(2 == pairing.faces.size());
+
+  const LI_face* first = pairing.find(nearer);
+  const LI_face* second = pairing.find(farther);
+  CHECK(NULL != first && right_of(nearer, 40) == first->right);
+  CHECK(NULL != second && right_of(farther, 30) == second->right);
+  if (NULL != first && NULL != second) {
+    CHECK(40 == first->disparity && 30 == second->disparity);
+    CHECK(first->range < second->range);
+  }
+
+  // One right face for two left ones.
+  pairing.left.assign(1, farther);
+  pairing.left.push_back(nearer);
+  pairing.right.assign(1, right_of(nearer, 10));
+  pairing.pair();
+
+  CHECK(2 == pairing.faces.size());
+  first = pairing.find(farther);
+  second = pairing.find(nearer);
+  CHECK(NULL != first && right_of(nearer, 10) == first->right);
+  CHECK(NULL != first && 110 == first->disparity);
+  CHECK(NULL != second && second->right.empty());
+}
+
+int main() {
+  test_band();
+  test_known_disparities();
+  test_outside_band();
+  test_same_rows();
+  return LI_test_result();
+}
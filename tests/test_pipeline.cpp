@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * The frame pipeline: every frame pushed is either delivered once to the
+ * stages or counted as dropped, the overflow policy deciding which frames
+ * a full queue keeps.
+ */
+
+// The overflow policies of a full queue, on its own.
+static void test_queue() {
+  std::atomic<bool> running(true);
+  int evicted = -1;
+  int item = -1;
+
+  LI_stage_queue<int> newest(4, LI_DROP_NEWEST);
+  for (int i = 0; i < 4; ++i)
+    CHECK(LI_QUEUED == newest.push(i, evicted, running));
+  CHECK(LI_REJECTED == newest.push(4, evicted, running));
+
+  for (int i = 0; i < 4; ++i)
+    CHECK(newest.pop(item) && i == item);
+  CHECK(!newest.pop(item));
+
+  LI_queue_stats stats = newest.stats();
+  CHECK(4 == stats.pushed && 4 == stats.popped && 1 == stats.dropped);
+  CHECK(0 == stats.depth && 4 == stats.max_depth && 4 == stats.capacity);
+
+  LI_stage_queue<int> oldest(4, LI_DROP_OLDEST);
+  for (int i = 0; i < 4; ++i)
+    CHECK(LI_QUEUED == oldest.push(i, evicted, running));
+  CHECK(LI_QUEUED_EVICTED == oldest.push(4, evicted, running));
+  CHECK(0 == evicted);
+
+  for (int i = 1; i <= 4; ++i)
+    CHECK(oldest.pop(item) && i == item);
+  CHECK(5 == oldest.stats().pushed && 1 == oldest.stats().dropped);
+
+  // A blocked producer goes on once a consumer makes room, and gives up
+  // when the pipeline stops.
+  LI_stage_queue<int> block(4, LI_BLOCK);
+  for (int i = 0; i < 4; ++i)
+    CHECK(LI_QUEUED == block.push(i, evicted, running));
+
+  std::thread consumer([&block] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    int first;
+    block.pop(first);
+  });
+  CHECK(LI_QUEUED == block.push(4, evicted, running));
+  consumer.join();
+  CHECK(0 == block.stats().dropped);
+
+  running = false;
+  CHECK(LI_REJECTED == block.push(5, evicted, running));
+  CHECK(1 == block.stats().dropped);
+}
+
+static const int WIDTH = 32;
+static const int HEIGHT = 24;
+
+// A stage recording the frames it sees, which can be held up to fill the
+// queues behind it.
+struct recording_stage {
+  std::mutex lock;
+  std::vector<uint32_t> sequences;
+  std::vector<unsigned int> workers;
+
+  std::atomic<bool> hold;
+  std::atomic<unsigned int> holding;
+
+  recording_stage() :
+    hold(false),
+    holding(0) {
+
+  }
+
+  LI_stage stage() {
+    return [this](LI_stereo_frame& frame) {
+      ++this->holding;
+      while (this->hold)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      --this->holding;
+
+      std::lock_guard<std::mutex> guard(this->lock);
+      this->sequences.push_back(frame.info.sequence);
+      this->workers.push_back(frame.worker);
+      return LI_SUCCESS;
+    };
+  }
+
+  std::vector<uint32_t> seen() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    std::vector<uint32_t> sorted = this->sequences;
+    std::sort(sorted.begin(), sorted.end());
+    return sorted;
+  }
+};
+
+static LI_config test_config(unsigned int workers, LI_overflow_t overflow) {
+  LI_config config;
+  config.workers = workers;
+  config.queue_depth = 4;
+  config.overflow = overflow;
+  config.face_detection = false;
+  config.mode.width = WIDTH;
+  config.mode.height = HEIGHT;
+  return config;
+}
+
+// Every frame goes through exactly once, on one of the workers.
+static void test_workers() {
+  const unsigned int workers = 4;
+  const uint32_t frames = 300;
+
+  LI_stereocamera camera(test_config(workers, LI_BLOCK));
+  recording_stage recorder;
+  camera.add_stage(recorder.stage());
+
+  LI_test_frame frame(WIDTH, HEIGHT);
+  for (uint32_t i = 0; i < frames; ++i)
+    camera.push_frame(frame.get(i));
+
+  CHECK(LI_wait_for([&] {
+    return frames == camera.frame_stats().delivered;
+  }));
+
+  std::vector<uint32_t> seen = recorder.seen();
+  CHECK(frames == seen.size());
+  for (uint32_t i = 0; i < seen.size() && i < frames; ++i)
+    CHECK(i == seen[i]);
+
+  for (unsigned int i = 0; i < recorder.workers.size(); ++i)
+    CHECK(recorder.workers[i] < workers);
+
+  LI_queue_stats convert = camera.queue_stats(LI_STAGE_CONVERT);
+  LI_queue_stats analyse = camera.queue_stats(LI_STAGE_ANALYSE);
+  CHECK(frames == convert.pushed && frames == convert.popped);
+  CHECK(frames == analyse.pushed && frames == analyse.popped);
+  CHECK(0 == convert.dropped && 0 == analyse.dropped);
+  CHECK(4 == convert.capacity && convert.max_depth <= convert.capacity);
+  CHECK(0 == camera.dropped_frames());
+}
+
+// With the only worker held up by frame 0, the conversion queue takes the
+// next four frames and overflows on the six after them. Returns the frames
+// delivered once the worker goes on.
+static std::vector<uint32_t> overflow(LI_overflow_t policy) {
+  LI_stereocamera camera(test_config(1, policy));
+  recording_stage recorder;
+  recorder.hold = true;
+  camera.add_stage(recorder.stage());
+
+  LI_test_frame frame(WIDTH, HEIGHT);
+  camera.push_frame(frame.get(0));
+  CHECK(LI_wait_for([&] { return 1 == recorder.holding; }));
+
+  std::thread producer([&] {
+    for (uint32_t i = 1; i <= 10; ++i)
+      camera.push_frame(frame.get(i));
+  });
+
+  if (LI_BLOCK == policy) {
+    // The producer waits for room with frame 5 rather than dropping it.
+    CHECK(LI_wait_for([&] {
+      return 4 == camera.queue_stats(LI_STAGE_CONVERT).depth;
+    }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(6 == camera.frame_stats().received);
+    CHECK(0 == camera.dropped_frames());
+  }
+  else {
+    producer.join();
+
+    LI_queue_stats convert = camera.queue_stats(LI_STAGE_CONVERT);
+    CHECK(4 == convert.depth);
+    CHECK(6 == convert.dropped);
+    CHECK(6 == camera.dropped_frames());
+  }
+
+  recorder.hold = false;
+  if (producer.joinable())
+    producer.join();
+
+  CHECK(LI_wait_for([&] {
+    return 11 == camera.frame_stats().delivered + camera.dropped_frames();
+  }));
+  CHECK(11 == camera.frame_stats().received);
+
+  return recorder.seen();
+}
+
+static void test_overflow() {
+  std::vector<uint32_t> newest = overflow(LI_DROP_NEWEST);
+  CHECK((std::vector<uint32_t> { 0, 1, 2, 3, 4 }) == newest);
+
+  std::vector<uint32_t> oldest = overflow(LI_DROP_OLDEST);
+  CHECK((std::vector<uint32_t> { 0, 7, 8, 9, 10 }) == oldest);
+
+  std::vector<uint32_t> block = overflow(LI_BLOCK);
+  CHECK(11 == block.size());
+}
+
+// A failing stage skips the rest of the chain for its frame only, and the
+// error is counted rather than thrown.
+static void test_failing_stage() {
+  LI_stereocamera camera(test_config(2, LI_BLOCK));
+  std::atomic<unsigned int> after(0);
+
+  camera.add_stage([](LI_stereo_frame& frame) {
+    return (0 == frame.info.sequence % 2) ?
+      LI_SUCCESS : LI_UNSPECIFIED;
+  });
+  camera.add_stage([&after](LI_stereo_frame&) {
+    ++after;
+    return LI_SUCCESS;
+  });
+
+  LI_test_frame frame(WIDTH, HEIGHT);
+  for (uint32_t i = 0; i < 20; ++i)
+    camera.push_frame(frame.get(i));
+
+  CHECK(LI_wait_for([&] { return 20 == camera.frame_stats().delivered; }));
+  CHECK(10 == after);
+  CHECK(10 == camera.error_stats().count(LI_UNSPECIFIED));
+}
+
+int main() {
+  test_queue();
+  test_workers();
+  test_overflow();
+  test_failing_stage();
+  return LI_test_result();
+}
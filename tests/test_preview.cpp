@@ -0,0 +1,98 @@
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+#define LI_WITH_HIGHGUI
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * The preview's single-slot mailbox: the stage never waits for the
+ * preview thread, frames coming faster than the rate limit are skipped,
+ * and frames posted while the thread is busy rendering replace each other
+ * so that only the latest is shown. Needs a display.
+ */
+
+static const int WIDTH = 64;
+static const int HEIGHT = 48;
+
+static LI_stereo_frame test_frame(uint32_t sequence) {
+  LI_stereo_frame frame;
+  frame.left = cv::Mat(HEIGHT, WIDTH, CV_8UC1, cv::Scalar(sequence % 256));
+  frame.right = cv::Mat(HEIGHT, WIDTH, CV_8UC1, cv::Scalar(255 - sequence % 256));
+  frame.info.sequence = sequence;
+  return frame;
+}
+
+static unsigned long long offered(const LI_preview_stats& stats) {
+  return stats.posted + stats.decimated + stats.busy;
+}
+
+// Within 1 / max_fps of the frame posted, the next ones are skipped.
+static void test_rate_limit() {
+  LI_preview_config config;
+  config.max_fps = 10;
+  config.window = "test_preview (rate limit)";
+
+  LI_preview_stage preview(config);
+  LI_stereo_frame frame = test_frame(0);
+
+  for (int i = 0; i < 20; ++i)
+    CHECK(LI_SUCCESS == preview(frame));
+
+  LI_preview_stats stats = preview.stats();
+  CHECK(1 == stats.posted && 19 == stats.decimated && 0 == stats.busy);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(120));
+  CHECK(LI_SUCCESS == preview(frame));
+  CHECK(2 == preview.stats().posted);
+  CHECK(LI_wait_for([&preview] { return 2 == preview.stats().rendered; }));
+}
+
+// A burst far faster than the display: posting never waits, and the
+// frames the thread had no time for are replaced, not queued.
+static void test_stale_frames() {
+  LI_preview_config config;
+  config.max_fps = 0;
+  config.window = "test_preview (burst)";
+
+  LI_preview_stage preview(config);
+  LI_stage stage = preview;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < 200; ++i) {
+    LI_stereo_frame frame = test_frame(i);
+    CHECK(LI_SUCCESS == stage(frame));
+  }
+  CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(100));
+
+  // Every frame is accounted for once, copies of the stage sharing the
+  // counters.
+  CHECK(200 == offered(preview.stats()));
+  CHECK(0 < preview.stats().posted);
+
+  CHECK(LI_wait_for([&preview] { return 0 < preview.stats().rendered; }));
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  LI_preview_stats stats = preview.stats();
+  CHECK(stats.rendered < stats.posted);
+
+  // Once the thread is idle, the next frame posted is rendered.
+  LI_stereo_frame frame = test_frame(200);
+  CHECK(LI_SUCCESS == preview(frame));
+  CHECK(stats.posted + 1 == preview.stats().posted);
+  CHECK(LI_wait_for([&preview, &stats] {
+    return stats.rendered + 1 == preview.stats().rendered;
+  }));
+}
+
+int main() {
+  if (NULL == std::getenv("DISPLAY") && NULL == std::getenv("WAYLAND_DISPLAY")) {
+    std::cerr << "No display, preview not tested\n";
+    return LI_TEST_SKIPPED;
+  }
+
+  test_rate_limit();
+  test_stale_frames();
+  return LI_test_result();
+}
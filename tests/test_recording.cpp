@@ -0,0 +1,155 @@
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * The raw stream recordings: what is recorded comes back frame for frame
+ * when replayed, and frames the recording fails to write are reported.
+ */
+
+static const int WIDTH = 64;
+static const int HEIGHT = 48;
+
+static LI_config test_config() {
+  LI_config config;
+  config.workers = 1;
+  config.face_detection = false;
+  config.overflow = LI_BLOCK;
+  config.mode.width = WIDTH;
+  config.mode.height = HEIGHT;
+  return config;
+}
+
+static const uint32_t SEQUENCE[] = { 7, 8, 9, 12, 13, 20 };
+static const unsigned int FRAMES = sizeof(SEQUENCE) / sizeof(SEQUENCE[0]);
+
+// Every frame distinct, in both images.
+static void paint(LI_test_frame& frame, unsigned int i) {
+  frame.fill((uint8_t) (10 * i), (uint8_t) (200 - 10 * i));
+  frame.set((int) i, (int) i, 255, 0);
+}
+
+// Records the frames one at a time, waiting for each to be written.
+static bool record(const std::string& path) {
+  LI_stereocamera camera(test_config());
+  if (!camera.start_recording(path))
+    return false;
+
+  LI_test_frame frame(WIDTH, HEIGHT);
+  for (unsigned int i = 0; i < FRAMES; ++i) {
+    paint(frame, i);
+    camera.push_frame(frame.get(SEQUENCE[i]));
+
+    CHECK(LI_wait_for([&camera, i] {
+      return i + 1 == camera.recording_stats().recorded;
+    }));
+  }
+
+  CHECK(0 == camera.recording_stats().lost);
+  CHECK(0 == camera.error_stats().count(LI_UNABLE_TO_RECORD_FRAME));
+  return camera.stop_recording();
+}
+
+// The recording holds the frames as pushed, and replays them in order
+// with the same sequence numbers and images.
+static void test_round_trip() {
+  std::string path = "test_recording.bin";
+  CHECK(record(path));
+
+  LI_replay replay;
+  CHECK(replay.open(path));
+  CHECK(FRAMES == replay.frames());
+
+  LI_test_frame expected(WIDTH, HEIGHT);
+  int64_t previous_offset = -1;
+
+  for (unsigned int i = 0; i < replay.frames() && i < FRAMES; ++i) {
+    LI_record_header header;
+    const uint8_t *payload = replay.frame(i, header);
+
+    CHECK(SEQUENCE[i] == header.sequence);
+    CHECK((uint32_t) WIDTH == header.width);
+    CHECK((uint32_t) HEIGHT == header.height);
+    CHECK((uint32_t) (2 * WIDTH) == header.step);
+    CHECK((uint64_t) (2 * WIDTH * HEIGHT) == header.payload_bytes);
+    CHECK(previous_offset <= header.offset_us);
+    previous_offset = header.offset_us;
+
+    paint(expected, i);
+    CHECK(0 == std::memcmp(payload, expected.get(0)->data,
+      (size_t) header.payload_bytes));
+  }
+
+  // Replayed, the frames go through the stages as they were pushed.
+  std::mutex lock;
+  std::vector<uint32_t> sequences;
+  std::vector<int> lefts, rights, marks;
+
+  LI_stereocamera camera(test_config());
+  camera.add_stage([&](LI_stereo_frame& frame) {
+    std::lock_guard<std::mutex> guard(lock);
+    sequences.push_back(frame.info.sequence);
+    lefts.push_back(frame.left.at<uint8_t>(0, WIDTH - 1));
+    rights.push_back(frame.right.at<uint8_t>(0, WIDTH - 1));
+    int i = (int) marks.size();
+    marks.push_back(frame.left.at<uint8_t>(i, i));
+    return LI_SUCCESS;
+  });
+
+  CHECK(FRAMES == camera.replay(replay, false));
+  CHECK(LI_wait_for([&camera] {
+    return FRAMES == camera.frame_stats().delivered;
+  }));
+
+  std::lock_guard<std::mutex> guard(lock);
+  CHECK(FRAMES == sequences.size());
+  for (unsigned int i = 0; i < sequences.size(); ++i) {
+    CHECK(SEQUENCE[i] == sequences[i]);
+    CHECK(10 * (int) i == lefts[i] && 200 - 10 * (int) i == rights[i]);
+    CHECK(255 == marks[i]);
+  }
+
+  // The holes in the sequence show up again.
+  CHECK(2 == camera.frame_stats().gaps);
+
+  std::remove(path.c_str());
+}
+
+// A recording that cannot be written (a full disk) reports the frames it
+// loses, and does not complete.
+static void test_write_failure() {
+  LI_stereocamera camera(test_config());
+  if (!camera.start_recording("/dev/full")) {
+    std::cerr << "No /dev/full, write failures not tested\n";
+    return;
+  }
+
+  LI_test_frame frame(WIDTH, HEIGHT);
+  for (unsigned int i = 0; i < FRAMES; ++i) {
+    camera.push_frame(frame.get(i));
+    CHECK(LI_wait_for([&camera, i] {
+      LI_recording_stats stats = camera.recording_stats();
+      return i + 1 == stats.recorded + stats.lost;
+    }));
+  }
+
+  // stdio may take the first bytes into its buffer, not a whole frame.
+  LI_recording_stats stats = camera.recording_stats();
+  CHECK(0 < stats.lost);
+  CHECK(stats.lost == camera.error_stats().count(LI_UNABLE_TO_RECORD_FRAME));
+  CHECK(!camera.stop_recording());
+
+  // The frames went through the pipeline all the same.
+  CHECK(LI_wait_for([&camera] {
+    return FRAMES == camera.frame_stats().delivered;
+  }));
+}
+
+int main() {
+  test_round_trip();
+  test_write_failure();
+  return LI_test_result();
+}
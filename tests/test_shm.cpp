@@ -0,0 +1,225 @@
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * The shared memory ring: what the publisher writes the readers read in
+ * order, in place, and readers falling behind are told what they missed.
+ * Published from the stages, frames that cannot be published do not stop
+ * the pipeline and are reported once.
+ */
+
+static const int WIDTH = 64;
+static const int HEIGHT = 48;
+static const unsigned int SLOTS = 4;
+
+static LI_config test_config() {
+  LI_config config;
+  config.workers = 1;
+  config.face_detection = false;
+  config.overflow = LI_BLOCK;
+  config.mode.width = WIDTH;
+  config.mode.height = HEIGHT;
+  return config;
+}
+
+// A name of this process's own, so that concurrent runs keep apart.
+static std::string ring_name() {
+  return "/li_test_shm_" + std::to_string((long) getpid());
+}
+
+// Frame i has its left image filled with i and its right one with 100 + i.
+static bool publish(LI_shm_publisher& publisher, uint32_t i) {
+  std::vector<uint8_t> left(WIDTH * HEIGHT, (uint8_t) i);
+  std::vector<uint8_t> right(WIDTH * HEIGHT, (uint8_t) (100 + i));
+
+  LI_frame_info info;
+  info.sequence = 1000 + i;
+  info.gap = i % 2;
+  info.capture_us = 10 * i;
+
+  return publisher.publish(info, &left[0], WIDTH, &right[0], WIDTH,
+    WIDTH, HEIGHT);
+}
+
+static bool check_frame(const LI_shm_reader& reader,
+  const LI_shm_frame& frame, uint32_t i) {
+
+  bool same = 1000 + i == frame.info.sequence &&
+    i % 2 == frame.info.gap &&
+    (int64_t) (10 * i) == frame.info.capture_us &&
+    (uint32_t) WIDTH == frame.info.width &&
+    (uint32_t) HEIGHT == frame.info.height;
+
+  for (int y = 0; y < HEIGHT; ++y)
+    for (int x = 0; x < WIDTH; ++x)
+      same = same &&
+        (uint8_t) i == frame.left[y * reader.step() + x] &&
+        (uint8_t) (100 + i) == frame.right[y * reader.step() + x];
+
+  return same && reader.valid(frame);
+}
+
+// Readers see the frames published since they attached, in order.
+static void test_in_order() {
+  LI_shm_reader reader;
+  CHECK(!reader.open(ring_name()));
+
+  LI_shm_publisher publisher;
+  CHECK(publisher.create(ring_name(), SLOTS, WIDTH, HEIGHT));
+  CHECK(publish(publisher, 0));
+
+  CHECK(reader.open(ring_name()));
+  CHECK(WIDTH == reader.width() && HEIGHT == reader.height());
+  CHECK((size_t) WIDTH <= reader.step());
+
+  LI_shm_frame frame;
+  CHECK(!reader.next(frame));
+  CHECK(!reader.wait(10));
+
+  for (uint32_t i = 1; i <= 3; ++i)
+    CHECK(publish(publisher, i));
+
+  for (uint32_t i = 1; i <= 3; ++i) {
+    CHECK(reader.next(frame));
+    CHECK(i == frame.info.index);
+    CHECK(0 == frame.skipped);
+    CHECK(check_frame(reader, frame, i));
+  }
+  CHECK(!reader.next(frame));
+  CHECK(0 == reader.lost_frames());
+
+  // Frames of another size are turned away.
+  std::vector<uint8_t> small(WIDTH * HEIGHT);
+  CHECK(!publisher.publish(LI_frame_info(), &small[0], WIDTH / 2,
+    &small[0], WIDTH / 2, WIDTH / 2, HEIGHT));
+  CHECK(!reader.next(frame));
+}
+
+// A reader more than the ring behind resumes at the oldest frame left,
+// counting those it missed. latest() skips to the newest frame.
+static void test_fall_behind() {
+  LI_shm_publisher publisher;
+  CHECK(publisher.create(ring_name(), SLOTS, WIDTH, HEIGHT));
+
+  LI_shm_reader reader;
+  CHECK(reader.open(ring_name()));
+
+  for (uint32_t i = 0; i < SLOTS + 2; ++i)
+    CHECK(publish(publisher, i));
+
+  LI_shm_frame frame;
+  CHECK(reader.next(frame));
+  CHECK(2 == frame.skipped && 2 == reader.lost_frames());
+  CHECK(check_frame(reader, frame, 2));
+
+  // The frame read is overwritten once the publisher laps the ring.
+  for (uint32_t i = SLOTS + 2; i < 2 * SLOTS + 3; ++i)
+    CHECK(publish(publisher, i));
+  CHECK(!reader.valid(frame));
+
+  CHECK(reader.latest(frame));
+  CHECK(2 * SLOTS + 2 == frame.info.index);
+  CHECK(check_frame(reader, frame, 2 * SLOTS + 2));
+  CHECK(2 == reader.lost_frames());
+  CHECK(!reader.latest(frame));
+}
+
+// A waiting reader wakes up when a frame is published.
+static void test_wait() {
+  LI_shm_publisher publisher;
+  CHECK(publisher.create(ring_name(), SLOTS, WIDTH, HEIGHT));
+
+  LI_shm_reader reader;
+  CHECK(reader.open(ring_name()));
+
+  std::thread writer([&publisher] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    publish(publisher, 7);
+  });
+
+  CHECK(reader.wait(5000));
+  LI_shm_frame frame;
+  CHECK(reader.next(frame));
+  CHECK(check_frame(reader, frame, 7));
+  writer.join();
+
+  // Closed, the ring cannot be attached to any longer.
+  publisher.close();
+  CHECK(!publisher.is_open());
+  LI_shm_reader late;
+  CHECK(!late.open(ring_name()));
+}
+
+// The stage publishes the pairs of the camera. Without a ring the frames
+// go on through the stages, and the failure is reported once per outage.
+static void test_stage() {
+  std::shared_ptr<LI_shm_publisher> publisher(new LI_shm_publisher());
+  CHECK(publisher->create(ring_name(), SLOTS, WIDTH, HEIGHT));
+
+  LI_shm_reader reader;
+  CHECK(reader.open(ring_name()));
+
+  LI_stereocamera camera(test_config());
+  std::atomic<unsigned int> after(0);
+  camera.add_stage(camera.publish_stage(publisher));
+  camera.add_stage([&after](LI_stereo_frame&) {
+    ++after;
+    return LI_SUCCESS;
+  });
+
+  LI_test_frame frame(WIDTH, HEIGHT, 30, 130);
+  for (uint32_t i = 1; i <= 2; ++i)
+    camera.push_frame(frame.get(i));
+  CHECK(LI_wait_for([&camera] {
+    return 2 == camera.frame_stats().delivered;
+  }));
+
+  LI_shm_frame shared;
+  for (uint32_t i = 1; i <= 2; ++i) {
+    CHECK(reader.next(shared));
+    CHECK(i == shared.info.sequence);
+    CHECK(30 == shared.left[0] && 130 == shared.right[WIDTH - 1]);
+  }
+
+  publisher->close();
+  for (uint32_t i = 3; i <= 5; ++i)
+    camera.push_frame(frame.get(i));
+  CHECK(LI_wait_for([&camera] {
+    return 5 == camera.frame_stats().delivered;
+  }));
+  CHECK(5 == after);
+  CHECK(1 == camera.error_stats().count(LI_UNABLE_TO_PUBLISH_FRAME));
+  CHECK(3 == camera.error_stats().last.sequence);
+
+  // Published again, then failing again: a second report.
+  CHECK(publisher->create(ring_name(), SLOTS, WIDTH, HEIGHT));
+  camera.push_frame(frame.get(6));
+  CHECK(LI_wait_for([&camera] {
+    return 6 == camera.frame_stats().delivered;
+  }));
+  CHECK(1 == camera.error_stats().count(LI_UNABLE_TO_PUBLISH_FRAME));
+
+  publisher->close();
+  camera.push_frame(frame.get(7));
+  camera.push_frame(frame.get(8));
+  CHECK(LI_wait_for([&camera] {
+    return 8 == camera.frame_stats().delivered;
+  }));
+  CHECK(2 == camera.error_stats().count(LI_UNABLE_TO_PUBLISH_FRAME));
+  CHECK(8 == after);
+}
+
+int main() {
+  test_in_order();
+  test_fall_behind();
+  test_wait();
+  test_stage();
+  return LI_test_result();
+}
@@ -0,0 +1,125 @@
+#include <chrono>
+#include <thread>
+
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * The frame statistics: the gaps in the sequence numbers of the frames
+ * received, and the latency histograms with their percentiles.
+ */
+
+static const int WIDTH = 64;
+static const int HEIGHT = 48;
+
+static LI_config test_config() {
+  LI_config config;
+  config.workers = 1;
+  config.face_detection = false;
+  config.overflow = LI_BLOCK;
+  config.mode.width = WIDTH;
+  config.mode.height = HEIGHT;
+  return config;
+}
+
+// The histogram on its own: percentiles are the upper bounds of their
+// buckets, capped by the maximum.
+static void test_histogram() {
+  LI_histogram histogram;
+  CHECK(0 == histogram.snapshot().percentile_us(0.5));
+
+  for (int i = 0; i < 90; ++i)
+    histogram.record(10);
+  for (int i = 0; i < 10; ++i)
+    histogram.record(1000);
+
+  LI_latency_histogram latencies = histogram.snapshot();
+  CHECK(100 == latencies.count);
+  CHECK(1000 == latencies.max_us);
+  CHECK(109 == latencies.mean_us());
+  CHECK(90 == latencies.buckets[4] && 10 == latencies.buckets[10]);
+
+  CHECK(16 == latencies.percentile_us(0.5));
+  CHECK(16 == latencies.percentile_us(0.89));
+  CHECK(1000 == latencies.percentile_us(0.9));
+  CHECK(1000 == latencies.percentile_us(0.99));
+  CHECK(1000 == latencies.percentile_us(1));
+
+  // Time going backwards is not recorded.
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  histogram.record(now, now - std::chrono::milliseconds(1));
+  CHECK(100 == histogram.snapshot().count);
+
+  histogram.reset();
+  CHECK(0 == histogram.snapshot().count && 0 == histogram.snapshot().max_us);
+}
+
+// Frames missing from the sequence are counted once per gap, a sequence
+// going backwards (a restarted stream) is no gap.
+static void test_gaps() {
+  LI_stereocamera camera(test_config());
+  LI_test_frame frame(WIDTH, HEIGHT);
+
+  const uint32_t sequence[] = { 0, 1, 2, 5, 6, 10, 3, 4 };
+  const unsigned int count = sizeof(sequence) / sizeof(sequence[0]);
+
+  for (unsigned int i = 0; i < count; ++i)
+    camera.push_frame(frame.get(sequence[i]));
+  CHECK(LI_wait_for([&camera] {
+    return count == camera.frame_stats().delivered;
+  }));
+
+  LI_frame_stats stats = camera.frame_stats();
+  CHECK(count == stats.received);
+  CHECK(2 == stats.gaps);
+  CHECK(2 + 3 == stats.missing);
+  CHECK(0 == stats.dropped);
+
+  // Every frame delivered has its delivery time recorded (its time in
+  // the queue or in the stages, without any, may round down to nothing),
+  // the synthetic ones have no capture time.
+  CHECK(count == stats.delivery.count);
+  CHECK(count >= stats.queueing.count && count >= stats.processing.count);
+  CHECK(0 == stats.capture.count);
+
+  camera.reset_frame_stats();
+  stats = camera.frame_stats();
+  CHECK(0 == stats.received && 0 == stats.gaps && 0 == stats.missing);
+  CHECK(0 == stats.delivered && 0 == stats.delivery.count);
+}
+
+// A stage taking a few milliseconds shows in the percentiles of the
+// processing and of the delivery.
+static void test_percentiles() {
+  LI_stereocamera camera(test_config());
+  LI_test_frame frame(WIDTH, HEIGHT);
+
+  camera.add_stage([](LI_stereo_frame&) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(3));
+    return LI_SUCCESS;
+  });
+
+  for (uint32_t i = 0; i < 20; ++i)
+    camera.push_frame(frame.get(i));
+  CHECK(LI_wait_for([&camera] {
+    return 20 == camera.frame_stats().delivered;
+  }));
+
+  LI_frame_stats stats = camera.frame_stats();
+  CHECK(0 == stats.gaps);
+
+  CHECK(3000 <= stats.processing.percentile_us(0.5));
+  CHECK(stats.processing.percentile_us(0.5) <= stats.processing.percentile_us(0.99));
+  CHECK(stats.processing.percentile_us(0.99) <= stats.processing.max_us);
+  CHECK(3000 <= stats.processing.mean_us());
+
+  CHECK(3000 <= stats.delivery.percentile_us(0.5));
+  CHECK(stats.processing.max_us <= stats.delivery.max_us);
+}
+
+int main() {
+  test_histogram();
+  test_gaps();
+  test_percentiles();
+  return LI_test_result();
+}
@@ -0,0 +1,139 @@
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#define LI_ENABLE_TRACING
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * The tracing of the frame path: spans land in the latency histogram of
+ * their stage and in the ring of their thread, the rings being written as
+ * a Chrome trace and the histograms as text metrics. Built with
+ * LI_ENABLE_TRACING, as the stages of the camera are timed too.
+ */
+
+static const int WIDTH = 64;
+static const int HEIGHT = 48;
+
+static LI_config test_config() {
+  LI_config config;
+  config.workers = 1;
+  config.face_detection = false;
+  config.overflow = LI_BLOCK;
+  config.mode.width = WIDTH;
+  config.mode.height = HEIGHT;
+  return config;
+}
+
+// Spans of exact durations, ending now.
+static void record(const char *name, int count, int us) {
+  LI_tracer& tracer = LI_tracer::instance();
+  unsigned int stage = tracer.stage(name);
+
+  for (int i = 0; i < count; ++i) {
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    tracer.record(stage, end - std::chrono::microseconds(us), end);
+  }
+}
+
+static unsigned int occurrences(const std::string& text, const std::string& what) {
+  unsigned int count = 0;
+  for (size_t at = text.find(what); std::string::npos != at;
+       at = text.find(what, at + what.size()))
+    ++count;
+  return count;
+}
+
+static std::string chrome_trace() {
+  std::ostringstream out;
+  LI_tracer::instance().write_chrome_trace(out);
+  return out.str();
+}
+
+// Stages are told apart by name, and their spans make up their
+// histograms, dumped as metrics.
+static void test_histograms() {
+  LI_tracer& tracer = LI_tracer::instance();
+  CHECK(tracer.stage("test/histogram") == tracer.stage("test/histogram"));
+  CHECK(tracer.stage("test/histogram") != tracer.stage("test/other"));
+  CHECK(0 == tracer.histogram("test/never").count);
+
+  record("test/histogram", 90, 10);
+  record("test/histogram", 10, 1000);
+
+  LI_latency_histogram histogram = tracer.histogram("test/histogram");
+  CHECK(100 == histogram.count);
+  CHECK(1000 == histogram.max_us);
+  CHECK(16 == histogram.percentile_us(0.5));
+  CHECK(1000 == histogram.percentile_us(0.99));
+
+  std::ostringstream out;
+  tracer.write_metrics(out, true);
+  std::string metrics = out.str();
+
+  CHECK(1 == occurrences(metrics,
+    "li_stage_count{stage=\"test/histogram\"} 100\n"));
+  CHECK(1 == occurrences(metrics,
+    "li_stage_latency_us{stage=\"test/histogram\",quantile=\"0.5\"} 16\n"));
+  CHECK(1 == occurrences(metrics,
+    "li_stage_latency_us{stage=\"test/histogram\",quantile=\"0.99\"} 1000\n"));
+  CHECK(1 == occurrences(metrics,
+    "li_stage_latency_max_us{stage=\"test/histogram\"} 1000\n"));
+
+  // The dump started the histograms over.
+  CHECK(0 == tracer.histogram("test/histogram").count);
+}
+
+// Every thread has its own ring, in which the newest spans overwrite the
+// oldest. Names are escaped.
+static void test_chrome_trace() {
+  std::thread([] { record("test/\"quoted\"", 3, 250); }).join();
+  std::thread([] { record("test/lapped", LI_TRACE_EVENTS + 10, 1); }).join();
+
+  std::string trace = chrome_trace();
+  CHECK(0 == trace.find("{\"traceEvents\": ["));
+  CHECK(trace.size() - 4 == trace.rfind("\n]}\n"));
+
+  CHECK(3 == occurrences(trace, "\"name\": \"test/\\\"quoted\\\"\""));
+  CHECK(3 == occurrences(trace, "\"dur\": 250}"));
+  CHECK(LI_TRACE_EVENTS == occurrences(trace, "\"name\": \"test/lapped\""));
+}
+
+// The stages of the camera are timed, on the threads running them.
+static void test_camera() {
+  LI_stereocamera camera(test_config());
+  camera.add_stage([](LI_stereo_frame&) {
+    LI_TRACE_SCOPE("test/stage");
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return LI_SUCCESS;
+  });
+
+  LI_test_frame frame(WIDTH, HEIGHT);
+  for (uint32_t i = 0; i < 10; ++i)
+    camera.push_frame(frame.get(i));
+  CHECK(LI_wait_for([&camera] {
+    return 10 == camera.frame_stats().delivered;
+  }));
+
+  // The conversion span closes once the frame is queued for the stages,
+  // possibly after the frame was delivered.
+  LI_tracer& tracer = LI_tracer::instance();
+  CHECK(LI_wait_for([&tracer] {
+    return 10 == tracer.histogram("convert").count;
+  }));
+  CHECK(10 == tracer.histogram("test/stage").count);
+  CHECK(1000 <= tracer.histogram("test/stage").max_us);
+
+  std::string trace = chrome_trace();
+  CHECK(10 == occurrences(trace, "\"name\": \"test/stage\""));
+  CHECK(10 <= occurrences(trace, "\"name\": \"convert\""));
+}
+
+int main() {
+  test_histograms();
+  test_chrome_trace();
+  test_camera();
+  return LI_test_result();
+}
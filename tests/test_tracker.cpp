@@ -0,0 +1,213 @@
+#include <vector>
+
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * The face tracking between full scans: faces keep the ID of their track
+ * from frame to frame, frames are scanned in full every 'interval' frames
+ * and as soon as a track is lost, stale frames analysed out of order leave
+ * the tracks alone, and a reset (as when the stream restarts) starts over.
+ */
+
+static LI_tracker_config tracker_config(unsigned int interval) {
+  LI_tracker_config config;
+  config.interval = interval;
+  config.max_misses = 2;
+  return config;
+}
+
+// A face of the given size, seen 10 pixels to the left in the right image.
+static LI_face face_at(int x, int y, int size = 40) {
+  LI_face face;
+  face.left = cv::Rect(x, y, size, size);
+  face.right = face.left - cv::Point(10, 0);
+  return face;
+}
+
+static std::vector<int> ids(const std::vector<LI_face>& faces) {
+  std::vector<int> result;
+  for (unsigned int i = 0; i < faces.size(); ++i)
+    result.push_back(faces[i].id);
+  return result;
+}
+
+// Whether a frame is only looked at around the tracked faces, whose
+// boxes are left in 'boxes'.
+static bool tracked(LI_face_tracker& tracker, uint32_t sequence,
+  std::vector<cv::Rect>& boxes) {
+
+  return !tracker.plan(sequence, boxes);
+}
+
+// Faces keep their IDs as they move, whichever order they are found in;
+// new faces get new IDs.
+static void test_ids() {
+  LI_face_tracker tracker(tracker_config(10));
+  std::vector<cv::Rect> boxes;
+
+  CHECK(tracker.plan(0, boxes) && boxes.empty());
+  std::vector<LI_face> faces;
+  faces.push_back(face_at(10, 10));
+  faces.push_back(face_at(200, 50));
+  tracker.update(0, faces, true);
+  CHECK((std::vector<int> { 0, 1 }) == ids(faces));
+  CHECK(2 == tracker.size());
+
+  // Moved a little, found the other way round.
+  CHECK(tracked(tracker, 1, boxes));
+  CHECK((std::vector<cv::Rect> { faces[0].left, faces[1].left }) == boxes);
+
+  std::vector<LI_face> moved;
+  moved.push_back(face_at(205, 52));
+  moved.push_back(face_at(14, 8));
+  tracker.update(1, moved, false);
+  CHECK((std::vector<int> { 1, 0 }) == ids(moved));
+
+  // The tracks follow the faces.
+  CHECK(tracked(tracker, 2, boxes));
+  CHECK((std::vector<cv::Rect> { moved[1].left, moved[0].left }) == boxes);
+
+  // A face missing from the left image is matched by its right box.
+  std::vector<LI_face> more = moved;
+  more[0].left = cv::Rect();
+  more.push_back(face_at(400, 100));
+  tracker.update(2, more, false);
+  CHECK((std::vector<int> { 1, 0, 2 }) == ids(more));
+  CHECK(3 == tracker.size());
+}
+
+// Every 'interval' frames the frame is scanned in full, sequence numbers
+// wrapping around included. An interval of 1 scans every frame.
+static void test_interval() {
+  LI_face_tracker tracker(tracker_config(4));
+  std::vector<cv::Rect> boxes;
+  std::vector<LI_face> faces(1, face_at(10, 10));
+
+  const uint32_t first = 0xfffffffeu;
+  for (uint32_t i = 0; i < 12; ++i) {
+    uint32_t sequence = first + i;
+    CHECK((0 == i % 4) == tracker.plan(sequence, boxes));
+
+    std::vector<LI_face> found = faces;
+    tracker.update(sequence, found, 0 == i % 4);
+    CHECK(0 == found[0].id);
+  }
+
+  LI_face_tracker every(tracker_config(1));
+  for (uint32_t i = 0; i < 5; ++i) {
+    CHECK(every.plan(i, boxes));
+    std::vector<LI_face> found = faces;
+    every.update(i, found, true);
+  }
+}
+
+// A track lost between full scans gets the next frame scanned in full,
+// and is dropped after max_misses frames without its face.
+static void test_lost_track() {
+  LI_face_tracker tracker(tracker_config(10));
+  std::vector<cv::Rect> boxes;
+
+  std::vector<LI_face> both;
+  both.push_back(face_at(10, 10));
+  both.push_back(face_at(200, 50));
+  std::vector<LI_face> one(1, both[0]);
+
+  CHECK(tracker.plan(0, boxes));
+  tracker.update(0, both, true);
+
+  CHECK(tracked(tracker, 1, boxes));
+  std::vector<LI_face> found = one;
+  tracker.update(1, found, false);
+
+  // Missed once in a tracked frame: rescan, the track still being kept.
+  CHECK(tracker.plan(2, boxes));
+  CHECK(2 == tracker.size());
+  found = one;
+  tracker.update(2, found, true);
+
+  // Missed in a full scan too: no rescan for that alone.
+  CHECK(tracked(tracker, 3, boxes));
+  CHECK(2 == boxes.size());
+  found = one;
+  tracker.update(3, found, false);
+  CHECK(1 == tracker.size());
+
+  // The third miss dropped the track, and asked for a rescan.
+  CHECK(tracker.plan(4, boxes));
+  found = both;
+  tracker.update(4, found, true);
+  CHECK((std::vector<int> { 0, 2 }) == ids(found));
+}
+
+// Results of frames older than the last one applied get the IDs of the
+// tracks they match, but neither move nor add nor miss tracks.
+static void test_stale_frames() {
+  LI_face_tracker tracker(tracker_config(10));
+  std::vector<cv::Rect> boxes;
+
+  std::vector<LI_face> faces;
+  faces.push_back(face_at(10, 10));
+  faces.push_back(face_at(200, 50));
+
+  CHECK(tracker.plan(5, boxes));
+  tracker.update(5, faces, true);
+
+  std::vector<LI_face> stale;
+  stale.push_back(face_at(16, 12));
+  stale.push_back(face_at(400, 100));
+  tracker.update(3, stale, false);
+  CHECK((std::vector<int> { 0, -1 }) == ids(stale));
+  CHECK(2 == tracker.size());
+
+  // Face 1, missing from the stale frame, asks for no rescan, and face 0
+  // stays where the newer frame saw it.
+  CHECK(tracked(tracker, 6, boxes));
+  CHECK((std::vector<cv::Rect> { faces[0].left, faces[1].left }) == boxes);
+
+  // Across the wrap-around of the sequence numbers too: a frame from just
+  // before the wrap, missing a face, asks for no rescan either.
+  LI_face_tracker wrapped(tracker_config(10));
+  CHECK(wrapped.plan(2, boxes));
+  wrapped.update(2, faces, true);
+  stale.assign(1, face_at(10, 10));
+  wrapped.update(0xfffffff0u, stale, false);
+  CHECK(0 == stale[0].id && 2 == wrapped.size());
+  CHECK(tracked(wrapped, 3, boxes));
+}
+
+// A reset forgets the tracks: the next frame is scanned in full, and IDs
+// start over, whatever the sequence numbers of the new stream.
+static void test_reset() {
+  LI_face_tracker tracker(tracker_config(10));
+  std::vector<cv::Rect> boxes;
+
+  std::vector<LI_face> faces;
+  faces.push_back(face_at(10, 10));
+  faces.push_back(face_at(200, 50));
+
+  CHECK(tracker.plan(1000, boxes));
+  tracker.update(1000, faces, true);
+  CHECK(tracked(tracker, 1001, boxes));
+
+  tracker.reset();
+  CHECK(0 == tracker.size());
+
+  // The new stream starts with lower sequence numbers, which are not
+  // taken as stale.
+  CHECK(tracker.plan(0, boxes) && boxes.empty());
+  std::vector<LI_face> found(1, faces[1]);
+  tracker.update(0, found, true);
+  CHECK(0 == found[0].id);
+  CHECK(1 == tracker.size());
+  CHECK(tracked(tracker, 1, boxes));
+}
+
+int main() {
+  test_ids();
+  test_interval();
+  test_lost_track();
+  test_stale_frames();
+  test_reset();
+  return LI_test_result();
+}
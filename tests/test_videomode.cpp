@@ -0,0 +1,173 @@
+#include <cstring>
+
+#include "LI_test.hpp"
+#include "LI_stereocamera.hpp"
+
+/*
+ * The video modes: listing those advertised by the format descriptors of
+ * a device, and picking the one to stream among them.
+ */
+
+static const uint32_t FPS_30 = 333333;
+static const uint32_t FPS_15 = 666666;
+static const uint32_t FPS_10 = 1000000;
+
+// Format descriptors as libuvc builds them from the USB descriptors: a
+// YUY2 format with a size offering a list of intervals and a size offering
+// a range of them, and an MJPEG format.
+struct test_descriptors {
+  uvc_format_desc_t yuy2, mjpeg;
+  uvc_frame_desc_t vga, wide, mjpeg_vga;
+  uint32_t vga_intervals[3], mjpeg_intervals[2];
+
+  test_descriptors() :
+    yuy2(),
+    mjpeg(),
+    vga(),
+    wide(),
+    mjpeg_vga(),
+    vga_intervals(),
+    mjpeg_intervals() {
+
+    std::memcpy(this->yuy2.fourccFormat, "YUY2", 4);
+    this->yuy2.frame_descs = &this->vga;
+    this->yuy2.next = &this->mjpeg;
+    this->mjpeg.prev = &this->yuy2;
+
+    this->vga.wWidth = 640;
+    this->vga.wHeight = 480;
+    this->vga.bFrameIntervalType = 2;
+    this->vga_intervals[0] = FPS_30;
+    this->vga_intervals[1] = FPS_15;
+    this->vga.intervals = this->vga_intervals;
+    this->vga.next = &this->wide;
+    this->wide.prev = &this->vga;
+
+    // Continuous intervals, with the default one equal to the shortest.
+    this->wide.wWidth = 1280;
+    this->wide.wHeight = 480;
+    this->wide.dwMinFrameInterval = FPS_30;
+    this->wide.dwDefaultFrameInterval = FPS_30;
+    this->wide.dwMaxFrameInterval = FPS_10;
+
+    std::memcpy(this->mjpeg.fourccFormat, "MJPG", 4);
+    this->mjpeg.frame_descs = &this->mjpeg_vga;
+    this->mjpeg_vga.wWidth = 640;
+    this->mjpeg_vga.wHeight = 480;
+    this->mjpeg_vga.bFrameIntervalType = 1;
+    this->mjpeg_intervals[0] = FPS_30;
+    this->mjpeg_vga.intervals = this->mjpeg_intervals;
+  }
+};
+
+static bool same(
+  const LI_video_mode& mode,
+  uint32_t fourcc, int width, int height, uint32_t interval) {
+
+  return fourcc == mode.fourcc && width == mode.width &&
+    height == mode.height && interval == mode.interval;
+}
+
+// Every size of every format, with each of its intervals (a range giving
+// its distinct ends and default).
+static void test_enumerate() {
+  test_descriptors descriptors;
+  std::vector<LI_video_mode> modes;
+
+  LI_stereocamera::enumerate_modes(&descriptors.yuy2, modes);
+
+  CHECK(5 == modes.size());
+  if (5 != modes.size())
+    return;
+
+  CHECK(same(modes[0], LI_FOURCC_YUY2, 640, 480, FPS_30));
+  CHECK(same(modes[1], LI_FOURCC_YUY2, 640, 480, FPS_15));
+  CHECK(same(modes[2], LI_FOURCC_YUY2, 1280, 480, FPS_30));
+  CHECK(same(modes[3], LI_FOURCC_YUY2, 1280, 480, FPS_10));
+  CHECK(same(modes[4], LI_FOURCC('M', 'J', 'P', 'G'), 640, 480, FPS_30));
+
+  CHECK(30 == modes[0].fps() && 15 == modes[1].fps() && 10 == modes[3].fps());
+
+  // A device without descriptors has no modes (and the list is cleared).
+  LI_stereocamera::enumerate_modes(NULL, modes);
+  CHECK(modes.empty());
+}
+
+// The policies, among the YUY2 modes only.
+static void test_select() {
+  test_descriptors descriptors;
+  std::vector<LI_video_mode> modes;
+  LI_stereocamera::enumerate_modes(&descriptors.yuy2, modes);
+
+  LI_mode_request request;
+  LI_video_mode selected;
+
+  CHECK(LI_select_mode(modes, request, selected));
+  CHECK(same(selected, LI_FOURCC_YUY2, 640, 480, FPS_30));
+
+  request.fps = 14;
+  CHECK(LI_select_mode(modes, request, selected));
+  CHECK(same(selected, LI_FOURCC_YUY2, 640, 480, FPS_15));
+
+  request.width = 1200;
+  request.fps = 5;
+  CHECK(LI_select_mode(modes, request, selected));
+  CHECK(same(selected, LI_FOURCC_YUY2, 1280, 480, FPS_10));
+
+  request.policy = LI_MODE_HIGHEST_FPS;
+  CHECK(LI_select_mode(modes, request, selected));
+  CHECK(same(selected, LI_FOURCC_YUY2, 1280, 480, FPS_30));
+
+  request.policy = LI_MODE_LOWEST_LATENCY;
+  CHECK(LI_select_mode(modes, request, selected));
+  CHECK(same(selected, LI_FOURCC_YUY2, 640, 480, FPS_30));
+
+  request.policy = LI_MODE_EXACT;
+  request.width = 1280;
+  request.fps = 10;
+  CHECK(LI_select_mode(modes, request, selected));
+  CHECK(same(selected, LI_FOURCC_YUY2, 1280, 480, FPS_10));
+
+  // No exact match leaves the selection alone.
+  request.fps = 60;
+  CHECK(!LI_select_mode(modes, request, selected));
+  CHECK(same(selected, LI_FOURCC_YUY2, 1280, 480, FPS_10));
+
+  // Nor does a device with MJPEG modes only.
+  LI_stereocamera::enumerate_modes(&descriptors.mjpeg, modes);
+  request.policy = LI_MODE_CLOSEST;
+  CHECK(1 == modes.size());
+  CHECK(!LI_select_mode(modes, request, selected));
+}
+
+// A camera advertising no mode is asked for the requested one as is.
+static void test_fallback() {
+  std::vector<LI_video_mode> modes;
+  LI_mode_request request;
+  request.width = 320;
+  request.height = 240;
+  request.fps = 25;
+
+  LI_video_mode chosen;
+  CHECK(LI_choose_mode(modes, request, chosen));
+  CHECK(same(chosen, LI_FOURCC_YUY2, 320, 240, 400000));
+  CHECK(25 == chosen.fps());
+
+  // Advertised modes are chosen from...
+  test_descriptors descriptors;
+  LI_stereocamera::enumerate_modes(&descriptors.yuy2, modes);
+  CHECK(LI_choose_mode(modes, request, chosen));
+  CHECK(same(chosen, LI_FOURCC_YUY2, 640, 480, FPS_30));
+
+  // ...and if none fits, the request is kept but reported.
+  request.policy = LI_MODE_EXACT;
+  CHECK(!LI_choose_mode(modes, request, chosen));
+  CHECK(same(chosen, LI_FOURCC_YUY2, 320, 240, 400000));
+}
+
+int main() {
+  test_enumerate();
+  test_select();
+  test_fallback();
+  return LI_test_result();
+}